@@ -33,7 +33,9 @@ Matching:
 
  match_notes() is called if there is no temporal quantization
  (exact matching).
- match_samples() is called if there is temporal quantization.
+ match_bar_image() is called if there is temporal quantization.
+ It compares byte copies of the images and leaves the cases it
+ cannot handle to match_samples().
 
  difference_midipitch() is called if we are doing contour
  matching on the temporal quantized images. For exact matching
@@ -49,10 +51,24 @@ Matching:
 
 
 
-#define VERSION "1.70 November 15 2015 abcmatch"
+#define VERSION "1.71 October 18 2026 abcmatch"
 #include <stdio.h>
 #include <stdlib.h>
 #include <ctype.h>
+#include <string.h>
+#include <limits.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+/* -j scans the file in several child processes */
+#if !defined(_WIN32) && !defined(__MSDOS__)
+#define SCANFORK
+#define SERVESOCKET
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <signal.h>
+#include <unistd.h>
+#endif
 #include "abc.h"
 #include "parseabc.h"
 
@@ -111,14 +127,14 @@ extern int voicesused;
 */
 
 /* data structure for input to matcher. */
-int imidipitch[2000];		/* pitch-barline midi note representation of input tune */
-int inotelength[2000];		/* notelength representation of input tune */
+int *imidipitch;		/* pitch-barline midi note representation of input tune */
+int *inotelength;		/* notelength representation of input tune */
 int innotes;			/*number of notes in imidipitch,inotelength representation */
 int inbars;			/*number of bars in input tune */
-int ibarlineptr[500];		/*pointers to bar lines in imidipitch */
+int *ibarlineptr;		/*pointers to bar lines in imidipitch */
 int itimesig_num, itimesig_denom;
-int imaxnotes = 2000;		/* maximum limits of this program */
-int imaxbars = 200;
+int imaxnotes = 0;		/* space allocated by reserve_input () */
+int imaxbars = 0;
 int resolution = 12;		/* default to 1/8 note resolution */
 int anymode = 0;		/* default to matching all bars */
 int ignore_simple = 0;		/* ignore simple bars */
@@ -135,19 +151,21 @@ int wpintv = 0;			/* flag for computing interval pdf */
 int wpipdf  = 0;		/* flag for computing interval pdf for each tune*/
 int norhythm = 0;		/* ignore note lengths */
 int levdist = 0;		/* levenshtein distance */
+int anykey = 0;			/* -anykey, transpose bars to match */
 
 char *templatefile;
 
 /* data structure for matcher (template) (usually match.abc)*/
-int tpmidipitch[1000];		/*pitch-barline representation for template */
-int tpnotelength[1000];		/*note lengths for template */
+int *tpmidipitch;		/*pitch-barline representation for template */
+int *tpnotelength;		/*note lengths for template */
 int tpnotes;			/* number of notes in template */
 int tpbars;			/* number of bar lines in template */
-int tpbarlineptr[300];		/* I don't expect 300 bar lines, but lets play safe */
+int *tpbarlineptr;		/* pointers to bar lines in tpmidipitch */
 int tptimesig_num, tptimesig_denom;
-int tpmaxnotes = 1000;		/* maximum limits of this program */
-int tpmaxbars = 300;
-unsigned char tpbarstatus[300];
+int tpmaxnotes = 0;		/* space allocated by reserve_template () */
+int tpmaxbars = 0;
+unsigned char *tpbarstatus;
+int tpbarreset;			/* tpbarstatus was cleared by brief mode */
 
 int pitch_histogram[128];
 int weighted_pitch_histogram[128];
@@ -175,8 +193,19 @@ int sf2midishift[] = { 11, 6, 1, 8, 3, 10, 5, 0, 7, 2, 9, 4, 11, 6, 1, };
  * a time for the input tune.
  */
 
-int ipitch_samples[400], isamples;
-int mpitch_samples[4000], msamples[160];	/* maximum number of bars 160 */
+int *ipitch_samples, isamples;
+int *mpitch_samples, *msamples;
+int imaxsamples = 0, mmaxsamples = 0;	/* space allocated */
+int *mimageoffset;		/* start of each template bar in mpitch_samples */
+int *mfirstpitch;		/* first pitch of each template image (-anykey) */
+
+/* the same images with one byte per sample (see encode_image ()),
+ * the template bars packed one after the other like mpitch_samples
+ */
+unsigned char *icodes;
+int icodable, iwild;		/* input image has codes, has wild samples */
+unsigned char *mcodes;
+char *mcodable, *mwild;
 
 char titlename[48];
 char keysignature[16];
@@ -185,13 +214,130 @@ int tpxref = 0; /* template reference number */
 int tp_fileindex = 0; /* file sequence number for tpxref */
 
 
+void *
+growspace (void *array, int oldsize, int newsize)
+/* reallocates an array, clearing the new part */
+{
+  char *p;
+
+  p = (char *) realloc (array, newsize);
+  if (p == NULL)
+    {
+      printf ("abcmatch: out of memory\n");
+      exit (1);
+    }
+  memset (p + oldsize, 0, newsize - oldsize);
+  return p;
+}
+
+
+int
+roomfor (int allocated, int needed)
+/* returns the new size of an array which has to hold needed items */
+{
+  if (needed <= allocated)
+    return allocated;
+  if (allocated == 0)
+    allocated = 256;
+  while (allocated < needed)
+    allocated = 2 * allocated;
+  return allocated;
+}
+
+
+void
+reserve_input (int nfeatures)
+/* makes room in the input arrays for a tune with nfeatures features.
+   make_note_representation () makes at most one entry per feature,
+   plus two bar lines at the end. */
+{
+  int n;
+
+  n = roomfor (imaxnotes, nfeatures + 2);
+  if (n > imaxnotes)
+    {
+      imidipitch = (int *) growspace (imidipitch, imaxnotes * sizeof (int),
+				      n * sizeof (int));
+      inotelength = (int *) growspace (inotelength,
+				       imaxnotes * sizeof (int),
+				       n * sizeof (int));
+      imaxnotes = n;
+    }
+  n = roomfor (imaxbars, nfeatures + 2);
+  if (n > imaxbars)
+    {
+      ibarlineptr = (int *) growspace (ibarlineptr, imaxbars * sizeof (int),
+				       n * sizeof (int));
+      imaxbars = n;
+    }
+}
+
+
+void
+reserve_template (int nfeatures)
+/* the same for the template and its bar arrays */
+{
+  int n;
+
+  n = roomfor (tpmaxnotes, nfeatures + 2);
+  if (n > tpmaxnotes)
+    {
+      tpmidipitch = (int *) growspace (tpmidipitch,
+				       tpmaxnotes * sizeof (int),
+				       n * sizeof (int));
+      tpnotelength = (int *) growspace (tpnotelength,
+					tpmaxnotes * sizeof (int),
+					n * sizeof (int));
+      tpmaxnotes = n;
+    }
+  n = roomfor (tpmaxbars, nfeatures + 2);
+  if (n > tpmaxbars)
+    {
+      tpbarlineptr = (int *) growspace (tpbarlineptr,
+					tpmaxbars * sizeof (int),
+					n * sizeof (int));
+      tpbarstatus = (unsigned char *) growspace (tpbarstatus, tpmaxbars, n);
+      msamples = (int *) growspace (msamples, tpmaxbars * sizeof (int),
+				    n * sizeof (int));
+      mimageoffset = (int *) growspace (mimageoffset,
+					tpmaxbars * sizeof (int),
+					n * sizeof (int));
+      mfirstpitch = (int *) growspace (mfirstpitch,
+				       tpmaxbars * sizeof (int),
+				       n * sizeof (int));
+      mcodable = (char *) growspace (mcodable, tpmaxbars, n);
+      mwild = (char *) growspace (mwild, tpmaxbars, n);
+      tpmaxbars = n;
+    }
+}
+
+
+void
+reserve_samples (int **samples, unsigned char **codes, int *maxsamples,
+		 int n)
+/* makes room for n samples in a bar image and its byte copy */
+{
+  int newmax;
+
+  newmax = roomfor (*maxsamples, n);
+  if (newmax > *maxsamples)
+    {
+      *samples = (int *) growspace (*samples, *maxsamples * sizeof (int),
+				    newmax * sizeof (int));
+      *codes = (unsigned char *) growspace (*codes, *maxsamples, newmax);
+      *maxsamples = newmax;
+    }
+}
+
+
 void
-make_note_representation (int *nnotes, int *nbars, int maxnotes, int maxbars,
+make_note_representation (int *nnotes, int *nbars,
 			  int *timesig_num, int *timesig_denom,
 			  int *barlineptr, int *notelength, int *midipitch)
 /* converts between the feature,pitch,num,denom representation to the
    midipitch,notelength,... representation. This simplification does
    not preserve chords, decorations, grace notes etc.
+   The arrays must have room for notes+2 entries (reserve_input ()).
 */
 {
   float fract;
@@ -278,8 +424,7 @@ make_note_representation (int *nnotes, int *nbars, int maxnotes, int maxbars,
 	    midipitch[*nnotes] = BAR;
 	    notelength[*nnotes] = BAR;
 	    (*nnotes)++;
-	    if (*nbars < maxbars) (*nbars)++;
-            else printf("abcmatch too many bars\n");
+	    (*nbars)++;
             }
 	  barlineptr[*nbars] = *nnotes;
 	  break;
@@ -295,18 +440,13 @@ make_note_representation (int *nnotes, int *nbars, int maxnotes, int maxbars,
 	default:
 	  break;
 	}
-      if (*nnotes > 2000)
-	{
-	  printf ("ran out of space for midipitch for xref %d\n",xrefno);
-	  exit (0);
-	}
-      if (*nbars > 599)
-	{
-	  printf ("ran out of space for barlineptr for xref %d\n",xrefno);
-	  exit (0);
-	}
     }
+/* terminate the representation so that nothing is left over from
+   the previous tune */
+  midipitch[*nnotes] = BAR;
+  notelength[*nnotes] = BAR;
   midipitch[*nnotes + 1] = BAR;	/* in case a final bar line is missing */
+  notelength[*nnotes + 1] = BAR;
 /*printf("refno =%d  %d notes %d bar lines  %d/%d time-signature %d sharps\n"
 ,xrefno,(*nnotes),(*nbars),(*timesig_num),(*timesig_denom),sf);*/
 #ifdef DEBUG
@@ -516,10 +656,14 @@ difference_midipitch (int *pitch_samples, int nsamples)
 
 
 
+int *integrated_length;		/* used by make_bar_image () */
+int maxintegrated = 0;
+
 int
 make_bar_image (int bar_number, int resolution,
 		int *barlineptr, int *notelength, int nnotes, int delta_pitch,
-		int *midipitch, int *pitch_samples)
+		int *midipitch, int **samples, unsigned char **codes,
+		int *maxsamples, int start)
 {
 /* the function returns the midipitch at regular time interval
    for bar %d xref %d\n,bar_number,xrefnos
@@ -533,26 +677,41 @@ make_bar_image (int bar_number, int resolution,
 
    input: midipitch[],notelength,resolution,delta_pitch,nnotes
           bar_number
-   output: pitch_samples
+   output: pitch_samples, which is (*samples) + start. The space for
+   the samples and their byte copy (*codes) is enlarged as needed.
 
    the function returns the number of pitch_samples i creates
 
 */
-  int integrated_length[50];	/* maximum of 50 notes in a bar */
 /* integrated_length is the number of time units in the bar after note i;
 */
   int offset, lastnote, lastpulse, lastsample;
   int i, j, t;
+  int *pitch_samples;
   offset = barlineptr[bar_number];
 /* double bar is always placed at the beginning of the tune */
 
   i = 1;
+  if (maxintegrated == 0)
+    {
+      maxintegrated = 64;
+      integrated_length = (int *) growspace (NULL, 0,
+					     maxintegrated * sizeof (int));
+    }
   integrated_length[0] = notelength[offset];
   lastnote = 0;
   while (notelength[i + offset] != BAR)
     {
       if (notelength[i + offset] > 288)
 	return -1;		/* don't try to handle notes longer than 2 whole */
+      if (i >= maxintegrated)
+	{
+	  integrated_length = (int *) growspace (integrated_length,
+						 maxintegrated * sizeof (int),
+						 2 * maxintegrated *
+						 sizeof (int));
+	  maxintegrated = 2 * maxintegrated;
+	}
       integrated_length[i] =
 	integrated_length[i - 1] + notelength[i + offset];
       lastnote = i;
@@ -562,14 +721,12 @@ make_bar_image (int bar_number, int resolution,
 	  /* printf("make_bar_image -- running past last note for bar %d xref %d\n",bar_number,xrefno); */
 	  break;
 	}
-      if (i > 49)
-	{
-	  printf ("make_bar_image -- bar %d has too many notes for xref %d\n",
-		  bar_number, xrefno);
-	  break;
-	}
     }
   lastpulse = integrated_length[lastnote];
+  if (lastpulse > 0)
+    reserve_samples (samples, codes, maxsamples,
+		     start + (lastpulse + resolution - 1) / resolution);
+  pitch_samples = *samples + start;
   i = 0;
   j = 0;
   t = 0;
@@ -585,13 +742,6 @@ make_bar_image (int bar_number, int resolution,
 	    pitch_samples[j] = midipitch[i + offset] + delta_pitch;
 	  j++;
 	  t += resolution;
-	  if (j >= 400)
-	    {
-	      printf
-		("make_bar_image -- pitch_sample is out of space for bar %d xrefno = %d\n",
-		 bar_number, xrefno);
-	      break;
-	    }
 	}
     }
   lastsample = j;
@@ -618,24 +768,174 @@ print_bars (int mbar_number, int ibar_number)
 
 
 
-#define MIN3(a, b, c) ((a) < (b) ? ((a) < (c) ? (a) : (c)) : ((b) < (c) ? (b) : (c)))
- 
-int levenshtein(int *s1, int *s2, int s1len, int s2len) {
-    int  x, y, lastdiag, olddiag; /* [SS] 2015-10-08 removed unsigned */
-    int column[33];
-    for (y = 1; y <= s1len; y++)
-        column[y] = y;
-    for (x = 1; x <= s2len; x++) {
-        column[0] = x;
-        for (y = 1, lastdiag = x-1; y <= s1len; y++) {
-            olddiag = column[y];
-            column[y] = MIN3(column[y] + 1, column[y-1] + 1, lastdiag + (s1[y-1] == s2[x-1] ? 0 : 1));
-            lastdiag = olddiag;
-        }
-       if (column[x] >= levdist) return levdist;
+/* levenshtein distance between the symbol strings s1 and s2.
+ * The distance is computed with the bit-parallel algorithm of
+ * G. Myers (J. ACM 46, 1999) in the form given by H. Hyyro for
+ * strings longer than a machine word: bit i of the vectors pv and
+ * mv records whether the distance increases or decreases going
+ * down from row i to row i+1 of the dynamic programming table, so
+ * a whole column is updated with a few logical operations per
+ * word of s1. The match masks for each distinct symbol of s1 are
+ * looked up by binary search.
+ *
+ * The return value follows the original implementation, which is
+ * only called with s1len == s2len: levdist if the distance is at
+ * least levdist (the computation stops as soon as the remaining
+ * characters of s2 cannot bring it below levdist), 0 if the
+ * distance is below levdist and the strings have at least
+ * 2*levdist symbols, otherwise the distance.
+ */
+
+typedef unsigned long levword;
+#define LEVBITS ((int) (8 * sizeof (levword)))
+
+int *levsymbol;			/* sorted distinct symbols of s1 */
+levword *levpeq;		/* match masks for each symbol in levsymbol */
+levword *levpv, *levmv;		/* vertical deltas + and - */
+int levsize = 0;		/* allocated length of s1 */
+
+int
+levsymbol_index (int c, int nsymbols)
+{
+  int lo, hi, mid;
+
+  lo = 0;
+  hi = nsymbols - 1;
+  while (lo <= hi)
+    {
+      mid = (lo + hi) / 2;
+      if (levsymbol[mid] == c)
+	return mid;
+      if (levsymbol[mid] < c)
+	lo = mid + 1;
+      else
+	hi = mid - 1;
+    }
+  return -1;
+}
+
+int
+levenshtein (int *s1, int *s2, int s1len, int s2len)
+{
+  int i, j, k, b, x, words, nsymbols;
+  int score, hin, hout;
+  levword eq, xv, xh, ph, mh, pv, mv, lastbit;
+  levword *eqs;
+
+  if (s1len == 0)
+    score = s2len;
+  else
+    {
+      words = (s1len + LEVBITS - 1) / LEVBITS;
+      if (s1len > levsize)
+	{
+	  if (levsize > 0)
+	    {
+	      free (levsymbol);
+	      free (levpeq);
+	      free (levpv);
+	      free (levmv);
+	    }
+	  levsize = s1len;
+	  levsymbol = checkmalloc (levsize * sizeof (int));
+	  levpeq = (levword *) checkmalloc (levsize * words * sizeof (levword));
+	  levpv = (levword *) checkmalloc (words * sizeof (levword));
+	  levmv = (levword *) checkmalloc (words * sizeof (levword));
+	}
+/* distinct symbols of s1 in increasing order (bars are short) */
+      nsymbols = 0;
+      for (i = 0; i < s1len; i++)
+	{
+	  for (j = nsymbols; j > 0 && levsymbol[j - 1] > s1[i]; j--)
+	    ;
+	  if (j > 0 && levsymbol[j - 1] == s1[i])
+	    continue;
+	  for (k = nsymbols; k > j; k--)
+	    levsymbol[k] = levsymbol[k - 1];
+	  levsymbol[j] = s1[i];
+	  nsymbols++;
+	}
+      for (i = 0; i < nsymbols * words; i++)
+	levpeq[i] = 0;
+      for (i = 0; i < s1len; i++)
+	levpeq[levsymbol_index (s1[i], nsymbols) * words + i / LEVBITS] |=
+	  (levword) 1 << (i % LEVBITS);
+      for (b = 0; b < words; b++)
+	{
+	  levpv[b] = ~(levword) 0;
+	  levmv[b] = 0;
+	}
+      lastbit = (levword) 1 << ((s1len - 1) % LEVBITS);
+      score = s1len;
+      for (x = 0; x < s2len; x++)
+	{
+	  k = levsymbol_index (s2[x], nsymbols);
+	  eqs = (k < 0) ? NULL : levpeq + k * words;
+	  hin = 1;		/* the top row increases by one each step */
+	  for (b = 0; b < words; b++)
+	    {
+	      eq = (eqs == NULL) ? 0 : eqs[b];
+	      pv = levpv[b];
+	      mv = levmv[b];
+	      xv = eq | mv;
+	      if (hin < 0)
+		eq |= 1;
+	      xh = (((eq & pv) + pv) ^ pv) | eq;
+	      ph = mv | ~(xh | pv);
+	      mh = pv & xh;
+	      if (b == words - 1)
+		{
+		  if (ph & lastbit)
+		    score++;
+		  if (mh & lastbit)
+		    score--;
+		}
+	      hout = 0;
+	      if (ph >> (LEVBITS - 1))
+		hout = 1;
+	      if (mh >> (LEVBITS - 1))
+		hout = -1;
+	      ph <<= 1;
+	      mh <<= 1;
+	      if (hin < 0)
+		mh |= 1;
+	      else if (hin > 0)
+		ph |= 1;
+	      levpv[b] = mh | ~(xv | ph);
+	      levmv[b] = ph & xv;
+	      hin = hout;
+	    }
+/* each remaining symbol of s2 can lower the distance by one at most */
+	  if (score - (s2len - 1 - x) >= levdist)
+	    return levdist;
+	}
+    }
+  if (score >= levdist)
+    return levdist;
+  if (s1len / (2 * levdist) >= 1)
+    return 0;
+  return score;
+}
+
+
+int *string1, *string2;		/* symbol strings compared by levenshtein */
+int stringsize = 0;		/* allocated length of string1 and string2 */
+
+void
+reserve_strings (int n)
+/* makes room for n symbols in string1 and string2 */
+{
+  if (n <= stringsize)
+    return;
+  while (stringsize < n)
+    stringsize = (stringsize == 0) ? 64 : 2 * stringsize;
+  string1 = (int *) realloc (string1, stringsize * sizeof (int));
+  string2 = (int *) realloc (string2, stringsize * sizeof (int));
+  if (string1 == NULL || string2 == NULL)
+    {
+      printf ("abcmatch: out of memory\n");
+      exit (1);
     }
-    if (column[s1len] < levdist && s1len/(2*levdist)>= 1) return 0;
-    return(column[s1len]);
 }
 
 int perfect_match (int *s1, int *s2, int s1len) {
@@ -658,7 +958,6 @@ match_notes (int mbar_number, int ibar_number, int delta_pitch)
   int ioffset, moffset;
   int tplastnote,lastnote; /* for contour matching */
   int deltapitch,deltapitchtp;
-  int string1[32],string2[32];
 
   ioffset = ibarlineptr[ibar_number];
   moffset = tpbarlineptr[mbar_number];
@@ -671,6 +970,8 @@ match_notes (int mbar_number, int ibar_number, int delta_pitch)
     return -1;			/* in case nothing in bar */
   while (tpmidipitch[i + moffset] != BAR)
     {
+      if (i + ioffset >= innotes)
+	return -1;		/* template runs past the end of the tune */
       /*printf("%d %d\n",imidipitch[i+ioffset],tpmidipitch[i+moffset]);*/
       if (imidipitch[i + ioffset] == RESTNOTE
 	  && tpmidipitch[i + moffset] == RESTNOTE)
@@ -702,10 +1003,10 @@ match_notes (int mbar_number, int ibar_number, int delta_pitch)
 	     deltapitch = quantize7 (deltapitch);
              deltapitchtp = quantize7(deltapitchtp);
              }
+          reserve_strings (notes + 1);
           string1[notes] = 256*deltapitch + inotelength[i + ioffset];
           string2[notes] = 256*deltapitchtp + tpnotelength[i + moffset];
-          if (notes < 32) notes++;
-          else printf("notes > 32\n");
+          notes++;
 
          /* printf("%d %d\n",deltapitch,deltapitchtp);*/
           }
@@ -717,10 +1018,10 @@ match_notes (int mbar_number, int ibar_number, int delta_pitch)
       else  {
 /* absolute matching (with transposition) */
 /*printf("%d %d\n",imidipitch[i+ioffset],tpmidipitch[i+moffset]-delta_pitch);*/
+      reserve_strings (notes + 1);
       string1[notes] = 256*imidipitch[i+ioffset] + inotelength[i + ioffset];
       string2[notes] = 256*(tpmidipitch[i+moffset] - delta_pitch) + tpnotelength[i + moffset];
-      if (notes < 32) notes++;
-      else printf("notes > 32\n");
+      notes++;
       }
   i++;
   }    
@@ -747,7 +1048,6 @@ fixed_match_notes (int fnotes, int mbar_number, int ibar_number, int delta_pitch
   int ioffset, moffset;
   int tplastnote,lastnote; /* for contour matching */
   int deltapitch,deltapitchtp;
-  int string1[32],string2[32];
   ioffset = ibarlineptr[ibar_number];
   moffset = tpbarlineptr[mbar_number];
   /*printf("ioffset = %d moffset = %d\n",ioffset,moffset);*/ 
@@ -757,6 +1057,8 @@ fixed_match_notes (int fnotes, int mbar_number, int ibar_number, int delta_pitch
   tplastnote =0;
   while (notes < fnotes)
     {
+      if (j + ioffset >= innotes)
+	return -1;		/* ran out of notes in the tune */
       /*printf("%d %d\n",imidipitch[j+ioffset],tpmidipitch[i+moffset]);*/
       if (imidipitch[j + ioffset] == RESTNOTE
 	  || imidipitch[j + ioffset] == BAR)
@@ -795,10 +1097,10 @@ fixed_match_notes (int fnotes, int mbar_number, int ibar_number, int delta_pitch
 	     deltapitch = quantize7 (deltapitch);
              deltapitchtp = quantize7(deltapitchtp);
              }
+          reserve_strings (notes + 1);
           string1[notes] = 256*deltapitch + inotelength[j + ioffset];
           string2[notes] = 256*deltapitchtp + tpnotelength[i + moffset];
-          if (notes < 32) notes++;
-          else printf("notes > 32\n");
+          notes++;
           
           /* printf("deltapitch  %d %d\n",deltapitch,deltapitchtp);
              printf("length %d %d\n",inotelength[j + ioffset],tpnotelength[i+moffset]);
@@ -818,10 +1120,10 @@ fixed_match_notes (int fnotes, int mbar_number, int ibar_number, int delta_pitch
        printf("%d %d\n",inotelength[j+ioffset],tpnotelength[i+moffset]);
      */
      
+      reserve_strings (notes + 1);
       string1[notes] = 256*imidipitch[j+ioffset] + inotelength[j + ioffset];
       string2[notes] = 256*(tpmidipitch[i+moffset] - delta_pitch) + tpnotelength[i + moffset];
-      if (notes < 32) notes++;
-      else printf("notes > 32\n");
+      notes++;
       }
 
   i++;
@@ -836,6 +1138,79 @@ fixed_match_notes (int fnotes, int mbar_number, int ibar_number, int delta_pitch
 
 
 
+/* With -anykey the transposition is not taken from the key
+ * signatures. Each template bar is compared with a tune bar at the
+ * transposition which makes their first notes agree, and the match
+ * is then verified note by note as usual, so the shift reported is
+ * the real one. The bar fingerprints are relative to the first note
+ * of the bar, so the index finds the candidates in any key.
+ */
+
+int matchshift;			/* delta_pitch of the last match found */
+
+int
+note_shift (int mbar_number, int ibar_number, int *delta_pitch)
+/* sets delta_pitch (as passed to match_notes () or fixed_match_notes ())
+   to the transposition making the first notes of the two bars agree.
+   Returns 0, leaving it alone, if either bar has no note. */
+{
+  int i, j;
+
+  i = tpbarlineptr[mbar_number];
+  j = ibarlineptr[ibar_number];
+  while (i < tpnotes && j < innotes)
+    {
+      if (fixednumberofnotes)
+	{
+/* fixed_match_notes () passes over rests and bar lines */
+	  if (imidipitch[j] == RESTNOTE || imidipitch[j] == BAR)
+	    {
+	      j++;
+	      continue;
+	    }
+	  if (tpmidipitch[i] == RESTNOTE || tpmidipitch[i] == BAR)
+	    {
+	      i++;
+	      continue;
+	    }
+	}
+      else if (tpmidipitch[i] == BAR || imidipitch[j] == BAR)
+	return 0;
+      if (tpmidipitch[i] >= 0 && imidipitch[j] >= 0)
+	{
+	  *delta_pitch = tpmidipitch[i] - imidipitch[j];
+	  return 1;
+	}
+      i++;
+      j++;
+    }
+  return 0;
+}
+
+
+int
+compare_bars (int mbar_number, int ibar_number, int delta_pitch)
+/* returns 0 if the template bar matches the tune bar */
+{
+  if (fixednumberofnotes)
+    return fixed_match_notes (fixednumberofnotes, mbar_number, ibar_number,
+			      delta_pitch);
+  return match_notes (mbar_number, ibar_number, delta_pitch);
+}
+
+
+void
+print_bar_number (int barnum, int delta_pitch)
+/* with -anykey each bar is followed by the number of semitones the
+   tune is above the template */
+{
+  if (anykey)
+    printf ("%d:%d ", barnum, -delta_pitch);
+  else
+    printf ("%d ", barnum);
+}
+
+
 /* for debugging */
 void
 print_bar_samples (int mmsamples, int *mmpitch_samples)
@@ -852,10 +1227,10 @@ match_samples (int mmsamples, int *mmpitch_samples)
   int i;
   int changes;
   int last_sample;
-  int string1[32],string2[32];
   int j;
   if (mmsamples != isamples)
     return -1;
+  reserve_strings (mmsamples);
   changes = 0;
   last_sample = ipitch_samples[0];	/* [SS] 2012-02-05 */
   j = 0;
@@ -880,6 +1255,189 @@ match_samples (int mmsamples, int *mmpitch_samples)
 
 
 
+
+/* The sampled bar images are also kept with one byte per sample, so
+ * that an input bar can be compared with the template bars using
+ * memcmp () or a byte loop which the compiler vectorizes. The code
+ * of a sample is IMAGE_REST for a rest, IMAGE_ANY for ANY and the
+ * value + 128 for values from -126 to 127. Samples of -1 are skipped
+ * by match_samples (), so they have to be handled separately.
+ * Images with other values, -lev and -ign go through match_samples ().
+ */
+
+#define IMAGE_REST 0
+#define IMAGE_ANY 1
+#define IMAGE_WILD (-1 + 128)
+
+int
+encode_image (int *samples, int nsamples, unsigned char *codes, int *wild)
+/* returns 0 if some sample has no code */
+{
+  int i;
+
+  *wild = 0;
+  for (i = 0; i < nsamples; i++)
+    {
+      if (samples[i] == RESTNOTE)
+	codes[i] = IMAGE_REST;
+      else if (samples[i] == ANY)
+	codes[i] = IMAGE_ANY;
+      else if (samples[i] >= -126 && samples[i] <= 127)
+	codes[i] = (unsigned char) (samples[i] + 128);
+      else
+	return 0;
+      if (samples[i] == -1)
+	*wild = 1;
+    }
+  return 1;
+}
+
+
+int
+compare_images (unsigned char *a, unsigned char *b, int nsamples)
+/* returns 0 if the images agree except where either one is wild */
+{
+  int i;
+  unsigned char differ;
+
+  differ = 0;
+  for (i = 0; i < nsamples; i++)
+    differ |= (a[i] != b[i]) & (a[i] != IMAGE_WILD) & (b[i] != IMAGE_WILD);
+  return differ ? -1 : 0;
+}
+
+
+int
+match_bar_image (int bar)
+/* same as match_samples (msamples[bar], mpitch_samples + mimageoffset[bar])
+   for the image of the input bar in ipitch_samples and icodes */
+{
+  if (levdist != 0 || ignore_simple || !icodable || !mcodable[bar])
+    return match_samples (msamples[bar], mpitch_samples + mimageoffset[bar]);
+  if (msamples[bar] != isamples)
+    return -1;
+  if (isamples <= 0)
+    return 0;
+  if (!iwild && !mwild[bar])
+    return memcmp (icodes, mcodes + mimageoffset[bar], isamples) ? -1 : 0;
+  return compare_images (icodes, mcodes + mimageoffset[bar], isamples);
+}
+
+
+int
+first_matching_image ()
+/* returns the first template bar matching the input bar image or -1 */
+{
+  int j;
+
+  for (j = 0; j < tpbars; j++)
+    if (match_bar_image (j) == 0)
+      return j;
+  return -1;
+}
+
+
+void
+make_input_image (int bar, int delta_key)
+/* makes the sampled image of a bar of the input tune */
+{
+  isamples = make_bar_image (bar, resolution,
+			     ibarlineptr, inotelength, innotes, delta_key,
+			     imidipitch, &ipitch_samples, &icodes,
+			     &imaxsamples, 0);
+  if (con == 1)
+    difference_midipitch (ipitch_samples, isamples);
+  icodable = encode_image (ipitch_samples, isamples, icodes, &iwild);
+}
+
+
+int
+image_first_pitch (int *samples, int nsamples)
+/* returns the first sample which is a pitch or RESTNOTE if none is */
+{
+  int i;
+
+  for (i = 0; i < nsamples; i++)
+    if (samples[i] >= 0)
+      return samples[i];
+  return RESTNOTE;
+}
+
+
+void
+shift_input_image (int delta_pitch)
+/* transposes the image of the input bar, leaving the wild samples */
+{
+  int i;
+
+  if (delta_pitch == 0)
+    return;
+  for (i = 0; i < isamples; i++)
+    if (ipitch_samples[i] >= 0)
+      ipitch_samples[i] += delta_pitch;
+  icodable = encode_image (ipitch_samples, isamples, icodes, &iwild);
+}
+
+
+int
+first_shifted_image (int *delta_pitch)
+/* for -anykey: returns the first template bar matching the input bar
+   image when it is transposed to the first pitch of that bar, or -1.
+   The image is left with that transposition. */
+{
+  int j, first, shift;
+
+  first = image_first_pitch (ipitch_samples, isamples);
+  shift = 0;
+  for (j = 0; j < tpbars; j++)
+    {
+      if (first != RESTNOTE && mfirstpitch[j] != RESTNOTE)
+	{
+	  shift_input_image (mfirstpitch[j] - first - shift);
+	  shift = mfirstpitch[j] - first;
+	}
+      if (match_bar_image (j) == 0)
+	{
+	  *delta_pitch = shift;
+	  return j;
+	}
+    }
+  return -1;
+}
+
+
+void
+make_template_images ()
+/* makes the sampled images of the template bars */
+{
+  int i, moffset, wild;
+
+  moffset = 0;
+  for (i = 0; i < tpbars; i++)
+    {
+      msamples[i] =
+	make_bar_image (i, resolution,
+			tpbarlineptr, tpnotelength, tpnotes, 0,
+			tpmidipitch, &mpitch_samples, &mcodes,
+			&mmaxsamples, moffset);
+      mimageoffset[i] = moffset;
+      mcodable[i] = 0;
+      mwild[i] = 0;
+      mfirstpitch[i] = RESTNOTE;
+      if (msamples[i] < 1)
+	continue;
+      mfirstpitch[i] = image_first_pitch (mpitch_samples + moffset,
+					  msamples[i]);
+      if (con == 1)
+	difference_midipitch (mpitch_samples + moffset, msamples[i]);
+      mcodable[i] = encode_image (mpitch_samples + moffset, msamples[i],
+				  mcodes + moffset, &wild);
+      mwild[i] = wild;
+      moffset += msamples[i];
+    }
+}
+
+
 int
 match_any_bars (int tpbars, int barnum, int delta_key, int nmatches)
 {
@@ -889,66 +1447,56 @@ match_any_bars (int tpbars, int barnum, int delta_key, int nmatches)
  * of the variable called resolution.
 
  * The template is not passed as an argument but is accessed from
- * the global arrays, tpmidipitch[1000] and tpnotelength[1000].
+ * the global arrays, tpmidipitch and tpnotelength.
  */
 
   int kmatches;
-  int moffset, j, dif;
+  int j, dif, delta;
 /* for every bar in match sample */
   kmatches = nmatches;
-  moffset = 0;
   if (resolution > 0)
     {
-      isamples = make_bar_image (barnum, resolution, 
-				 ibarlineptr, inotelength, innotes, delta_key,
-				 imidipitch,ipitch_samples);
+      delta = delta_key;
+      if (anykey)
+	make_input_image (barnum, 0);
+      else
+	make_input_image (barnum, delta_key);
       if (isamples < 1)
 	return kmatches;
-      if (con == 1)
-	difference_midipitch (ipitch_samples, isamples);
-      for (j = 0; j < tpbars; j++)
+      if (anykey)
+	j = first_shifted_image (&delta);
+      else
+	j = first_matching_image ();
+      if (j >= 0)
 	{
-
-	  dif = match_samples (msamples[j], mpitch_samples + moffset);
-/* debugging 
-          printf("bar %d\n",j);
-          print_bar_samples(msamples[j],mpitch_samples+moffset);
-          /*printf("dif = %d\n\n",dif);*/
-
-
-
-	  moffset += msamples[j];
-	  if (dif == 0)
-	    {
-              if (tpxref > 0) tpbarstatus[j] = 1;
-	      kmatches++;
-	      if (kmatches == 1)
-		printf ("%d %d  %d ", fileindex, xrefno, barnum);
+          if (tpxref > 0) tpbarstatus[j] = 1;
+	  kmatches++;
+	  if (kmatches == 1)
+	    printf ("%d %d  ", fileindex, xrefno);
 /* subtract one from bar because first bar always seems to be 2 */
-	      else
-		printf (" %d ", barnum );
-	      break;
-	    }
+	  else
+	    printf (" ");
+	  print_bar_number (barnum, delta);
 	}
     }
   else				/* exact match */
     {
       for (j = 0; j < tpbars; j++)
 	{
-          if (fixednumberofnotes) 
-  	    dif = fixed_match_notes (fixednumberofnotes,j, barnum, delta_key);
-          else
-  	    dif = match_notes (j, barnum, delta_key);
-  
+	  delta = delta_key;
+	  if (anykey)
+	    note_shift (j, barnum, &delta);
+	  dif = compare_bars (j, barnum, delta);
 
 	  if (dif == 0)
 	    {
               if (tpxref > 0) tpbarstatus[j] = 1;
 	      kmatches++;
 	      if (kmatches == 1)
-		printf ("%d %d  %d ", fileindex, xrefno, barnum);
+		printf ("%d %d  ", fileindex, xrefno);
 	      else
-		printf (" %d ", barnum );
+		printf (" ");
+	      print_bar_number (barnum, delta);
 	      break;
 	    }			/* dif condition */
 	}			/*for loop */
@@ -957,6 +1505,8 @@ match_any_bars (int tpbars, int barnum, int delta_key, int nmatches)
 }
 
 
+#define MAXALLBARS 17		/* template bars compared by match_all_bars () */
+
 int
 match_all_bars (int tpbars, int barnum, int delta_key, int nmatches)
 {
@@ -965,50 +1515,55 @@ match_all_bars (int tpbars, int barnum, int delta_key, int nmatches)
    must match in the same sequence in order to be reported.
    It runs in one of two modes depending on the value of resolution.
 */
-  int kmatches;
-  int moffset, j, dif;
-  int matched_bars[20];
+  int j, dif, first, shifted;
+/* only the first MAXALLBARS bars of a longer template are matched */
+  if (tpbars > MAXALLBARS)
+    tpbars = MAXALLBARS;
 /* for every bar in match sample */
-  kmatches = 0;
-  moffset = 0;
   if (resolution > 0)
-    for (j = 0; j < tpbars; j++)
-      {
-	isamples = make_bar_image (barnum + j, resolution, 
-				   ibarlineptr, inotelength, innotes,
-				   delta_key, imidipitch ,ipitch_samples);
-	if (con == 1)
-	  difference_midipitch (ipitch_samples, isamples);
-	dif = match_samples (msamples[j], mpitch_samples + moffset);
-	moffset += msamples[j];
-	if (dif != 0)
-	  return nmatches;
-	matched_bars[kmatches] = barnum + j ;
-	kmatches++;
-	if (j > 15)
-	  break;
-      }
+    {
+/* with -anykey all the bars take the transposition of the first
+   template bar having a note */
+      shifted = 0;
+      for (j = 0; j < tpbars; j++)
+	{
+	  if (anykey)
+	    {
+	      make_input_image (barnum + j, 0);
+	      first = image_first_pitch (ipitch_samples, isamples);
+	      if (!shifted && first != RESTNOTE && mfirstpitch[j] != RESTNOTE)
+		{
+		  delta_key = mfirstpitch[j] - first;
+		  shifted = 1;
+		}
+	      shift_input_image (delta_key);
+	    }
+	  else
+	    make_input_image (barnum + j, delta_key);
+	  dif = match_bar_image (j);
+	  if (dif != 0)
+	    return nmatches;
+	}
+    }
   else
-    for (j = 0; j < tpbars; j++)
-      {
-        if (fixednumberofnotes)
-	  dif = fixed_match_notes (fixednumberofnotes,j, barnum + j, delta_key);
-        else
-	  dif = match_notes (j, barnum + j, delta_key);
-	if (dif != 0)
-	  return nmatches;
-	matched_bars[kmatches] = barnum + j ;
-        /*printf("matched %d\n",barnum+j-1);*/
-	kmatches++;
-	if (j > 15)
-	  break;
-      }
+    {
+      if (anykey)
+	for (j = 0; j < tpbars && !note_shift (j, barnum + j, &delta_key);
+	     j++);
+      for (j = 0; j < tpbars; j++)
+	{
+	  dif = compare_bars (j, barnum + j, delta_key);
+	  if (dif != 0)
+	    return nmatches;
+	}
+    }
 
+/* the matched bars are barnum, barnum+1, ... */
   if (nmatches == 0)
     printf ("%d %d ", fileindex, xrefno);
-  for (j = 0; j < kmatches; j++)
-    printf ("%d ", matched_bars[j]);
-  return kmatches + nmatches;
+  for (j = 0; j < tpbars; j++)
+    print_bar_number (barnum + j, delta_key);
+  return tpbars + nmatches;
 }
 
 
@@ -1060,141 +1615,1979 @@ find_first_matching_tune_bar (int mbarnumber, int inbars, int transpose)
       if (dif == 0)
 	return i;
     }
-  return -1;
+  return -1;
+}
+
+
+
+
+int
+find_first_matching_template_bar (int barnumber, int tpbars, int transpose)
+/* given a bar number in the tune, the function looks for
+ * the first bar in the template which matches the tune bar.
+ */
+{
+  int i, dif, delta;
+  for (i = 1; i < tpbars; i++)
+    {
+      delta = transpose;
+      if (anykey)
+	note_shift (i, barnumber, &delta);
+      dif = compare_bars (i, barnumber, delta);
+      if (dif == 0)
+	{
+	  matchshift = delta;
+	  return i;
+	}
+    }
+  return -1;
+}
+
+/* this function is not used */
+int
+count_matched_template_bars (int tpbars, int inbars, int transpose)
+{
+  int i, count, bar;
+  count = 0;
+  for (i = 0; i < tpbars; i++)
+    {
+      bar = find_first_matching_tune_bar (i, inbars, transpose);
+      /*if (bar >= 0) printf ("bar %d matches %d\n",bar,i); */
+      if (bar >= 0)
+	count++;
+    }
+  return count;
+}
+
+
+int briefshift;			/* commonest delta_pitch of the matches */
+
+int
+count_matched_tune_bars (int tpbars, int inbars, int transpose)
+/* used only by brief mode */
+{
+  int i, count, bar, k;
+  int shiftcount[256];
+  count = 0;
+  for (k = 0; k < 256; k++)
+    shiftcount[k] = 0;
+  briefshift = transpose;
+/* find_first_matching_template_bar () is given inbars and looks at
+   template bars up to inbars; their bar line pointers past tpbars
+   are 0, so they repeat the first bar of the template */
+  reserve_template (inbars);
+  for (i=0;i<tpmaxbars;i++) tpbarstatus[i] = 0;
+  tpbarreset = 1;
+  for (i = 0; i < inbars; i++)
+    {
+      bar = find_first_matching_template_bar (i, inbars, transpose);
+      /*if (bar >= 0) {printf ("bar %d matches %d\n",bar,i); 
+         print_bars(bar,i);
+         }
+       */
+      if (bar >= 0) {
+	count++;
+        tpbarstatus[bar] = 1;
+	k = MAX (0, MIN (255, matchshift + 128));
+	if (++shiftcount[k] > shiftcount[briefshift + 128])
+	  briefshift = k - 128;
+        }
+    }
+  return count;
+}
+
+int count_matching_template_bars ()
+{
+int i;
+int count;
+count = 0;
+for (i=0;i<tpmaxbars;i++)
+  if (tpbarstatus[i] > 0) count++;
+return count;
+}  
+
+void startfile(); /* links with matchsup.c */
+
+char *scanfilename;		/* file name printed by the tables */
+int scanfirstpitch = -1;	/* first note of a -j piece for interval_histogram */
+void scan_file (char *filename, void (*process) ());
+
+void
+analyze_tune ()
+/* adds the tune which has just been parsed to the histograms */
+{
+  int i;
+
+/*     printf("fileindex = %d xrefno =%d\n",fileindex,xrefno); */
+/*     printf("%s\n",titlename); */
+  if (notes < 10)
+    return;
+  /*print_feature_list(); */
+  reserve_input (notes);
+  make_note_representation (&innotes, &inbars,
+			    &itimesig_num, &itimesig_denom, ibarlineptr,
+			    inotelength, imidipitch);
+  if (scanfirstpitch == -1)
+    for (i = 0; i < innotes && scanfirstpitch == -1; i++)
+      if (imidipitch[i] >= 0)
+	scanfirstpitch = imidipitch[i];
+  compute_note_histograms ();
+  if (action == cpitch_histogram_table)
+    {
+      printf ("%4d %s %s\n%s\n", xrefno, scanfilename, keysignature,
+	      titlename);
+      make_and_print_pitch_pdf ();
+      init_histograms ();
+    }
+  if (action == interval_pdf_table)
+    {
+      printf ("%4d %s %s\n%s\n", xrefno, scanfilename, keysignature,
+	      titlename);
+      make_and_print_interval_pdf ();
+      init_histograms ();
+    }
+}
+
+int
+analyze_abc_file (char *filename)
+{
+  init_histograms ();
+  scanfilename = filename;
+  scan_file (filename, analyze_tune);
+  switch (action)
+    {
+    case cpitch_histogram:
+      print_pitch_histogram ();
+      break;
+    case cwpitch_histogram:
+      print_weighted_pitch_histogram ();
+      break;
+    case clength_histogram:
+      print_length_histogram ();
+      break;
+    case interval_pdf:
+      print_interval_pdf ();
+      break;
+    }
+  return (0);
+}
+
+/* state of the template shared with match_tune () */
+int mkey;			/* key signature offset of template */
+int mseqno;			/* sequence number of template (match.abc) */
+/* mseqno can differ from xrefnum when running count_matched_tune_bars
+ * because there is no guarantee the xref numbers are in
+ * sequence in the input file. Hopefully fileindex matches sequence
+ * number in script calling this executable.
+ */
+int kfile;			/* number of tunes reported in brief mode */
+int allpairs = 0;		/* -pairs */
+int pairtemplate;		/* tune used as template by -pairs */
+
+int scanworker = 0;		/* set in the child processes of -j */
+long briefheaderpos;		/* where a child would print the header */
+
+void
+print_brief_header ()
+{
+  if (allpairs)
+    printf ("%d %d\n", pairtemplate, tpbars);
+  else
+    printf ("%d\n", tpbars);
+}
+
+
+void
+report_brief (int tune, int transpose)
+/* counts the bars the tune shares with the template and reports
+   them if there are at least cthresh */
+{
+  int count, kount;
+
+  count = count_matched_tune_bars (tpbars, inbars, transpose);
+  kount = count_matching_template_bars();
+  /*if (count >= cthresh) [SS] 2013-11-26 */
+  if (kount >= cthresh)
+    {
+      if (kfile == 0)
+	{
+	  if (scanworker)
+	    {
+/* the parent prints it if no earlier piece reported a tune */
+	      fflush (stdout);
+	      briefheaderpos = ftell (stdout);
+	    }
+	  else
+	    print_brief_header ();
+	}
+      if (anykey)
+	printf (" %d %d %d %d\n", tune, count, kount, -briefshift);
+      else
+	printf (" %d %d %d\n", tune, count,kount);
+      kfile++;
+    }
+}
+
+
+void
+match_tune ()
+/* compares the tune which has just been parsed by parsetune ()
+ * with the template and reports the results.
+ */
+{
+  int ikey;
+  int transpose;
+
+  /*printf("fileindex = %d xrefno =%d\n",fileindex,xrefno); 
+    printf("%s\n",titlename); */
+  if (tpxref == xrefno) {
+     tp_fileindex = fileindex;
+     return;
+     }
+  if (notes < 10)
+    return;
+  ikey = sf2midishift[sf + 7];
+  /*print_feature_list(); */
+  if (voicesused) {/*printf("xref %d has voices\n",xrefno);*/
+                   return;
+                  }
+  reserve_input (notes);
+  make_note_representation (&innotes, &inbars,
+			    &itimesig_num, &itimesig_denom,
+			    ibarlineptr, inotelength, imidipitch);
+
+/* ignore tunes which do not share the same time signature as the template */
+  if ((itimesig_num != tptimesig_num
+      || itimesig_denom != tptimesig_denom)
+     && fixednumberofnotes == 0)
+    return;
+
+
+  transpose = mkey - ikey;
+/* we do not know whether to transpose up or down so we will
+   go in the direction with the smallest number of steps
+  [SS] 2013-11-12
+*/
+  if (transpose > 6) transpose = transpose -12;
+  if (transpose < -6) transpose = transpose + 12;
+
+
+/* brief mode is used by the grouper in runabc.tcl */
+  if (brief)
+    {
+      if (mseqno == fileindex)
+	return;	/* don't check tune against itself */
+      report_brief (fileindex, transpose);
+    }
+
+  else
+/* top level matching function if not brief mode */
+    find_and_report_matching_bars (tpbars, inbars, transpose,
+				   anymode, con);
+}
+
+
+/* Parallel scan (-j).
+ *
+ * The matcher keeps all of its state in globals, so the input file
+ * is divided into pieces starting at tune boundaries and each piece
+ * is parsed by a child process with its output going to a temporary
+ * file. The parent copies the outputs in file order and adds up the
+ * histograms and the other totals, giving the same output as a
+ * serial scan. A piece may only start where the parser does not
+ * depend on what came before it; if any child ends somewhere else
+ * than where the next piece starts, the file is scanned serially.
+ */
+
+int scanjobs = 1;		/* -j */
+
+struct scanpiece
+{
+  long offset;			/* file position of the first record */
+  int line;			/* fileline_number at that position */
+  int index;			/* fileindex before the first record */
+  int xref;			/* xrefno left by the previous tune */
+};
+
+struct scanresult
+{
+  struct scanpiece end;		/* state after the last record */
+  int clean;			/* parser state does not carry over */
+  int kfile;
+  long headerpos;
+  int tp_fileindex;
+  int tpbarreset;
+  int firstpitch;
+  int lastpitch;
+};
+
+int abbreviations_defined ();
+extern int fileline_number;
+
+
+int
+find_scan_pieces (FILE * f, long size, int n, struct scanpiece *piece)
+/* divides the file into at most n pieces of similar size, each
+ * starting after a blank line which ends a tune and before any U:
+ * field. The lines and records are counted the way parsetune ()
+ * reads them. Returns the number of pieces.
+ */
+{
+  int t, lastch, done_eol, intune, phase, field, xref, number, digits;
+  int npieces, line;
+  int records, endrecord;
+
+  piece[0].offset = 0;
+  piece[0].line = fileline_number;
+  piece[0].index = fileindex;
+  piece[0].xref = xrefno;
+  npieces = 1;
+  line = fileline_number;
+  records = 0;
+  intune = 0;
+  xref = xrefno;
+  number = 0;
+  digits = 0;
+  field = 0;
+  phase = 0;
+  lastch = '\0';
+  done_eol = 0;
+  while ((t = getc (f)) != EOF && npieces < n)
+    {
+      endrecord = 0;
+      if ((t != '\n') && (t != '\r'))
+	{
+/* phase 0 leading space, 1 after X or U, 2 after X:, 3 X: field, 4 other */
+	  switch (phase)
+	    {
+	    case 0:
+	      if (t == 'X' || t == 'U')
+		{
+		  phase = 1;
+		  field = t;
+		}
+	      else if (t != ' ' && t != '\t')
+		phase = 4;
+	      break;
+	    case 1:
+	      if (t == ':' && field == 'U')
+		return npieces;	/* later tunes depend on the U: field */
+	      if (t == ':')
+		{
+		  phase = 2;
+		  number = 0;
+		  digits = 0;
+		}
+	      else if (t != ' ' && t != '\t')
+		phase = 4;
+	      break;
+	    case 2:
+	      if (t == ':' || t == '|')
+		{
+		  phase = 4;	/* a repeat, not a field */
+		  break;
+		}
+	      phase = 3;
+	      /* fall through */
+	    case 3:
+/* the reference number as read by readnumf () */
+	      if (digits == 0 && (t == ' ' || t == '\t'))
+		break;
+	      if (digits >= 0 && isdigit (t))
+		{
+		  number = 10 * number + t - '0';
+		  digits++;
+		}
+	      else
+		digits = -1;
+	      break;
+	    }
+	  done_eol = 0;
+	}
+      else if ((done_eol) && (((t == '\n') && (lastch == '\r')) ||
+			      ((t == '\r') && (lastch == '\n'))))
+	done_eol = 0;
+      else
+	{
+	  line++;
+	  if (phase == 0 && intune)
+	    {
+	      intune = 0;
+	      endrecord = 2;
+	    }
+	  if (phase == 2 || phase == 3)
+	    {
+	      if (intune)
+		endrecord = 1;	/* tune ends in the middle of a record */
+	      intune = 1;
+	      xref = number;
+	    }
+	  phase = 0;
+	  done_eol = 1;
+	}
+      lastch = t;
+      if (endrecord)
+	{
+	  records++;
+	  lastch = '\0';
+	  done_eol = 0;
+	  if (endrecord == 2 && ftell (f) >= size / n * npieces)
+	    {
+	      piece[npieces].offset = ftell (f);
+	      piece[npieces].line = line;
+	      piece[npieces].index = fileindex + records;
+	      piece[npieces].xref = xref;
+	      npieces++;
+	    }
+	}
+    }
+  return npieces;
+}
+
+
+void
+scan_records (FILE * fp, long end, void (*process) ())
+/* parses the records of the file up to position end (or to the end
+   of the file if end is negative), calling process () after each */
+{
+  while (!feof (fp) && (end < 0 || ftell (fp) < end))
+    {
+      fileindex++;
+      startfile ();
+      parsetune (fp);
+      process ();
+    }
+}
+
+
+#ifdef SCANFORK
+void
+scan_piece (char *filename, struct scanpiece *piece, long end,
+	    FILE * out, FILE * result, void (*process) ())
+/* runs in a child process: scans one piece of the file with the
+   output going to out and the totals to result */
+{
+  struct scanresult r;
+
+  fflush (stdout);
+  dup2 (fileno (out), 1);
+  scanworker = 1;
+  briefheaderpos = -1;
+  fp = fopen (filename, "rt");
+  if (fp == NULL)
+    exit (1);
+  if (piece->offset > 0)
+    {
+      fseek (fp, piece->offset, SEEK_SET);
+      fileline_number = piece->line;
+      fileindex = piece->index;
+      xrefno = piece->xref;
+      dotune = 0;
+    }
+  scan_records (fp, end, process);
+  fflush (stdout);
+  r.end.offset = ftell (fp);
+  r.end.line = fileline_number;
+  r.end.index = fileindex;
+  r.end.xref = xrefno;
+  r.clean = (dotune == 0 && !abbreviations_defined ());
+  r.kfile = kfile;
+  r.headerpos = briefheaderpos;
+  r.tp_fileindex = tp_fileindex;
+  r.tpbarreset = tpbarreset;
+  r.firstpitch = scanfirstpitch;
+  r.lastpitch = lastpitch;
+  fclose (fp);
+  fwrite (&r, sizeof r, 1, result);
+  fwrite (tpbarstatus, tpmaxbars, 1, result);
+  fwrite (pitch_histogram, sizeof pitch_histogram, 1, result);
+  fwrite (weighted_pitch_histogram, sizeof weighted_pitch_histogram, 1,
+	  result);
+  fwrite (length_histogram, sizeof length_histogram, 1, result);
+  fwrite (interval_histogram, sizeof interval_histogram, 1, result);
+  if (fflush (result) != 0)
+    exit (1);
+  exit (0);
+}
+
+
+void
+add_counts (int *total, FILE * f, int n)
+{
+  int i, count;
+
+  for (i = 0; i < n; i++)
+    if (fread (&count, sizeof count, 1, f) == 1)
+      total[i] += count;
+}
+
+
+int
+parallel_scan (char *filename, void (*process) ())
+/* scans the file in scanjobs child processes. Returns 0 if the file
+   could not be divided or the pieces did not join up. */
+{
+  FILE *f;
+  struct stat st;
+  struct scanpiece *piece;
+  struct scanresult *r;
+  FILE **out, **result;
+  pid_t *pids;
+  unsigned char *status;
+  int n, k, i, c, ok, wstatus;
+  long pos;
+
+  if (stat (filename, &st) != 0)
+    return 0;
+  f = fopen (filename, "rt");
+  if (f == NULL)
+    return 0;
+  piece = (struct scanpiece *) checkmalloc (scanjobs *
+					     sizeof (struct scanpiece));
+  n = find_scan_pieces (f, (long) st.st_size, scanjobs, piece);
+  fclose (f);
+  if (n < 2)
+    {
+      free (piece);
+      return 0;
+    }
+
+  r = (struct scanresult *) checkmalloc (n * sizeof (struct scanresult));
+  out = (FILE **) checkmalloc (n * sizeof (FILE *));
+  result = (FILE **) checkmalloc (n * sizeof (FILE *));
+  pids = (pid_t *) checkmalloc (n * sizeof (pid_t));
+  fflush (stdout);
+  for (k = 0; k < n; k++)
+    {
+      out[k] = tmpfile ();
+      result[k] = tmpfile ();
+      if (out[k] == NULL || result[k] == NULL)
+	{
+	  printf ("abcmatch: cannot create temporary file\n");
+	  exit (1);
+	}
+      pids[k] = fork ();
+      if (pids[k] < 0)
+	{
+	  printf ("abcmatch: cannot start process\n");
+	  exit (1);
+	}
+      if (pids[k] == 0)
+	scan_piece (filename, &piece[k],
+		    (k < n - 1) ? piece[k + 1].offset : -1,
+		    out[k], result[k], process);
+    }
+
+/* check that every piece ended where the next one starts */
+  ok = 1;
+  for (k = 0; k < n; k++)
+    {
+      if (waitpid (pids[k], &wstatus, 0) != pids[k] ||
+	  !WIFEXITED (wstatus) || WEXITSTATUS (wstatus) != 0)
+	ok = 0;
+      rewind (result[k]);
+      if (fread (&r[k], sizeof r[k], 1, result[k]) != 1)
+	ok = 0;
+      else if (k < n - 1 && (!r[k].clean ||
+			     r[k].end.offset != piece[k + 1].offset ||
+			     r[k].end.line != piece[k + 1].line ||
+			     r[k].end.index != piece[k + 1].index ||
+			     r[k].end.xref != piece[k + 1].xref))
+	ok = 0;
+    }
+
+  if (ok)
+    {
+      status = (unsigned char *) checkmalloc (tpmaxbars + 1);
+      for (k = 0; k < n; k++)
+	{
+	  rewind (out[k]);
+	  pos = 0;
+	  while ((c = getc (out[k])) != EOF)
+	    {
+	      if (pos == r[k].headerpos && kfile == 0)
+		print_brief_header ();
+	      putchar (c);
+	      pos++;
+	    }
+	  if (pos == r[k].headerpos && kfile == 0)
+	    print_brief_header ();
+	  kfile += r[k].kfile;
+	  if (r[k].tp_fileindex != 0)
+	    tp_fileindex = r[k].tp_fileindex;
+	  if (tpmaxbars > 0 && fread (status, tpmaxbars, 1, result[k]) == 1)
+	    for (i = 0; i < tpmaxbars; i++)
+	      tpbarstatus[i] = r[k].tpbarreset ? status[i] :
+		(tpbarstatus[i] | status[i]);
+	  add_counts (pitch_histogram, result[k], 128);
+	  add_counts (weighted_pitch_histogram, result[k], 128);
+	  add_counts (length_histogram, result[k], 144);
+	  add_counts (interval_histogram, result[k], 128);
+/* the interval between the last note of one piece and the first of the next */
+	  if (r[k].firstpitch >= 0)
+	    {
+	      if (lastpitch != 0 && r[k].firstpitch - lastpitch + 60 > -1 &&
+		  r[k].firstpitch - lastpitch + 60 < 128)
+		interval_histogram[r[k].firstpitch - lastpitch + 60]++;
+	      lastpitch = r[k].lastpitch;
+	    }
+	}
+      free (status);
+      fileindex = r[n - 1].end.index;
+      xrefno = r[n - 1].end.xref;
+    }
+  for (k = 0; k < n; k++)
+    {
+      fclose (out[k]);
+      fclose (result[k]);
+    }
+  free (piece);
+  free (r);
+  free (out);
+  free (result);
+  free (pids);
+  return ok;
+}
+#else
+int
+parallel_scan (char *filename, void (*process) ())
+{
+  return 0;
+}
+#endif
+
+
+void
+scan_file (char *filename, void (*process) ())
+/* parses every tune in the file calling process () after each */
+{
+  if (scanjobs > 1 && parallel_scan (filename, process))
+    return;
+  fp = fopen (filename, "rt");
+  if (fp == NULL)
+    {
+      printf ("cannot open file %s\n", filename);
+      exit (0);
+    }
+  scan_records (fp, -1, process);
+  fclose (fp);
+}
+
+
+/* Corpus index.
+ *
+ * Searching a large collection normally means parsing every tune and
+ * comparing every bar with the template. abcmatch -mkindex builds a
+ * file recording where each tune starts together with a fingerprint
+ * (hash) of each of its bars; abcmatch -index reads it and only
+ * parses and compares the tunes sharing at least one fingerprint
+ * with the bars of the template. The fingerprints are chosen so that
+ * two bars which match_notes () or match_samples () consider equal
+ * always have the same fingerprint (they are relative to the first
+ * note for transposition and hold pitch differences for contour
+ * matching); a collision merely adds a candidate. Queries which
+ * cannot be answered this way (-lev, -fixed, -qnt, -con with a
+ * resolution, a different resolution from the index, ...) scan
+ * the whole file as before.
+ *
+ * The file holds a header (magic, size and date of the abc file,
+ * resolution, number of tunes and the position and length of the
+ * postings of each kind of fingerprint), the table of tunes and
+ * then the (key, tune) postings of each kind sorted by key. A query
+ * only needs one kind, which is read in a single fread (). File
+ * positions are 64 bits so that collections over 2GB can be indexed.
+ */
+
+#define INDEXMAGIC "ABCMIDX3"
+
+#define FP_NOTES 0		/* pitch and length relative to first note */
+#define FP_NOTES_NR 1		/* same for -norhythm */
+#define FP_CONTOUR 2		/* pitch differences and length for -con */
+#define FP_CONTOUR_NR 3		/* same for -con -norhythm */
+#define FP_SAMPLES 4		/* sampled bar image relative to first note */
+#define FP_KINDS 5
+
+#define IDXHEADER (8 + 20 + 12 * FP_KINDS)	/* bytes before the tunes */
+#define IDXTUNESIZE 20		/* bytes per tune */
+#define IDXPOSTSIZE 8		/* bytes per posting */
+
+#define FP_REST 0x7fffffff	/* token standing for a rest */
+
+#define IDX_CLEAN 1		/* parser can be restarted at this tune */
+#define IDX_ANY(kind) (2 << (kind))	/* tune has wildcard bars of this
+				   kind, always compare */
+
+struct idxtune
+{
+  long offset;			/* file position before parsetune () */
+  int line;			/* fileline_number at that position */
+  int xref;			/* xrefno after parsetune () */
+  int flags;
+};
+
+struct idxposting
+{
+  unsigned int key;
+  int tune;			/* fileindex of tune */
+};
+
+struct idxtune *idxtunes;
+int idxntunes, idxmaxtunes;
+struct idxposting *idxpost[FP_KINDS];
+int idxnpost[FP_KINDS], idxmaxpost[FP_KINDS];
+int idxresolution;
+FILE *idxfile = NULL;		/* -index file while it is being read */
+long idxkindpos[FP_KINDS];	/* file position of postings of each kind */
+
+char *mkindexname = NULL;	/* -mkindex file */
+char *indexname = NULL;		/* -index file */
+
+
+
+void *
+growarray (void *array, int *max, int size)
+/* doubles the space allocated for an array */
+{
+  void *p;
+
+  *max = (*max == 0) ? 1024 : 2 * *max;
+  p = realloc (array, *max * size);
+  if (p == NULL)
+    {
+      printf ("abcmatch: out of memory for index\n");
+      exit (1);
+    }
+  return p;
+}
+
+
+unsigned int
+fp_add (unsigned int h, int token)
+/* adds an integer to a FNV-1a hash */
+{
+  int i;
+  unsigned int v;
+
+  v = (unsigned int) token;
+  for (i = 0; i < 4; i++)
+    {
+      h = (h ^ (v & 0xff)) * 16777619u;
+      v = v >> 8;
+    }
+  return h & 0xffffffff;
+}
+
+
+int
+wildcard_sample (int p)
+/* match_samples () skips samples of pitch -1, which could also
+   result from transposing a very low note. */
+{
+  return (p != RESTNOTE && p > -8 && p < 7);
+}
+
+
+int
+fingerprint_bar (int kind, int *midipitch, int *notelength, int offset,
+		 unsigned int *key)
+/* computes the fingerprint of the bar starting at midipitch[offset].
+   Returns the number of notes and rests in the bar, or -1 if the
+   bar contains a note which the matcher treats as a wildcard.
+
+   match_notes () compares 256*pitch+length after shifting the pitch,
+   so FP_NOTES hashes the difference of these values from those of
+   the first note; rests are not compared except for their position.
+   In contour mode it compares 256*(pitch difference)+length from
+   the second element onwards, treating a rest as a pitch.
+*/
+{
+  int i, n, wild;
+  int x, first, last;
+  unsigned int h;
+
+  h = 2166136261u;
+  n = 0;
+  wild = 0;
+  first = RESTNOTE;
+  last = 0;
+  for (i = offset; midipitch[i] != BAR; i++)
+    {
+      if (midipitch[i] == -1)
+	wild = 1;		/* skipped by match_notes () */
+      switch (kind)
+	{
+	case FP_NOTES:
+	case FP_NOTES_NR:
+	  if (midipitch[i] == RESTNOTE)
+	    {
+	      h = fp_add (h, FP_REST);
+	      break;
+	    }
+	  x = 256 * midipitch[i];
+	  if (kind == FP_NOTES)
+	    x += notelength[i];
+	  if (first == RESTNOTE)
+	    first = x;
+	  h = fp_add (h, x - first);
+	  break;
+	case FP_CONTOUR:
+	case FP_CONTOUR_NR:
+	  if (n > 0)
+	    {
+	      x = 256 * (midipitch[i] - last);
+	      if (kind == FP_CONTOUR)
+		x += notelength[i];
+	      h = fp_add (h, x);
+	    }
+	  last = midipitch[i];
+	  break;
+	}
+      n++;
+    }
+  *key = fp_add (h, n);
+  if (wild && n > 1)
+    return -1;
+/* in contour mode the bar lines following an empty bar give pitch
+   differences of 0 and lengths of BAR, which match_notes () may
+   accept, so empty bars are wildcards too */
+  if (n == 0 && (kind == FP_CONTOUR || kind == FP_CONTOUR_NR))
+    return -1;
+  return n;
+}
+
+
+int
+fingerprint_samples (int *samples, int nsamples, unsigned int *key)
+/* computes the fingerprint of a bar image made by make_bar_image ()
+   with no transposition. Returns the number of samples or -1 if
+   the image contains a wildcard sample.
+*/
+{
+  int i, first, wild;
+  unsigned int h;
+
+  h = fp_add (2166136261u, nsamples);
+  first = RESTNOTE;
+  wild = 0;
+  for (i = 0; i < nsamples; i++)
+    {
+      if (samples[i] == RESTNOTE)
+	{
+	  h = fp_add (h, FP_REST);
+	  continue;
+	}
+      if (wildcard_sample (samples[i]))
+	wild = 1;
+      if (first == RESTNOTE)
+	first = samples[i];
+      h = fp_add (h, samples[i] - first);
+    }
+  *key = h;
+  if (wild)
+    return -1;
+  return nsamples;
+}
+
+
+int
+abbreviations_defined ()
+/* U: definitions persist from one tune to the next */
+{
+  char symbol;
+
+  for (symbol = 'H'; symbol <= 'Z'; symbol++)
+    if (lookup_abbreviation (symbol) != NULL)
+      return 1;
+  return 0;
+}
+
+
+void
+add_posting (int kind, unsigned int key, int tune)
+{
+  if (idxnpost[kind] >= idxmaxpost[kind])
+    idxpost[kind] = (struct idxposting *)
+      growarray (idxpost[kind], &idxmaxpost[kind],
+		 sizeof (struct idxposting));
+  idxpost[kind][idxnpost[kind]].key = key;
+  idxpost[kind][idxnpost[kind]].tune = tune;
+  idxnpost[kind]++;
+}
+
+
+int
+compare_postings (const void *a, const void *b)
+{
+  const struct idxposting *pa, *pb;
+
+  pa = (const struct idxposting *) a;
+  pb = (const struct idxposting *) b;
+  if (pa->key != pb->key)
+    return (pa->key < pb->key) ? -1 : 1;
+  return pa->tune - pb->tune;
+}
+
+
+void
+sort_postings (int kind)
+/* sorts the postings and removes duplicate (key, tune) pairs */
+{
+  int i, j;
+
+  if (idxnpost[kind] > 0)
+    qsort (idxpost[kind], idxnpost[kind], sizeof (struct idxposting),
+	   compare_postings);
+  j = 0;
+  for (i = 0; i < idxnpost[kind]; i++)
+    if (j == 0 || compare_postings (&idxpost[kind][i],
+				    &idxpost[kind][j - 1]) != 0)
+      idxpost[kind][j++] = idxpost[kind][i];
+  idxnpost[kind] = j;
+}
+
+
+void
+putint32 (FILE * f, unsigned long n)
+/* index files are little endian */
+{
+  putc ((int) (n & 0xff), f);
+  putc ((int) ((n >> 8) & 0xff), f);
+  putc ((int) ((n >> 16) & 0xff), f);
+  putc ((int) ((n >> 24) & 0xff), f);
+}
+
+
+void
+putint64 (FILE * f, long n)
+/* file positions, which are never negative */
+{
+  int i;
+  unsigned long v;
+
+  v = (unsigned long) n;
+  for (i = 0; i < 8; i++)
+    {
+      putc ((int) (v & 0xff), f);
+      v = v >> 8;
+    }
+}
+
+
+long
+getint32 (unsigned char *p)
+/* decodes a number written by putint32 () from a buffer */
+{
+  unsigned long v;
+
+  v = (unsigned long) p[0] | ((unsigned long) p[1] << 8) |
+    ((unsigned long) p[2] << 16) | ((unsigned long) p[3] << 24);
+  if (v & 0x80000000UL)
+    return -(long) ((~v & 0xffffffffUL) + 1);
+  return (long) v;
+}
+
+
+int
+getint64 (unsigned char *p, long *n)
+/* decodes a file position written by putint64 (). Returns 0 if it
+   does not fit in a long. */
+{
+  int i;
+  unsigned long v;
+
+  v = 0;
+  for (i = 7; i >= 0; i--)
+    {
+      if (v > ((unsigned long) LONG_MAX >> 8))
+	return 0;
+      v = (v << 8) | p[i];
+    }
+  if (v > (unsigned long) LONG_MAX)
+    return 0;
+  *n = (long) v;
+  return 1;
+}
+
+
+int
+corpus_stamp (char *filename, long *size, long *mtime)
+/* identifies the version of the abc file the index was made from */
+{
+  struct stat st;
+
+  if (stat (filename, &st) != 0)
+    return 0;
+  *size = (long) (st.st_size & 0x7fffffff);
+  *mtime = (long) (st.st_mtime & 0x7fffffff);
+  return 1;
+}
+
+
+void
+index_bars (int tune)
+/* adds the fingerprints of the bars of the tune which has just
+   been converted by make_note_representation () */
+{
+  int i, kind, n;
+  unsigned int key;
+
+  for (i = 0; i < inbars; i++)
+    {
+      for (kind = FP_NOTES; kind <= FP_CONTOUR_NR; kind++)
+	{
+	  n = fingerprint_bar (kind, imidipitch, inotelength,
+			       ibarlineptr[i], &key);
+	  if (n == -1)
+	    idxtunes[tune].flags |= IDX_ANY (kind);
+	  else if (n > 1)
+	    add_posting (kind, key, tune);
+	}
+      if (idxresolution > 0)
+	{
+	  isamples = make_bar_image (i, idxresolution,
+				     ibarlineptr, inotelength, innotes, 0,
+				     imidipitch, &ipitch_samples, &icodes,
+				     &imaxsamples, 0);
+	  if (isamples < 1)
+	    continue;
+	  if (fingerprint_samples (ipitch_samples, isamples, &key) == -1)
+	    idxtunes[tune].flags |= IDX_ANY (FP_SAMPLES);
+	  else
+	    add_posting (FP_SAMPLES, key, tune);
+	}
+    }
+}
+
+
+void
+build_index (char *filename, char *indexfile)
+/* parses the abc file in the same way as main () and writes the
+   index file for -index */
+{
+  FILE *idx;
+  int i, kind, npostings;
+  long size, mtime, pos;
+
+  idxresolution = resolution;
+  fp = fopen (filename, "rt");
+  if (fp == NULL)
+    {
+      printf ("cannot open file %s\n", filename);
+      exit (0);
+    }
+  while (!feof (fp))
+    {
+      if (idxntunes >= idxmaxtunes)
+	idxtunes = (struct idxtune *)
+	  growarray (idxtunes, &idxmaxtunes, sizeof (struct idxtune));
+      idxtunes[idxntunes].offset = ftell (fp);
+      if (idxtunes[idxntunes].offset < 0)
+	{
+	  printf ("%s is too large to be indexed\n", filename);
+	  exit (1);
+	}
+      idxtunes[idxntunes].line = fileline_number;
+      idxtunes[idxntunes].flags = 0;
+      if (dotune == 0 && !abbreviations_defined ())
+	idxtunes[idxntunes].flags = IDX_CLEAN;
+      fileindex++;
+      startfile ();
+      parsetune (fp);
+      idxtunes[idxntunes].xref = xrefno;
+      idxntunes++;
+      if (notes < 10 || voicesused)
+	continue;
+      reserve_input (notes);
+      make_note_representation (&innotes, &inbars,
+				&itimesig_num, &itimesig_denom,
+				ibarlineptr, inotelength, imidipitch);
+      index_bars (fileindex);
+    }
+  fclose (fp);
+
+  if (!corpus_stamp (filename, &size, &mtime))
+    {
+      printf ("cannot stat file %s\n", filename);
+      exit (1);
+    }
+  idx = fopen (indexfile, "wb");
+  if (idx == NULL)
+    {
+      printf ("cannot create index file %s\n", indexfile);
+      exit (1);
+    }
+  fputs (INDEXMAGIC, idx);
+  putint64 (idx, size);
+  putint32 (idx, mtime);
+  putint32 (idx, idxresolution);
+  putint32 (idx, idxntunes);
+/* table of the postings of each kind */
+  pos = IDXHEADER + (long) idxntunes * IDXTUNESIZE;
+  npostings = 0;
+  for (kind = 0; kind < FP_KINDS; kind++)
+    {
+      sort_postings (kind);
+      putint64 (idx, pos);
+      putint32 (idx, idxnpost[kind]);
+      if (idxnpost[kind] > (LONG_MAX - pos) / IDXPOSTSIZE)
+	{
+	  printf ("index file %s would be too large\n", indexfile);
+	  exit (1);
+	}
+      pos = pos + (long) idxnpost[kind] * IDXPOSTSIZE;
+      npostings += idxnpost[kind];
+    }
+  for (i = 0; i < idxntunes; i++)
+    {
+      putint64 (idx, idxtunes[i].offset);
+      putint32 (idx, idxtunes[i].line);
+      putint32 (idx, idxtunes[i].xref);
+      putint32 (idx, idxtunes[i].flags);
+    }
+  for (kind = 0; kind < FP_KINDS; kind++)
+    for (i = 0; i < idxnpost[kind]; i++)
+      {
+	putint32 (idx, idxpost[kind][i].key);
+	putint32 (idx, idxpost[kind][i].tune);
+      }
+  if (fclose (idx) != 0)
+    {
+      printf ("error writing index file %s\n", indexfile);
+      exit (1);
+    }
+  printf ("%d tunes, %d bar fingerprints written to %s\n",
+	  idxntunes, npostings, indexfile);
+}
+
+
+int
+read_index (char *filename, char *indexfile)
+/* loads the header and the tunes of the index file, leaving it open
+   for load_postings (). Returns 0 if it is unusable, in which case
+   the whole abc file is scanned. */
+{
+  unsigned char header[IDXHEADER];
+  unsigned char *buf, *p;
+  long size, mtime, v;
+  int i, kind;
+
+  idxfile = fopen (indexfile, "rb");
+  if (idxfile == NULL)
+    {
+      fprintf (stderr, "abcmatch: cannot open index file %s\n", indexfile);
+      return 0;
+    }
+  if (fread (header, 1, IDXHEADER, idxfile) != IDXHEADER ||
+      strncmp ((char *) header, INDEXMAGIC, 8) != 0)
+    {
+      fprintf (stderr, "abcmatch: %s is not an abcmatch index\n", indexfile);
+      fclose (idxfile);
+      idxfile = NULL;
+      return 0;
+    }
+  if (!getint64 (header + 8, &v))
+    goto corrupt;
+  if (!corpus_stamp (filename, &size, &mtime) ||
+      v != size || getint32 (header + 16) != mtime)
+    {
+      fprintf (stderr, "abcmatch: index %s is out of date, scanning %s\n",
+	       indexfile, filename);
+      fclose (idxfile);
+      idxfile = NULL;
+      return 0;
+    }
+  idxresolution = (int) getint32 (header + 20);
+  idxntunes = (int) getint32 (header + 24);
+  if (idxntunes < 0)
+    goto corrupt;
+  for (kind = 0; kind < FP_KINDS; kind++)
+    {
+      if (!getint64 (header + 28 + 12 * kind, &idxkindpos[kind]))
+	goto corrupt;
+      idxnpost[kind] = (int) getint32 (header + 36 + 12 * kind);
+      if (idxnpost[kind] < 0)
+	goto corrupt;
+      idxpost[kind] = NULL;
+    }
+  idxtunes = (struct idxtune *)
+    checkmalloc ((idxntunes + 1) * sizeof (struct idxtune));
+  buf = (unsigned char *) checkmalloc ((long) idxntunes * IDXTUNESIZE + 1);
+  if (fread (buf, IDXTUNESIZE, idxntunes, idxfile) != (size_t) idxntunes)
+    {
+      free (buf);
+      goto corrupt;
+    }
+  for (i = 0, p = buf; i < idxntunes; i++, p += IDXTUNESIZE)
+    {
+      if (!getint64 (p, &idxtunes[i].offset))
+	{
+	  free (buf);
+	  goto corrupt;
+	}
+      idxtunes[i].line = (int) getint32 (p + 8);
+      idxtunes[i].xref = (int) getint32 (p + 12);
+      idxtunes[i].flags = (int) getint32 (p + 16);
+    }
+  free (buf);
+  return 1;
+
+corrupt:
+  fprintf (stderr, "abcmatch: index file %s is damaged\n", indexfile);
+  fclose (idxfile);
+  idxfile = NULL;
+  return 0;
+}
+
+
+int
+load_postings (int kind)
+/* reads the postings of one kind from the index file opened by
+   read_index (). They are already in memory with -serve. */
+{
+  unsigned char *buf, *p;
+  int i, n;
+
+  if (idxfile == NULL || idxpost[kind] != NULL)
+    return 1;
+  n = idxnpost[kind];
+  idxpost[kind] = (struct idxposting *)
+    checkmalloc ((n + 1) * sizeof (struct idxposting));
+  buf = (unsigned char *) checkmalloc ((long) n * IDXPOSTSIZE + 1);
+  if (fseek (idxfile, idxkindpos[kind], SEEK_SET) != 0 ||
+      fread (buf, IDXPOSTSIZE, n, idxfile) != (size_t) n)
+    {
+      fprintf (stderr, "abcmatch: index file %s is damaged\n", indexname);
+      free (buf);
+      return 0;
+    }
+  for (i = 0, p = buf; i < n; i++, p += IDXPOSTSIZE)
+    {
+      idxpost[kind][i].key = (unsigned int) (getint32 (p) & 0xffffffffL);
+      idxpost[kind][i].tune = (int) getint32 (p + 4);
+    }
+  free (buf);
+  return 1;
+}
+
+
+void
+mark_candidates (int kind, unsigned int key, int *candidate)
+/* binary search of the sorted postings for key, counting the
+   template bars found in each tune */
+{
+  int lo, hi, mid;
+  struct idxposting *post;
+
+  post = idxpost[kind];
+  lo = 0;
+  hi = idxnpost[kind];
+  while (lo < hi)
+    {
+      mid = (lo + hi) / 2;
+      if (post[mid].key < key)
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+  for (; lo < idxnpost[kind] && post[lo].key == key; lo++)
+    if (post[lo].tune >= 0 && post[lo].tune < idxntunes)
+      candidate[post[lo].tune]++;
+}
+
+
+int
+template_bar_key (int kind, int bar, unsigned int *key)
+/* computes the fingerprint of a template bar. Returns 1 if the
+   key was set, 0 if the bar cannot match any bar and -1 if the
+   index cannot be used to look for it.
+*/
+{
+  int i, n;
+
+  if (kind == FP_SAMPLES)
+    {
+/* match_all_bars () compares images even if they are empty */
+      if (msamples[bar] < 1)
+	return anymode ? 0 : -1;
+      n = fingerprint_samples (mpitch_samples + mimageoffset[bar],
+			       msamples[bar], key);
+      return (n == -1) ? -1 : 1;
+    }
+  if (tpmidipitch[tpbarlineptr[bar]] == BAR)
+    return 0;
+  n = fingerprint_bar (kind, tpmidipitch, tpnotelength, tpbarlineptr[bar],
+		       key);
+  if (n == -1)
+    return -1;
+  if (n < 2)
+    return 0;
+  if (kind == FP_CONTOUR || kind == FP_CONTOUR_NR)
+    for (i = tpbarlineptr[bar]; tpmidipitch[i] != BAR; i++)
+      if (tpmidipitch[i] == RESTNOTE)
+	return -1;		/* rests are skipped in pairs */
+  return 1;
+}
+
+
+int
+index_applies ()
+/* whether the fingerprints can answer queries with these options */
+{
+  if (levdist != 0 || fixednumberofnotes != 0 || qntflag != 0 ||
+      check != 0 || verbose != 0 || (brief && cthresh < 1))
+    return 0;
+  if (resolution > 0 && con != 0)
+    return 0;
+  return 1;
+}
+
+
+int
+find_candidates (int *candidate)
+/* sets candidate[tune] for the tunes of the index which may match
+   the template. Returns 0 if the index cannot be used for it. */
+{
+  int i, kind, lastbar, status, needed, keyed;
+  int tune;
+  unsigned int key;
+
+  if (resolution > 0 && resolution != idxresolution)
+    return 0;
+
+  if (resolution > 0)
+    kind = FP_SAMPLES;
+  else if (con)
+    kind = norhythm ? FP_CONTOUR_NR : FP_CONTOUR;
+  else
+    kind = norhythm ? FP_NOTES_NR : FP_NOTES;
+  if (!load_postings (kind))
+    return 0;
+
+/* the template bars which have to match for a tune to be reported */
+  if (brief)
+    lastbar = tpbars;		/* count_matched_tune_bars runs past tpbars */
+  else if (anymode)
+    lastbar = tpbars - 1;
+  else
+    lastbar = 0;
+
+  for (tune = 0; tune < idxntunes; tune++)
+    candidate[tune] = 0;
+  keyed = 0;
+  for (i = 0; i <= lastbar; i++)
+    {
+      status = template_bar_key (kind, i, &key);
+      if (status == -1)
+	return 0;
+      if (status == 1)
+	{
+	  mark_candidates (kind, key, candidate);
+	  keyed = 1;
+	}
+    }
+/* a template with no bar to look up (no bars, or only chords and
+   single notes) is left to the full scan */
+  if (!keyed)
+    return 0;
+/* brief mode only reports tunes sharing cthresh template bars */
+  needed = brief ? cthresh : 1;
+  for (tune = 0; tune < idxntunes; tune++)
+    candidate[tune] = (idxtunes[tune].flags & IDX_ANY (kind)) ||
+      (tpxref > 0 && idxtunes[tune].xref == tpxref) ||
+      candidate[tune] >= needed;
+  return 1;
+}
+
+
+int
+scan_with_index (char *filename)
+/* compares the template with the candidate tunes found in the index.
+   Returns 0 without doing anything if the index cannot be used for
+   this query.
+*/
+{
+  int tune, next, start;
+  int *candidate;
+
+  if (!index_applies () || abbreviations_defined ())
+    return 0;
+  if (!read_index (filename, indexname))
+    return 0;
+  candidate = checkmalloc ((idxntunes + 1) * sizeof (int));
+  if (!find_candidates (candidate))
+    {
+      fclose (idxfile);
+      idxfile = NULL;
+      free (candidate);
+      return 0;
+    }
+  fclose (idxfile);
+  idxfile = NULL;
+
+  fp = fopen (filename, "rt");
+  if (fp == NULL)
+    {
+      printf ("cannot open file %s\n", filename);
+      exit (0);
+    }
+  next = 0;			/* tune parsetune () would read next */
+  for (tune = 0; tune < idxntunes; tune++)
+    {
+      if (!candidate[tune])
+	continue;
+/* restart the parser at the nearest tune it does not depend on */
+      start = tune;
+      while (start > next && !(idxtunes[start].flags & IDX_CLEAN))
+	start--;
+      if (start > next)
+	{
+	  fseek (fp, idxtunes[start].offset, SEEK_SET);
+	  fileline_number = idxtunes[start].line;
+	  xrefno = idxtunes[start - 1].xref;
+	  dotune = 0;
+	  next = start;
+	}
+      while (next <= tune)
+	{
+	  fileindex = next;
+	  startfile ();
+	  parsetune (fp);
+	  next++;
+	}
+      match_tune ();
+    }
+  fclose (fp);
+  free (candidate);
+  return 1;
+}
+
+
+/* All pairs mode (-pairs).
+ *
+ * The grouper in runabc.tcl runs abcmatch -br once for every tune
+ * of a collection, each time with that tune in match.abc, so the
+ * file is parsed once per tune. With -pairs the file is parsed
+ * once, the note representation of every tune is kept, and each
+ * tune in turn is loaded into the template arrays and compared
+ * with the other tunes exactly as in brief mode. A tune is only
+ * compared if the number of template bars whose fingerprint is
+ * found among its bars could reach the -br threshold.
+ */
+
+struct tunerep
+{
+  int *midipitch;		/* as made by make_note_representation () */
+  int *notelength;
+  int *barlineptr;
+  int nnotes;
+  int nbars;
+  int timesig_num, timesig_denom;
+  int key;			/* sf2midishift of key signature */
+  int xref;
+  int notes;			/* number of features */
+  int voices;
+  int wild;			/* has a bar with a wildcard note */
+};
+
+struct tunerep *pairtunes;
+int npairtunes, maxpairtunes;
+
+
+void
+store_tunerep ()
+/* keeps the note representation of the tune which has just been
+   parsed */
+{
+  struct tunerep *t;
+  int i;
+
+  if (npairtunes >= maxpairtunes)
+    pairtunes = (struct tunerep *)
+      growarray (pairtunes, &maxpairtunes, sizeof (struct tunerep));
+  t = &pairtunes[npairtunes++];
+  t->xref = xrefno;
+  t->notes = notes;
+  t->voices = voicesused;
+  t->key = sf2midishift[sf + 7];
+  t->wild = 0;
+  t->nnotes = 0;
+  t->nbars = 0;
+  if (notes == 0)
+    return;
+  reserve_input (notes);
+  make_note_representation (&innotes, &inbars,
+			    &t->timesig_num, &t->timesig_denom,
+			    ibarlineptr, inotelength, imidipitch);
+  t->nnotes = innotes;
+  t->nbars = inbars;
+  t->midipitch = checkmalloc ((innotes + 2) * sizeof (int));
+  t->notelength = checkmalloc ((innotes + 2) * sizeof (int));
+  t->barlineptr = checkmalloc ((inbars + 1) * sizeof (int));
+  for (i = 0; i < innotes + 2; i++)
+    {
+      t->midipitch[i] = imidipitch[i];
+      t->notelength[i] = inotelength[i];
+    }
+  for (i = 0; i <= inbars; i++)
+    t->barlineptr[i] = ibarlineptr[i];
+}
+
+
+void
+clear_template ()
+/* count_matched_tune_bars () reads template bars past tpbars, so
+   they must be left as a fresh run would leave them */
+{
+  int i;
+
+  for (i = 0; i < tpmaxnotes; i++)
+    {
+      tpmidipitch[i] = 0;
+      tpnotelength[i] = 0;
+    }
+  for (i = 0; i < tpmaxbars; i++)
+    tpbarlineptr[i] = 0;
+}
+
+
+void
+load_template (struct tunerep *t)
+/* puts a tune in the template arrays as if match.abc contained
+   only this tune. */
+{
+  int i;
+
+  reserve_template (t->nnotes);
+  clear_template ();
+  for (i = 0; i < t->nnotes + 2; i++)
+    {
+      tpmidipitch[i] = t->midipitch[i];
+      tpnotelength[i] = t->notelength[i];
+    }
+  for (i = 0; i <= t->nbars; i++)
+    tpbarlineptr[i] = t->barlineptr[i];
+  tpnotes = t->nnotes;
+  tpbars = t->nbars;
+  tptimesig_num = t->timesig_num;
+  tptimesig_denom = t->timesig_denom;
+  mkey = t->key;
 }
 
 
+void
+load_tune (struct tunerep *t)
+/* puts a tune in the input arrays. */
+{
+  int i;
+
+  reserve_input (t->nnotes);
+  for (i = 0; i < t->nnotes + 2; i++)
+    {
+      imidipitch[i] = t->midipitch[i];
+      inotelength[i] = t->notelength[i];
+    }
+  innotes = t->nnotes;
+  inbars = t->nbars;
+  for (i = 0; i <= inbars; i++)
+    ibarlineptr[i] = t->barlineptr[i];
+  itimesig_num = t->timesig_num;
+  itimesig_denom = t->timesig_denom;
+}
 
 
-int
-find_first_matching_template_bar (int barnumber, int tpbars, int transpose)
-/* given a bar number in the tune, the function looks for
- * the first bar in the template which matches the tune bar.
- */
+void
+count_shared (int kind, unsigned int key, int *shared)
+/* increments shared[tune] for every tune having a bar with this key */
 {
-  int i, dif;
-  for (i = 1; i < tpbars; i++)
+  int lo, hi, mid;
+  struct idxposting *post;
+
+  post = idxpost[kind];
+  lo = 0;
+  hi = idxnpost[kind];
+  while (lo < hi)
     {
-      if (fixednumberofnotes)
-         dif = fixed_match_notes (fixednumberofnotes,i, barnumber, transpose);
+      mid = (lo + hi) / 2;
+      if (post[mid].key < key)
+	lo = mid + 1;
       else
-         dif = match_notes (i, barnumber, transpose);
-      if (dif == 0)
-	return i;
+	hi = mid;
     }
-  return -1;
+  for (; lo < idxnpost[kind] && post[lo].key == key; lo++)
+    shared[post[lo].tune]++;
 }
 
-/* this function is not used */
-int
-count_matched_template_bars (int tpbars, int inbars, int transpose)
+
+void
+match_all_pairs (char *filename)
+/* brief mode with every tune of the file as template */
 {
-  int i, count, bar;
-  count = 0;
-  for (i = 0; i < tpbars; i++)
+  int tune, other, i, n, kind, lookup, allcandidates, status, keyed;
+  int transpose;
+  int *shared;
+  unsigned int key;
+  struct tunerep *t;
+
+  fp = fopen (filename, "rt");
+  if (fp == NULL)
     {
-      bar = find_first_matching_tune_bar (i, inbars, transpose);
-      /*if (bar >= 0) printf ("bar %d matches %d\n",bar,i); */
-      if (bar >= 0)
-	count++;
+      printf ("cannot open file %s\n", filename);
+      exit (0);
     }
-  return count;
-}
+  while (!feof (fp))
+    {
+      fileindex++;
+      startfile ();
+      parsetune (fp);
+      store_tunerep ();
+    }
+  fclose (fp);
 
+/* the fingerprints do not apply to approximate matching */
+  lookup = (levdist == 0 && fixednumberofnotes == 0 && qntflag == 0);
+  if (con)
+    kind = norhythm ? FP_CONTOUR_NR : FP_CONTOUR;
+  else
+    kind = norhythm ? FP_NOTES_NR : FP_NOTES;
+  if (lookup)
+    {
+      for (tune = 0; tune < npairtunes; tune++)
+	{
+	  t = &pairtunes[tune];
+	  for (i = 0; i < t->nbars; i++)
+	    {
+	      n = fingerprint_bar (kind, t->midipitch, t->notelength,
+				   t->barlineptr[i], &key);
+	      if (n == -1)
+		t->wild = 1;
+	      else if (n > 1)
+		add_posting (kind, key, tune);
+	    }
+	}
+      sort_postings (kind);
+    }
+  shared = checkmalloc ((npairtunes + 1) * sizeof (int));
 
-int
-count_matched_tune_bars (int tpbars, int inbars, int transpose)
-/* used only by brief mode */
-{
-  int i, count, bar;
-  count = 0;
-  for (i=0;i<300;i++) tpbarstatus[i] = 0;
-  for (i = 0; i < inbars; i++)
+  for (tune = 0; tune < npairtunes; tune++)
     {
-      bar = find_first_matching_template_bar (i, inbars, transpose);
-      /*if (bar >= 0) {printf ("bar %d matches %d\n",bar,i); 
-         print_bars(bar,i);
-         }
-       */
-      if (bar >= 0) {
-	count++;
-        tpbarstatus[bar] = 1;
-        }
+      if (pairtunes[tune].notes == 0)
+	continue;
+      load_template (&pairtunes[tune]);
+      for (other = 0; other < npairtunes; other++)
+	shared[other] = 0;
+      allcandidates = !lookup || cthresh < 1;
+/* count_matched_tune_bars () uses template bars up to tpbars */
+      keyed = 0;
+      for (i = 0; i <= tpbars && !allcandidates; i++)
+	{
+	  status = template_bar_key (kind, i, &key);
+	  if (status == -1)
+	    allcandidates = 1;
+	  else if (status == 1)
+	    {
+	      count_shared (kind, key, shared);
+	      keyed = 1;
+	    }
+	}
+/* as in find_candidates (), nothing to look up means no filtering */
+      if (!keyed)
+	allcandidates = 1;
+      pairtemplate = tune;
+      kfile = 0;
+      for (other = 0; other < npairtunes; other++)
+	{
+	  t = &pairtunes[other];
+	  if (other == tune || t->xref == tpxref || t->notes < 10 || t->voices)
+	    continue;
+	  if (!allcandidates && !t->wild && shared[other] < cthresh)
+	    continue;
+	  if ((t->timesig_num != tptimesig_num
+	       || t->timesig_denom != tptimesig_denom)
+	      && fixednumberofnotes == 0)
+	    continue;
+	  load_tune (t);
+	  transpose = mkey - t->key;
+	  if (transpose > 6) transpose = transpose -12;
+	  if (transpose < -6) transpose = transpose + 12;
+	  report_brief (other, transpose);
+	}
     }
-  return count;
+  free (shared);
 }
 
-int count_matching_template_bars ()
+
+/* Query server (-serve).
+ *
+ * A program looking up templates in the same collection again and
+ * again would otherwise have the whole file parsed for every query.
+ * With -serve the file is parsed once, keeping the note
+ * representation of every tune as -pairs does and the bar
+ * fingerprints as -mkindex does, and abcmatch then answers queries.
+ * A query is a line holding the name of a template file, optionally
+ * followed by a reference number as for -tp; an empty line stands
+ * for the -tp file (match.abc by default). The answer is what
+ * abcmatch prints for that template with the same options, followed
+ * by a line holding a single period. Queries are read from stdin,
+ * or from the connections to a Unix domain socket if its name
+ * follows -serve. The file is parsed again when its size or
+ * modification time has changed since it was loaded.
+ */
+
+int serving = 0;		/* -serve */
+char *servesocket = NULL;	/* socket name given to -serve */
+long servesize, servemtime;	/* corpus_stamp () of the loaded file */
+
+
+void
+free_tunereps ()
 {
-int i;
-int count;
-count = 0;
-for (i=0;i<300;i++)
-  if (tpbarstatus[i] > 0) count++;
-return count;
-}  
+  int i;
+
+  for (i = 0; i < npairtunes; i++)
+    if (pairtunes[i].notes != 0)
+      {
+	free (pairtunes[i].midipitch);
+	free (pairtunes[i].notelength);
+	free (pairtunes[i].barlineptr);
+      }
+  npairtunes = 0;
+}
 
-void startfile(); /* links with matchsup.c */
 
 int
-analyze_abc_file (char *filename)
+load_corpus (char *filename)
+/* parses the abc file keeping every tune and the fingerprints of
+   its bars. Returns 0 if the file cannot be read. */
 {
-  FILE *fp;
+  int kind;
+  long size, mtime;
+
+  if (!corpus_stamp (filename, &size, &mtime))
+    return 0;
   fp = fopen (filename, "rt");
   if (fp == NULL)
-    {
-      printf ("cannot open file %s\n", filename);
-      exit (0);
-    }
-  init_histograms ();
+    return 0;
+  servesize = size;
+  servemtime = mtime;
+  free_tunereps ();
+  idxntunes = 0;
+  for (kind = 0; kind < FP_KINDS; kind++)
+    idxnpost[kind] = 0;
+  idxresolution = resolution;
+  fileindex = -1;
+  fileline_number = 1;
+  dotune = 0;
   while (!feof (fp))
     {
+      if (idxntunes >= idxmaxtunes)
+	idxtunes = (struct idxtune *)
+	  growarray (idxtunes, &idxmaxtunes, sizeof (struct idxtune));
       fileindex++;
       startfile ();
       parsetune (fp);
-/*     printf("fileindex = %d xrefno =%d\n",fileindex,xrefno); */
-/*     printf("%s\n",titlename); */
-      if (notes < 10)
+      store_tunerep ();
+      idxtunes[idxntunes].xref = xrefno;
+      idxtunes[idxntunes].flags = 0;
+      idxntunes++;
+      if (notes >= 10 && !voicesused)
+	index_bars (fileindex);
+    }
+  fclose (fp);
+  for (kind = 0; kind < FP_KINDS; kind++)
+    sort_postings (kind);
+  return 1;
+}
+
+
+void
+answer_query (char *request)
+/* matches the template named in the request against the loaded
+   tunes as match_tune () would */
+{
+  char *name, *p;
+  int tune, i, transpose, savedxref, savedanymode;
+  int *candidate;
+  struct tunerep *t;
+  FILE *f;
+
+  name = request;
+  while (isspace (*name))
+    name++;
+  for (p = name; *p != '\0' && !isspace (*p); p++);
+  if (*p != '\0')
+    *p++ = '\0';
+  while (isspace (*p))
+    p++;
+  if (*name == '\0')
+    name = templatefile;
+  f = fopen (name, "r");
+  if (f == NULL)
+    {
+      printf ("cannot open file %s\n", name);
+      return;
+    }
+  fclose (f);
+
+  savedxref = tpxref;
+  savedanymode = anymode;
+  if (isdigit (*p))
+    {
+      tpxref = readnumf (p);
+      anymode = 1;
+    }
+  xmatch = (tpxref > 0) ? tpxref : 0;
+  parsefile (name);
+  xmatch = 0;
+  if (tpxref != 0 && tpxref != xrefno)
+    {
+      printf ("could not find X:%d in file %s\n", tpxref, name);
+      tpxref = savedxref;
+      anymode = savedanymode;
+      return;
+    }
+  mkey = sf2midishift[sf + 7];
+  mseqno = xrefno;
+  reserve_template (notes);
+  clear_template ();
+  for (i = 0; i < tpmaxbars; i++)
+    tpbarstatus[i] = 0;
+  make_note_representation (&tpnotes, &tpbars,
+			    &tptimesig_num, &tptimesig_denom, tpbarlineptr,
+			    tpnotelength, tpmidipitch);
+  if (resolution > 0)
+    make_template_images ();
+
+  candidate = checkmalloc ((npairtunes + 1) * sizeof (int));
+  if (!index_applies () || !find_candidates (candidate))
+    for (tune = 0; tune < npairtunes; tune++)
+      candidate[tune] = 1;
+  kfile = 0;
+  tp_fileindex = 0;
+  for (tune = 0; tune < npairtunes; tune++)
+    {
+      if (!candidate[tune])
 	continue;
-      /*print_feature_list(); */
-      make_note_representation (&innotes, &inbars, imaxnotes, imaxbars,
-				&itimesig_num, &itimesig_denom, ibarlineptr,
-				inotelength, imidipitch);
-      compute_note_histograms ();
-      if (action == cpitch_histogram_table)
+      t = &pairtunes[tune];
+      fileindex = tune;
+      xrefno = t->xref;
+      if (tpxref == xrefno)
 	{
-	  printf ("%4d %s %s\n%s\n", xrefno, filename, keysignature,
-		  titlename);
-	  make_and_print_pitch_pdf ();
-	  init_histograms ();
+	  tp_fileindex = tune;
+	  continue;
 	}
-      if (action == interval_pdf_table)
+      if (t->notes < 10 || t->voices)
+	continue;
+      if ((t->timesig_num != tptimesig_num
+	   || t->timesig_denom != tptimesig_denom)
+	  && fixednumberofnotes == 0)
+	continue;
+      load_tune (t);
+      transpose = mkey - t->key;
+      if (transpose > 6) transpose = transpose -12;
+      if (transpose < -6) transpose = transpose + 12;
+      if (brief)
 	{
-	  printf ("%4d %s %s\n%s\n", xrefno, filename, keysignature,
-		  titlename);
-	  make_and_print_interval_pdf ();
-	  init_histograms ();
+	  if (mseqno != tune)
+	    report_brief (tune, transpose);
 	}
+      else
+	find_and_report_matching_bars (tpbars, inbars, transpose,
+				       anymode, con);
+    }
+  free (candidate);
+  if (tpxref > 0)
+    {
+      printf ("%d %d ", tp_fileindex, tpxref);
+      for (i = 0; i < tpbars; i++)
+	if (tpbarstatus[i] != 0)
+	  printf ("%d ", i);
+      printf ("\n");
+    }
+  tpxref = savedxref;
+  anymode = savedanymode;
+}
+
+
+void
+serve_queries (FILE * in, char *filename)
+/* answers the queries read from in until end of file */
+{
+  char request[1024];
+  long size, mtime;
 
+  while (fgets (request, sizeof (request), in) != NULL)
+    {
+      if (corpus_stamp (filename, &size, &mtime) &&
+	  (size != servesize || mtime != servemtime))
+	load_corpus (filename);
+      answer_query (request);
+      printf (".\n");
+      fflush (stdout);
     }
-  fclose (fp);
-  switch (action)
+}
+
+
+#ifdef SERVESOCKET
+void
+serve_socket (char *socketname, char *filename)
+/* answers the queries sent over each connection to the socket,
+   one connection at a time */
+{
+  struct sockaddr_un addr;
+  struct stat st;
+  int listener, conn, out;
+  FILE *in;
+
+  if (strlen (socketname) >= sizeof (addr.sun_path))
     {
-    case cpitch_histogram:
-      print_pitch_histogram ();
-      break;
-    case cwpitch_histogram:
-      print_weighted_pitch_histogram ();
-      break;
-    case clength_histogram:
-      print_length_histogram ();
-      break;
-    case interval_pdf:
-      print_interval_pdf ();
-      break;
+      printf ("socket name %s is too long\n", socketname);
+      exit (1);
+    }
+  if (stat (socketname, &st) == 0)
+    {
+      if (!S_ISSOCK (st.st_mode))
+	{
+	  printf ("%s exists and is not a socket\n", socketname);
+	  exit (1);
+	}
+      unlink (socketname);
+    }
+  memset (&addr, 0, sizeof (addr));
+  addr.sun_family = AF_UNIX;
+  strcpy (addr.sun_path, socketname);
+  listener = socket (AF_UNIX, SOCK_STREAM, 0);
+  if (listener < 0 ||
+      bind (listener, (struct sockaddr *) &addr, sizeof (addr)) != 0 ||
+      listen (listener, 5) != 0)
+    {
+      printf ("cannot listen on socket %s\n", socketname);
+      exit (1);
+    }
+/* a client going away must not end the server */
+  signal (SIGPIPE, SIG_IGN);
+  fflush (stdout);
+  out = dup (1);
+  for (;;)
+    {
+      conn = accept (listener, NULL, NULL);
+      if (conn < 0)
+	continue;
+      in = fdopen (conn, "r");
+      if (in == NULL)
+	{
+	  close (conn);
+	  continue;
+	}
+/* the matching functions print their results on stdout */
+      dup2 (conn, 1);
+      serve_queries (in, filename);
+      fflush (stdout);
+      dup2 (out, 1);
+      clearerr (stdout);
+      fclose (in);
     }
-  return (0);
 }
+#endif
 
 
 void
@@ -1204,7 +3597,7 @@ event_init (argc, argv, filename)
      char *argv[];
      char **filename;
 {
-  int i,j;
+  int j;
 
   xmatch = 0;
   /* look for code checking option */
@@ -1239,6 +3632,8 @@ event_init (argc, argv, filename)
     anymode = 1;
   if (getarg ("-ign", argc, argv) != -1)
     ignore_simple = 1;
+  if (getarg ("-anykey", argc, argv) != -1)
+    anykey = 1;
   if (getarg ("-con", argc, argv) != -1)
     con = 1;
   if (getarg ("-qnt", argc, argv) != -1)
@@ -1276,7 +3671,6 @@ event_init (argc, argv, filename)
          tpxref = readnumf(argv[j+1]);
         }
     anymode = 1; /* only mode which makes sense for a entire tune template*/
-    for (i=0;i<300;i++) tpbarstatus[i] = 0;
     }
  
  
@@ -1293,6 +3687,12 @@ event_init (argc, argv, filename)
       brief = 1;
     }
  
+  if (getarg ("-pairs", argc, argv) != -1)
+    {
+      allpairs = 1;
+      brief = 1;
+    }
+
   j = getarg ("-fixed", argc, argv);
   if (j != -1)
     {
@@ -1305,6 +3705,49 @@ event_init (argc, argv, filename)
       sscanf (argv[j], "%d", &fixednumberofnotes);
    }
 
+  j = getarg ("-mkindex", argc, argv);
+  if (j != -1)
+    {
+      if (argv[j] == NULL)
+	{
+	  printf ("error: expecting file name after parameter -mkindex\n");
+	  exit (0);
+	}
+      mkindexname = argv[j];
+    }
+
+  j = getarg ("-index", argc, argv);
+  if (j != -1)
+    {
+      if (argv[j] == NULL)
+	{
+	  printf ("error: expecting file name after parameter -index\n");
+	  exit (0);
+	}
+      indexname = argv[j];
+    }
+
+  j = getarg ("-serve", argc, argv);
+  if (j != -1)
+    {
+      serving = 1;
+      if (argv[j] != NULL && *argv[j] != '-')
+	servesocket = argv[j];
+    }
+
+  j = getarg ("-j", argc, argv);
+  if (j != -1)
+    {
+      if (argv[j] == NULL)
+	{
+	  printf ("error: expecting number after parameter -j\n");
+	  exit (0);
+	}
+      sscanf (argv[j], "%d", &scanjobs);
+      if (scanjobs < 1)
+	scanjobs = 1;
+    }
+
   wphist = getarg ("-wpitch_hist", argc, argv);
   phist = getarg ("-pitch_hist", argc, argv);
   lhist = getarg ("-length_hist", argc, argv);
@@ -1337,6 +3780,8 @@ event_init (argc, argv, filename)
      action = interval_pdf_table;
    }
 
+  if (con == 1)
+    anykey = 0;			/* contours do not depend on the key */
   if (brief == 1)
     resolution = 0;		/* do not compute msamples in main() */
   maxnotes = 3000;
@@ -1363,10 +3808,16 @@ event_init (argc, argv, filename)
       printf ("        -qnt contour quantization\n");
       printf ("        -lev use levenshtein distance\n");
       printf ("        -ign  ignore simple bars\n");
+      printf ("        -anykey find matches in any transposition\n");
       printf ("        -a report any matching bars (default all bars)\n");
       printf ("        -br %%d only report number of matched bars when\n\
 	    above given threshold\n");
+      printf ("        -pairs brief mode with every tune as template\n");
       printf ("        -tp <abc file> [reference number]\n");
+      printf ("        -mkindex <file> write an index of the abc file\n");
+      printf ("        -index <file> use index to find candidate tunes\n");
+      printf ("        -j <n> scan the file with n processes\n");
+      printf ("        -serve [socket] keep the file loaded and answer queries\n");
       printf ("        -ver returns version number\n");
       printf ("        -pitch_hist pitch histogram\n");
       printf ("        -wpitch_hist interval weighted pitch histogram\n");
@@ -1394,19 +3845,6 @@ main (argc, argv)
 {
   char *filename;
   int i;
-  int ikey, mkey;
-  int moffset;
-  int transpose;
-  int mseqno;
-  /* sequence number of template (match.abc) 
-   * mseqno can differ from xrefnum when running count_matched_tune_bars
-   * because there is no guarantee the xref numbers are in
-   * sequence in the input file. Hopefully fileindex matches sequence
-   * number in script calling this executable.
-   */
-
-  int kfile, count;
-  int kount;
 
 /* initialization */
   action = none;
@@ -1420,9 +3858,30 @@ main (argc, argv)
    runabc.tcl when you are using this search function.
 */
 
-  if (action != none)
+  if (mkindexname != NULL)
+    build_index (filename, mkindexname);
+
+  else if (action != none)
     analyze_abc_file (filename);
 
+  else if (allpairs)
+    match_all_pairs (filename);
+
+  else if (serving)
+    {
+      if (!load_corpus (filename))
+	{
+	  printf ("cannot open file %s\n", filename);
+	  exit (0);
+	}
+#ifdef SERVESOCKET
+      if (servesocket != NULL)
+	serve_socket (servesocket, filename);
+      else
+#endif
+	serve_queries (stdin, filename);
+    }
+
   else
     {				/* if not computing histograms */
       if (tpxref >0 ) xmatch = tpxref;/* get only tune with ref number xmatch*/
@@ -1435,7 +3894,8 @@ main (argc, argv)
       mseqno = xrefno;		/* if -br mode, X:refno is file sequence number */
       /* xrefno was set by runabc.tcl to be file sequence number of tune */
       /*print_feature_list(); */
-      make_note_representation (&tpnotes, &tpbars, tpmaxnotes, tpmaxbars,
+      reserve_template (notes);
+      make_note_representation (&tpnotes, &tpbars,
 				&tptimesig_num, &tptimesig_denom, tpbarlineptr,
 				tpnotelength, tpmidipitch);
 
@@ -1451,99 +3911,19 @@ main (argc, argv)
       tpbars -= j;
      */
 
-      moffset = 0;
 /* if not exact match, i.e. resolution > 0 compute to an
    sample representation of the template.
 */
       if (resolution > 0)
-	for (i = 0; i < tpbars; i++)
-	  {
-	    msamples[i] =
-	      make_bar_image (i, resolution, 
-			      tpbarlineptr, tpnotelength, tpnotes, 0,
-			      tpmidipitch, mpitch_samples + moffset);
-	    if (con == 1)
-	      difference_midipitch (mpitch_samples + moffset, msamples[i]);
-	    moffset += msamples[i];
-	    if (moffset > 3900)
-	      printf ("abcmatch: out of room in mpitch_samples\n");
-	  }
+	make_template_images ();
 
 /* now process the input file */
 
 
       xmatch = 0; /* we do not want to filter any reference numbers here */
-      fp = fopen (filename, "rt");
-      if (fp == NULL)
-	{
-	  printf ("cannot open file %s\n", filename);
-	  exit (0);
-	}
-
       kfile = 0;
-      while (!feof (fp))
-	{
-	  fileindex++;
-	  startfile ();
-	  parsetune (fp);
-          /*printf("fileindex = %d xrefno =%d\n",fileindex,xrefno); 
-            printf("%s\n",titlename); */
-          if (tpxref == xrefno) {
-             tp_fileindex = fileindex;
-             continue;
-             }
-	  if (notes < 10)
-	    continue;
-	  ikey = sf2midishift[sf + 7];
-	  /*print_feature_list(); */
-          if (voicesused) {/*printf("xref %d has voices\n",xrefno);*/
-                           continue;
-                          }
-	  make_note_representation (&innotes, &inbars, imaxnotes, imaxbars,
-				    &itimesig_num, &itimesig_denom,
-				    ibarlineptr, inotelength, imidipitch);
-	    {
-
-/* ignore tunes which do not share the same time signature as the template */
-	      if ((itimesig_num != tptimesig_num
-		  || itimesig_denom != tptimesig_denom)
-                 && fixednumberofnotes == 0)
-		continue;
-
-
-	      transpose = mkey - ikey;
-/* we do not know whether to transpose up or down so we will
-   go in the direction with the smallest number of steps
-  [SS] 2013-11-12
-*/
-              if (transpose > 6) transpose = transpose -12;
-              if (transpose < -6) transpose = transpose + 12;
-
-
-/* brief mode is used by the grouper in runabc.tcl */
-	      if (brief)
-		{
-		  if (mseqno == fileindex)
-		    continue;	/* don't check tune against itself */
-		  count = count_matched_tune_bars (tpbars, inbars, transpose);
-                  kount = count_matching_template_bars();
-		  /*if (count >= cthresh) [SS] 2013-11-26 */
-		  if (kount >= cthresh)
-		    {
-		      if (kfile == 0)
-			printf ("%d\n", tpbars);
-		      printf (" %d %d %d\n", fileindex, count,kount);
-		      kfile++;
-		    }
-		}
-
-	      else
-/* top level matching function if not brief mode */
-		find_and_report_matching_bars (tpbars, inbars, transpose,
-					       anymode, con);
-	    }
-	}
-      fclose (fp);
+      if (indexname == NULL || !scan_with_index (filename))
+	scan_file (filename, match_tune);
       if (tpxref > 0) {
           printf ("%d %d ", tp_fileindex, tpxref);
           for (i = 0; i <tpbars ;i++) 
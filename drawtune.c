@@ -29,11 +29,20 @@
 #endif
 
 #include <stdio.h>
+#include <stdarg.h>
 #ifdef ANSILIBS
 #include <stdlib.h>
 #include <ctype.h>
 #include <string.h>
 #endif
+/* -j lays tunes out in several child processes and -C keeps the */
+/* layout of each tune in a cache directory */
+#if !defined(_WIN32) && !defined(__MSDOS__)
+#define LAYOUTFORK
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
 
 #include "abc.h"
 #include "structs.h"
@@ -48,7 +57,9 @@ extern int barnums, nnbars;
 extern char outputname[256];
 extern char outputroot[256];
 extern int make_open();
+extern int tunekey(struct tune* t, char* settings, char* key);
 extern void printlib();
+extern void printpdf();
 extern int count_dots(int *base, int *base_exp, int n, int m);
 
 extern void monospace(struct tune* t);
@@ -69,6 +80,10 @@ static void pagebottom();
 static void setfont(int size, int num);
 
 FILE* f = NULL;
+static FILE* psfile; /* output file, written when f is complete */
+static char psname[256];
+static struct bbox psbox;
+static int psboxed;
 struct feature* beamset[64];
 struct feature* gracebeamset[32];
 int beamctr, gracebeamctr;;
@@ -85,10 +100,170 @@ int pagelen, pagewidth, xmargin, ymargin;
 double scaledlen, scaledwidth;
 int staffsep;
 int eps_out;
+int pdf_out = 0;
+int pdf_compress = 1;
 int titleleft = 0;
 int titlecaps = 0;
 int gchords_above = 1;
 int redcolor; /* [SS] 2013-11-04*/
+int layoutjobs = 1; /* -j */
+char* layoutcache = NULL; /* -C */
+
+/* With -j the tunes are shared out between child processes which */
+/* write their PostScript to temporary files. Anything which depends */
+/* on where the previous tunes ended (page breaks, the current font) */
+/* is left as a marker line in the file and is carried out when the  */
+/* files are copied to the real output in order by replay().         */
+/* The same files are kept by -C as the cached layout of a tune.   */
+#define RECORDMARK '\001'
+static int recording = 0;
+static int recfontsize, recfontnum; /* font after replay, 0 if not known */
+static double firstvline;
+
+/* Most of the PostScript is written with psprintf(), which handles  */
+/* the %d, %c, %s and %.1f conversions used for it and formats the   */
+/* numbers itself, giving the same text as fprintf() would. Each     */
+/* call is built up in psbuf and written to f in one go.             */
+static char psbuf[1024];
+static int pslen = 0;
+
+static void psflush()
+/* write out what psprintf() has built up */
+{
+  fwrite(psbuf, 1, pslen, f);
+  pslen = 0;
+}
+
+static void psroom(int n)
+/* make room for n more characters in psbuf */
+{
+  if (pslen + n > (int)sizeof(psbuf)) {
+    psflush();
+  };
+}
+
+static void psint(long n)
+/* add an integer to psbuf */
+{
+  char digits[24];
+  unsigned long u;
+  int i;
+
+  psroom(24);
+  if (n < 0) {
+    psbuf[pslen] = '-';
+    pslen = pslen + 1;
+    u = -(unsigned long)n;
+  } else {
+    u = n;
+  };
+  i = 0;
+  do {
+    digits[i] = '0' + (int)(u % 10);
+    i = i + 1;
+    u = u / 10;
+  } while (u != 0);
+  while (i > 0) {
+    i = i - 1;
+    psbuf[pslen] = digits[i];
+    pslen = pslen + 1;
+  };
+}
+
+static void psfixed(double x)
+/* add x to psbuf with one decimal place, as %.1f does */
+{
+  char number[400];
+  double y, r, d;
+  long n;
+
+  y = x * 10.0;
+  if ((y < 1e9) && (y > -1e9)) {
+    n = (long)(y + 0.5);
+    if ((double)n > y + 0.5) {
+      n = n - 1;
+    };
+    r = (double)n;
+    d = y + 0.5 - r;
+    /* that is y rounded unless y is within rounding error of a tie */
+    if ((n != 0) && (d > 1e-6) && (d < 1.0 - 1e-6)) {
+      if (n < 0) {
+        psroom(1);
+        psbuf[pslen] = '-';
+        pslen = pslen + 1;
+        n = -n;
+      };
+      psint(n / 10);
+      psroom(2);
+      psbuf[pslen] = '.';
+      psbuf[pslen+1] = '0' + (int)(n % 10);
+      pslen = pslen + 2;
+      return;
+    };
+  };
+  /* zero (which may be -0.0), very large, a tie or not a number */
+  sprintf(number, "%.1f", x);
+  n = strlen(number);
+  psroom(n);
+  memcpy(psbuf+pslen, number, n);
+  pslen = pslen + n;
+}
+
+static void psprintf(char* fmt, ...)
+/* fprintf(f, fmt, ...) for the conversions %d, %c, %s, %.1f and %% */
+{
+  va_list ap;
+  char* p;
+  char* s;
+  int len;
+
+  va_start(ap, fmt);
+  p = fmt;
+  while (*p != '\0') {
+    if (*p != '%') {
+      psroom(1);
+      psbuf[pslen] = *p;
+      pslen = pslen + 1;
+    } else {
+      p = p + 1;
+      switch (*p) {
+      case 'd':
+        psint((long)va_arg(ap, int));
+        break;
+      case 'c':
+        psroom(1);
+        psbuf[pslen] = (char)va_arg(ap, int);
+        pslen = pslen + 1;
+        break;
+      case 's':
+        s = va_arg(ap, char*);
+        len = strlen(s);
+        if (len > (int)sizeof(psbuf)) {
+          psflush();
+          fwrite(s, 1, len, f);
+        } else {
+          psroom(len);
+          memcpy(psbuf+pslen, s, len);
+          pslen = pslen + len;
+        };
+        break;
+      case '.':
+        /* %.1f */
+        p = p + 2;
+        psfixed(va_arg(ap, double));
+        break;
+      default:
+        psroom(1);
+        psbuf[pslen] = *p;
+        pslen = pslen + 1;
+        break;
+      };
+    };
+    p = p + 1;
+  };
+  va_end(ap);
+  psflush();
+}
 
 enum placetype {left, right, centre};
 struct font textfont;
@@ -358,11 +533,11 @@ static void ISOfprintf(char s[])
   while (i<len) {
     switch(s[i]) {
     case '(':
-      fprintf(f, "\\(");
+      psprintf("\\(");
       i = i+1;
       break;
     case ')':
-      fprintf(f, "\\)");
+      psprintf("\\)");
       i = i+1;
       break;
     case '\\':
@@ -372,7 +547,7 @@ static void ISOfprintf(char s[])
     default:
       ch = 0xFF & (int)s[i];
       if ((ch > 31) && (ch < 128)) {
-        fprintf(f, "%c", s[i]);
+        psprintf("%c", s[i]);
       } else {
         fprintf(f, "\\%03o", 0xFF & (int)s[i]);
       };
@@ -382,34 +557,89 @@ static void ISOfprintf(char s[])
   };
 }
 
+/* The widths of the 256 character codes in each of the two metric  */
+/* fonts, built from the tables above on first use.                  */
+static double charwidths[2][256];
+static int gotcharwidths = 0;
+
+static void makecharwidths()
+/* codes without a width in the tables count as a space */
+{
+  int code;
+
+  for (code = 0; code < 256; code++) {
+    if ((code >= 32) && (code - 32 < 224)) {
+      charwidths[0][code] = helvetica_width[code - 32];
+      charwidths[1][code] = timesbold_width[code - 32];
+    } else {
+      charwidths[0][code] = helvetica_width[0];
+      charwidths[1][code] = timesbold_width[0];
+    };
+  };
+  gotcharwidths = 1;
+}
+
+/* Layout measures the same syllables, guitar chords and instructions */
+/* many times over (sizenote() is called again by measureline()), so  */
+/* the widths are kept in a small cache indexed by a hash of the      */
+/* string. Widths are stored at the base point size of the font.     */
+#define WIDTHCACHE 1024
+
+struct cachedwidth {
+  char* str;
+  int metric;
+  double width;
+};
+
+static struct cachedwidth widthcache[WIDTHCACHE];
+
 static double stringwidth(char* str, double ptsize, int fontno)
 /* calculate width of string */
 {
-  int i, len, ch;
+  int i, metric, code;
+  unsigned int hash;
   double width;
-  int code;
   double baseptsize;
   double* charwidth;
+  struct cachedwidth* entry;
 
   if (fontno == 3) {
-    charwidth = &helvetica_width[0];
+    metric = 0;
     baseptsize = 12.0;
   } else {
-    charwidth = &timesbold_width[0];
+    metric = 1;
     baseptsize = 13.0;
   };
+  hash = 2166136261u + metric;
+  for (i = 0; str[i] != '\0'; i++) {
+    hash = (hash ^ (0xFF & (unsigned int)str[i])) * 16777619u;
+  };
+  entry = &widthcache[hash & (WIDTHCACHE - 1)];
+  if ((entry->str != NULL) && (entry->metric == metric) &&
+      (strcmp(entry->str, str) == 0)) {
+    return(entry->width*ptsize/baseptsize);
+  };
+  if (!gotcharwidths) {
+    makecharwidths();
+  };
+  charwidth = charwidths[metric];
   width = 0.0;
-  len = strlen(str);
   i = 0;
-  while (i < len) {
-    i = getISO(str, i, &code);
-    ch = code - 32;
-    if ((ch >= 0) && (ch < 224)) {
-      width = width + charwidth[ch];
+  while (str[i] != '\0') {
+    if (str[i] == '\\') {
+      i = getISO(str, i, &code);
     } else {
-      width = width + charwidth[0]; /* approximate with space */
+      code = 0xFF & (int)str[i];
+      i = i + 1;
     };
+    width = width + charwidth[code];
   };
+  if (entry->str != NULL) {
+    free(entry->str);
+  };
+  entry->str = addstring(str);
+  entry->metric = metric;
+  entry->width = width;
   return(width*ptsize/baseptsize);
 }
 
@@ -521,17 +751,17 @@ int ptsize, spce, defnum, specialnum;
 static void startpage()
 /* Encapsulated PostScript for a page header */
 {
-  fprintf(f, "%%%%Page: %d %d\n", pagecount, pagecount);
-  fprintf(f, "%%%%BeginPageSetup\n");
-  fprintf(f, "gsave\n");
+  psprintf("%%%%Page: %d %d\n", pagecount, pagecount);
+  psprintf("%%%%BeginPageSetup\n");
+  psprintf("gsave\n");
   if (landscape) {
-    fprintf(f, "90 rotate %d %d T\n", xmargin, -ymargin);
+    psprintf("90 rotate %d %d T\n", xmargin, -ymargin);
   } else {
-    fprintf(f, "%d %d T\n", xmargin, ymargin+pagelen);
+    psprintf("%d %d T\n", xmargin, ymargin+pagelen);
   };
-  fprintf(f, "0.8 setlinewidth 0 setlinecap\n");
+  psprintf("0.8 setlinewidth 0 setlinecap\n");
   fprintf(f, "%.3f %.3f scale\n", scale, scale);
-  fprintf(f, "%%%%EndPageSetup\n\n");
+  psprintf("%%%%EndPageSetup\n\n");
   fontnum = 0;
   fontsize = 0;
   totlen = 0.0;
@@ -546,11 +776,11 @@ static void closepage()
   if (pagenumbering) {
     setfont(12, 3);
     pagebottom();
-    fprintf(f, "(%d) %.1f 0 M cshow\n", pagecount, scaledwidth/2.0);
+    psprintf("(%d) %.1f 0 M cshow\n", pagecount, scaledwidth/2.0);
   };
-  fprintf(f, "%%%%PageTrailer\n");
-  fprintf(f, "grestore\n");
-  fprintf(f, "showpage\n\n");
+  psprintf("%%%%PageTrailer\n");
+  psprintf("grestore\n");
+  psprintf("showpage\n\n");
   pagecount = pagecount + 1;
 }
 
@@ -559,16 +789,21 @@ void newpage()
 /* everything will now be printed on this fresh sheet */
 /* ignore the command if the sheet is completely blank */
 {
-  if (totlen > 0.0) {
-    closepage();
-    startpage();
+  if (recording) {
+    fprintf(f, "%cP\n", RECORDMARK);
+    recfontsize = 0;
+  } else {
+    if (totlen > 0.0) {
+      closepage();
+      startpage();
+    };
   };
 }
 
 static void pagebottom()
 /* move to the bottom of the page */
 {
-  fprintf(f, "0 %.1f T\n", -(scaledlen - totlen));
+  psprintf("0 %.1f T\n", -(scaledlen - totlen));
   totlen = scaledlen;
   descend = 0.0;
 }
@@ -580,18 +815,23 @@ static void newblock(double height, double descender)
 /* Subsequent calls may draw up to height units above or */
 /* descender units below the line y=0 */
 {
-  if (totlen+(descend+height+descender) > scaledlen - (double)(pagenumbering*12)) {
-    newpage();
+  if (recording) {
+    fprintf(f, "%cB %.17g %.17g\n", RECORDMARK, height, descender);
+    recfontsize = 0;
+  } else {
+    if (totlen+(descend+height+descender) > scaledlen - (double)(pagenumbering*12)) {
+      newpage();
+    };
+    psprintf("0 %.1f T\n", - descend - height);
+    totlen = totlen + (descend + height);
+    descend = descender;
   };
-  fprintf(f, "0 %.1f T\n", - descend - height);
-  totlen = totlen + (descend + height);
-  descend = descender;
 }
 
 static void staveline()
 /* draw 5 lines of a stave */
 {
-  fprintf(f, "%.1f staff\n", scaledwidth);
+  psprintf("%.1f staff\n", scaledwidth);
 }
 
 static void printclef(struct aclef* t, double x, double yup, double ydown)
@@ -599,34 +839,34 @@ static void printclef(struct aclef* t, double x, double yup, double ydown)
 {
   switch (t->type) {
   case treble:
-    fprintf(f, "%.1f tclef\n", x);
+    psprintf("%.1f tclef\n", x);
     break;
   case bass:
-    fprintf(f, "%.1f bclef\n", x);
+    psprintf("%.1f bclef\n", x);
     break;
   case alto:
-    fprintf(f, "%.1f cclef\n", x);
+    psprintf("%.1f cclef\n", x);
     break;
   case baritone:
-    fprintf(f, "0 %d T %.1f cclef 0 %d T\n", 4*TONE_HT, x, -4*TONE_HT);
+    psprintf("0 %d T %.1f cclef 0 %d T\n", 4*TONE_HT, x, -4*TONE_HT);
     break;
   case tenor:
-    fprintf(f, "0 %d T %.1f cclef 0 %d T\n", 2*TONE_HT, x, -2*TONE_HT);
+    psprintf("0 %d T %.1f cclef 0 %d T\n", 2*TONE_HT, x, -2*TONE_HT);
     break;
   case mezzo:
-    fprintf(f, "0 %d T %.1f cclef 0 %d T\n", -2*TONE_HT, x, 2*TONE_HT);
+    psprintf("0 %d T %.1f cclef 0 %d T\n", -2*TONE_HT, x, 2*TONE_HT);
     break;
   case soprano:
-    fprintf(f, "0 %d T %.1f cclef 0 %d T\n", -4*TONE_HT, x, 4*TONE_HT);
+    psprintf("0 %d T %.1f cclef 0 %d T\n", -4*TONE_HT, x, 4*TONE_HT);
     break;
   default:
     break;
   };
   if (t->octave > 0) {
-    fprintf(f, "%.1f %.1f (%d) bnum\n", x, yup - CLEFNUM_HT + 3, t->octave);
+    psprintf("%.1f %.1f (%d) bnum\n", x, yup - CLEFNUM_HT + 3, t->octave);
   };
   if (t->octave < 0) {
-    fprintf(f, "%.1f %.1f (%d) bnum\n", x, -ydown, - t->octave);
+    psprintf("%.1f %.1f (%d) bnum\n", x, -ydown, - t->octave);
   };
 }
 
@@ -720,7 +960,7 @@ static void draw_keysig(char oldmap[], char newmap[], int newmult[],
     note = (sharp_pos[i] + 4) % 7;
     if ((newmap[note] == '=')&&(oldmap[note] != '=')) {
       pos = (sharp_pos[i] + offset - 3) % 7 + 3;
-      fprintf(f, " %.1f %d nt0", xpos, pos*TONE_HT);
+      psprintf(" %.1f %d nt0", xpos, pos*TONE_HT);
       xpos = xpos + 5;
     };
   };
@@ -730,9 +970,9 @@ static void draw_keysig(char oldmap[], char newmap[], int newmult[],
     if (newmap[note] == '^') {
       pos = (sharp_pos[i] + offset - 3) % 7 + 3;
       if (newmult[note] == 2) {
-        fprintf(f, " %.1f %d dsh0", xpos, pos*TONE_HT);
+        psprintf(" %.1f %d dsh0", xpos, pos*TONE_HT);
       } else {
-        fprintf(f, " %.1f %d sh0", xpos, pos*TONE_HT);
+        psprintf(" %.1f %d sh0", xpos, pos*TONE_HT);
       };
       xpos = xpos + 5;
     };
@@ -743,20 +983,20 @@ static void draw_keysig(char oldmap[], char newmap[], int newmult[],
     if (newmap[note] == '_') {
       pos = (flat_pos[i] + offset - 1)%7 + 1;
       if (newmult[note] == 2) {
-        fprintf(f, " %.1f %d dft0", xpos, pos*TONE_HT);
+        psprintf(" %.1f %d dft0", xpos, pos*TONE_HT);
       } else {
-        fprintf(f, " %.1f %d ft0", xpos, pos*TONE_HT);
+        psprintf(" %.1f %d ft0", xpos, pos*TONE_HT);
       };
       xpos = xpos + 5;
     };
   };
-  fprintf(f, "\n");
+  psprintf("\n");
 }
 
 static void draw_meter(struct fract* meter, double x)
 /* draw meter (time signature) at specified x value */
 {
-  fprintf(f, "%.1f (%d) (%d) tsig\n", x, meter->num, meter->denom);
+  psprintf("%.1f (%d) (%d) tsig\n", x, meter->num, meter->denom);
 }
 
 static double maxstrwidth(struct llist* strings, double ptsize, int fontno)
@@ -1128,9 +1368,9 @@ static void drawtuple(struct feature* beamset[], int beamctr, int tupleno)
     y1 = (double)(TONE_HT*n->y) - n->stemlength;
   };
   if (stemup) {
-    fprintf(f, " %.1f %.1f (%d) bnum", (x0+x1)/2, (y0+y1)/2 + TUPLE_UP, tupleno);
+    psprintf(" %.1f %.1f (%d) bnum", (x0+x1)/2, (y0+y1)/2 + TUPLE_UP, tupleno);
   } else {
-    fprintf(f, " %.1f %.1f (%d) bnum", (x0+x1)/2, (y0+y1)/2 + TUPLE_DOWN, 
+    psprintf(" %.1f %.1f (%d) bnum", (x0+x1)/2, (y0+y1)/2 + TUPLE_DOWN, 
            tupleno);
   };
 }
@@ -1142,9 +1382,9 @@ static void drawhtuple(double xstart, double xend, int num, double y)
   double xmid;
 
   xmid = (xstart + xend)/2;
-  fprintf(f, " %.1f %.1f %.1f %.1f hbr", xstart, y, xmid-6.0, y);
-  fprintf(f, " %.1f %.1f %.1f %.1f hbr", xend, y, xmid+6.0, y);
-  fprintf(f, " %.1f %.1f (%d) bnum\n", xmid, y-4.0, num);
+  psprintf(" %.1f %.1f %.1f %.1f hbr", xstart, y, xmid-6.0, y);
+  psprintf(" %.1f %.1f %.1f %.1f hbr", xend, y, xmid+6.0, y);
+  psprintf(" %.1f %.1f (%d) bnum\n", xmid, y-4.0, num);
 }
 
 static void drawbeam(struct feature* beamset[], int beamctr, int dograce)
@@ -1168,8 +1408,8 @@ static void drawbeam(struct feature* beamset[], int beamctr, int dograce)
     event_error("Internal error: beam does not start with NOTE");
     exit(0);
   };
-  fprintf(f, "\n");
-  if (redcolor) fprintf(f,"1.0 0.0 0.0 setrgbcolor\n");
+  psprintf("\n");
+  if (redcolor) psprintf("1.0 0.0 0.0 setrgbcolor\n");
   n = beamset[0]->item;
   stemup = n->stemup;
   beamdir = 2*stemup - 1;
@@ -1212,16 +1452,16 @@ static void drawbeam(struct feature* beamset[], int beamctr, int dograce)
               y1 = y1 + (y0-y1)/2;
             };
             if (dograce) {
-              fprintf(f, "%.1f %.1f %.1f %.1f gbm2\n", x0, y0, x1, y1);
+              psprintf("%.1f %.1f %.1f %.1f gbm2\n", x0, y0, x1, y1);
             } else {
-              fprintf(f, "%.1f %.1f %.1f %.1f %.1f bm\n", x0, y0, x1, y1,
+              psprintf("%.1f %.1f %.1f %.1f %.1f bm\n", x0, y0, x1, y1,
                        (double)(beamdir * TAIL_WIDTH));
             };
           } else {
             if (dograce) {
-              fprintf(f, "%.1f %.1f %.1f %.1f gbm2\n", x0, y0, x1, y1);
+              psprintf("%.1f %.1f %.1f %.1f gbm2\n", x0, y0, x1, y1);
             } else {
-              fprintf(f, "%.1f %.1f %.1f %.1f %.1f bm\n", x0, y0, x1, y1,
+              psprintf("%.1f %.1f %.1f %.1f %.1f bm\n", x0, y0, x1, y1,
                        (double)(beamdir * TAIL_WIDTH));
             };
           };
@@ -1233,7 +1473,7 @@ static void drawbeam(struct feature* beamset[], int beamctr, int dograce)
     d = d - 1;
     offset = offset + TAIL_SEP;
   };
-  if (redcolor) fprintf(f,"0 setgray\n");
+  if (redcolor) psprintf("0 setgray\n");
 }
 
 static void sizevoice(struct voice* v, struct tune* t)
@@ -1580,27 +1820,27 @@ static void singlehead(double x, double y, int base, int base_exp, int dots)
   int i;
   double dot_offset;
 
-  fprintf(f, "%.1f %.1f ", x, y);
+  psprintf("%.1f %.1f ", x, y);
   /* note head */
   dot_offset = HALF_HEAD;
   switch(base_exp) {
   case 1:
-    fprintf(f, "BHD");
+    psprintf("BHD");
     dot_offset = HALF_BREVE;
     break; 
   case 0:
-    fprintf(f, "HD");
+    psprintf("HD");
     break; 
   case -1:
-    fprintf(f, "Hd");
+    psprintf("Hd");
     break; 
   default:
     if (base_exp > 1) {
-      fprintf(f, "BHD");
+      psprintf("BHD");
       dot_offset = HALF_BREVE;
       event_warning("Note value too long to represent");
     } else {
-      fprintf(f, "hd");
+      psprintf("hd");
     };
     break; 
   };
@@ -1608,7 +1848,7 @@ static void singlehead(double x, double y, int base, int base_exp, int dots)
     event_warning("Note value cannot be represented");
   };
   for (i=1; i <= dots; i++) {
-    fprintf(f, " %.1f 3.0 dt", (double)(dot_offset+DOT_SPACE*i)); 
+    psprintf(" %.1f 3.0 dt", (double)(dot_offset+DOT_SPACE*i)); 
   };
 }
 
@@ -1649,20 +1889,20 @@ static void drawhead(struct note* n, double x, struct feature* ft)
   };
   switch (n->accidental) {
   case '=':
-    fprintf(f, " %.1f nt", accspace);
+    psprintf(" %.1f nt", accspace);
     break;
   case '^':
     if (n->mult == 1) {
-      fprintf(f, " %.1f sh", accspace);
+      psprintf(" %.1f sh", accspace);
     } else {
-      fprintf(f, " %.1f dsh", accspace);
+      psprintf(" %.1f dsh", accspace);
     };
     break;
   case '_':
     if (n->mult == 1) {
-      fprintf(f, " %.1f ft", accspace);
+      psprintf(" %.1f ft", accspace);
     } else {
-      fprintf(f, " %.1f dft", accspace);
+      psprintf(" %.1f dft", accspace);
     };
     break;
   default:
@@ -1670,12 +1910,12 @@ static void drawhead(struct note* n, double x, struct feature* ft)
   };
   i = 10;
   while (n->y >= i) {
-    fprintf(f, " %d hl", i*TONE_HT);
+    psprintf(" %d hl", i*TONE_HT);
     i = i + 2;
   };
   i = -2;
   while (n->y <= i) {
-    fprintf(f, " %d hl", i*TONE_HT);
+    psprintf(" %d hl", i*TONE_HT);
     i = i - 2;
   };
   if (n->accents != NULL) {
@@ -1691,49 +1931,49 @@ static void drawhead(struct note* n, double x, struct feature* ft)
       switch (decorators[i]) {
       case  '.':
         if (n->stemup) {
-          fprintf(f, " %.1f stc", ybot+STC_OFF);
+          psprintf(" %.1f stc", ybot+STC_OFF);
           ybot = ybot - SMALL_DEC_HT;
         } else {
-          fprintf(f, " %.1f stc", ytop+STC_OFF);
+          psprintf(" %.1f stc", ytop+STC_OFF);
           ytop = ytop + SMALL_DEC_HT;
         };
         break;
       case  'R':
         if (n->stemup) {
-          fprintf(f, " %.1f cpd", ybot+CPD_OFF);
+          psprintf(" %.1f cpd", ybot+CPD_OFF);
           ybot = ybot - SMALL_DEC_HT;
         } else {
-          fprintf(f, " %.1f cpu", ytop+CPU_OFF);
+          psprintf(" %.1f cpu", ytop+CPU_OFF);
           ytop = ytop + SMALL_DEC_HT;
         };
         break;
       case  'M':
         if (n->stemup) {
-          fprintf(f, " %.1f emb", ybot+EMB_OFF);
+          psprintf(" %.1f emb", ybot+EMB_OFF);
           ybot = ybot - SMALL_DEC_HT;
         } else {
-          fprintf(f, " %.1f emb", ytop+EMB_OFF);
+          psprintf(" %.1f emb", ytop+EMB_OFF);
           ytop = ytop + SMALL_DEC_HT;
         };
         break;
       case 'H':
-        fprintf(f, " %.1f hld", ytop+HLD_OFF);
+        psprintf(" %.1f hld", ytop+HLD_OFF);
         ytop = ytop + BIG_DEC_HT;
         break;
       case '~':
-        fprintf(f, " %.1f grm", ytop+GRM_OFF);
+        psprintf(" %.1f grm", ytop+GRM_OFF);
         ytop = ytop + BIG_DEC_HT;
         break;
       case 'u':
-        fprintf(f, " %.1f upb", ytop+UPB_OFF);
+        psprintf(" %.1f upb", ytop+UPB_OFF);
         ytop = ytop + BIG_DEC_HT;
         break;
       case 'v':
-        fprintf(f, " %.1f dnb", ytop+DNB_OFF);
+        psprintf(" %.1f dnb", ytop+DNB_OFF);
         ytop = ytop + BIG_DEC_HT;
         break;
       case 'T':
-        fprintf(f, " %.1f trl", ytop+TRL_OFF);
+        psprintf(" %.1f trl", ytop+TRL_OFF);
         ytop = ytop + BIG_DEC_HT;
         break;
       default:
@@ -1741,7 +1981,7 @@ static void drawhead(struct note* n, double x, struct feature* ft)
       };
     };
   };
-  fprintf(f, "\n");
+  psprintf("\n");
 }
 
 static void drawgracehead(struct note* n, double x, struct feature* ft, 
@@ -1755,35 +1995,35 @@ static void drawgracehead(struct note* n, double x, struct feature* ft,
   switch (tail) {
   case nostem:
     /* note head only */
-    fprintf(f, "%.1f %.1f gn", x, y);
+    psprintf("%.1f %.1f gn", x, y);
     break;
   case single:
     /* note head with stem and tail */
-    fprintf(f, "%.1f %.1f %.1f gn1", x, y, n->stemlength);
+    psprintf("%.1f %.1f %.1f gn1", x, y, n->stemlength);
     break;
   case midbeam:
   case startbeam:
   case endbeam:
     /* note head with stem and tail */
-    fprintf(f, "%.1f %.1f %.1f gnt", x, y, n->stemlength);
+    psprintf("%.1f %.1f %.1f gnt", x, y, n->stemlength);
     break;
   };
   switch (n->accidental) {
   case '=':
-    fprintf(f, " %.1f %.1f gnt0", x-ACC_OFFSET, y);
+    psprintf(" %.1f %.1f gnt0", x-ACC_OFFSET, y);
     break;
   case '^':
     if (n->mult == 1) {
-      fprintf(f, " %.1f %.1f gsh0", x-ACC_OFFSET, y);
+      psprintf(" %.1f %.1f gsh0", x-ACC_OFFSET, y);
     } else {
-      fprintf(f, " %.1f %.1f gds0h", x-ACC_OFFSET, y);
+      psprintf(" %.1f %.1f gds0h", x-ACC_OFFSET, y);
     };
     break;
   case '_':
     if (n->mult == 1) {
-      fprintf(f, " %.1f %.1f gft0", x-ACC_OFFSET, y);
+      psprintf(" %.1f %.1f gft0", x-ACC_OFFSET, y);
     } else {
-      fprintf(f, " %.1f %.1f gdf0", x-ACC_OFFSET, y);
+      psprintf(" %.1f %.1f gdf0", x-ACC_OFFSET, y);
     };
     break;
   default:
@@ -1791,15 +2031,15 @@ static void drawgracehead(struct note* n, double x, struct feature* ft,
   };
   i = 10;
   while (n->y >= i) {
-    fprintf(f, " %.1f %.1f ghl", x, (double)i*TONE_HT);
+    psprintf(" %.1f %.1f ghl", x, (double)i*TONE_HT);
     i = i + 2;
   };
   i = -2;
   while (n->y <= i) {
-    fprintf(f, " %.1f %.1f ghl", x, (double)i*TONE_HT);
+    psprintf(" %.1f %.1f ghl", x, (double)i*TONE_HT);
     i = i - 2;
   };
-  fprintf(f, "\n");
+  psprintf("\n");
 }
 
 static void handlegracebeam(struct note *n, struct feature* ft)
@@ -1842,7 +2082,7 @@ static void drawgracenote(struct note* n, double x, struct feature* ft,
   if (n->beaming == endbeam) {
     drawbeam(gracebeamset, gracebeamctr, 1);
   };
-  fprintf(f, "\n");
+  psprintf("\n");
 }
 
 static void singletail(int base, int base_exp, int stemup, double stemlength)
@@ -1855,39 +2095,39 @@ static void singletail(int base, int base_exp, int stemup, double stemlength)
     break;
   case -3:
     if (stemup) {
-      fprintf(f, " %.1f f1u", stemlength);
+      psprintf(" %.1f f1u", stemlength);
     } else {
-      fprintf(f, " %.1f f1d", stemlength);
+      psprintf(" %.1f f1d", stemlength);
     };
     break;
   case -4:
     if (stemup) {
-      fprintf(f, " %.1f f2u", stemlength);
+      psprintf(" %.1f f2u", stemlength);
     } else {
-      fprintf(f, " %.1f f2d", stemlength);
+      psprintf(" %.1f f2d", stemlength);
     };
     break;
   case -5:
     if (stemup) {
-      fprintf(f, " %.1f f3u", stemlength);
+      psprintf(" %.1f f3u", stemlength);
     } else {
-      fprintf(f, " %.1f f3d", stemlength);
+      psprintf(" %.1f f3d", stemlength);
     };
     break;
   case -6:
     if (stemup) {
-      fprintf(f, " %.1f f4u", stemlength);
+      psprintf(" %.1f f4u", stemlength);
     } else {
-      fprintf(f, " %.1f f4d", stemlength);
+      psprintf(" %.1f f4d", stemlength);
     };
     break;
   default:
     if (base_exp < -6) {
       event_warning("Note value too small to represent");
       if (stemup) {
-        fprintf(f, " %.1f f4u", stemlength);
+        psprintf(" %.1f f4u", stemlength);
       } else {
-        fprintf(f, " %.1f f4d", stemlength);
+        psprintf(" %.1f f4d", stemlength);
       };
     };
     break;
@@ -1898,21 +2138,21 @@ static void drawchordtail(struct chord* ch, double x)
 /* draw the tail to a set of notes belonging to a single chord */
 {
   if (ch->base > 1) {
-    fprintf(f, "%.1f setx ", x);
+    psprintf("%.1f setx ", x);
     if (ch->stemup) {
-      fprintf(f, "%.1f sety ", (double)(ch->ybot*TONE_HT));
-      fprintf(f, " %.1f su ", ch->stemlength + 
+      psprintf("%.1f sety ", (double)(ch->ybot*TONE_HT));
+      psprintf(" %.1f su ", ch->stemlength + 
               (double)((ch->ytop - ch->ybot)*TONE_HT));
     } else {
-      fprintf(f, "%.1f sety ", (double)(ch->ytop*TONE_HT));
-      fprintf(f, " %.1f sd ", ch->stemlength + 
+      psprintf("%.1f sety ", (double)(ch->ytop*TONE_HT));
+      psprintf(" %.1f sd ", ch->stemlength + 
               (double)((ch->ytop - ch->ybot)*TONE_HT));
     };
     if (ch->beaming == single) {
       singletail(ch->base, ch->base_exp, ch->stemup, ch->stemlength+
                    (double)((ch->ytop - ch->ybot)*TONE_HT));
     };
-    fprintf(f, "\n");
+    psprintf("\n");
   };
 }
 
@@ -1930,23 +2170,23 @@ static void showtext(struct llist* textitems, double x, double ystart, double yg
     if (*gc == ':') {
       switch (*(gc+1)) {
       case 'p': /* part label */
-        fprintf(f, " %.1f %.1f %.1f (", x, ygc, ygap);
+        psprintf(" %.1f %.1f %.1f (", x, ygc, ygap);
         ISOfprintf(gc+2);
-        fprintf(f, ") boxshow ");
+        psprintf(") boxshow ");
         break;
       case 's':
-        fprintf(f, " %.1f %.1f segno\n", x, ygc);
+        psprintf(" %.1f %.1f segno\n", x, ygc);
         break;
       case 'c':
-        fprintf(f, " %.1f %.1f coda\n", x, ygc);
+        psprintf(" %.1f %.1f coda\n", x, ygc);
         break;
       default:
         break;
       };
     } else {
-      fprintf(f, " %.1f %.1f (", x, ygc);
+      psprintf(" %.1f %.1f (", x, ygc);
       ISOfprintf(gc);
-      fprintf(f, ") gc ");
+      psprintf(") gc ");
     };
     gc = nextitem(textitems);
     ygc = ygc - ygap;
@@ -1967,6 +2207,9 @@ static void define_font(struct font* thefont, char* s)
       };
       thefont->name = addstring(fontname);
       thefont->defined = 0;
+      if (recording) {
+        fprintf(f, "%cR %d\n", RECORDMARK, thefont->special_num);
+      };
     };
     if (params == 2) {
       thefont->pointsize = fontsize;
@@ -2060,23 +2303,41 @@ char*s;
 static void setfont(int size, int num)
 /* define font point size and style */
 {
-  if ((fontsize != size) || (fontnum != num)) {
-    fprintf(f, "%d.0 F%d\n", size, num);
-    fontsize = size;
-    fontnum = num;
+  if (recording) {
+    if ((recfontsize != size) || (recfontnum != num)) {
+      fprintf(f, "%cF %d %d\n", RECORDMARK, size, num);
+      recfontsize = size;
+      recfontnum = num;
+    };
+  } else {
+    if ((fontsize != size) || (fontnum != num)) {
+      psprintf("%d.0 F%d\n", size, num);
+      fontsize = size;
+      fontnum = num;
+    };
   };
 }
 
 static void setfontstruct(struct font* thefont)
 /* set font according to font structure */
 {
-  if (thefont->name == NULL) {
+  if (recording) {
+    fprintf(f, "%cS %d %d %d %s\n", RECORDMARK, thefont->pointsize, 
+               thefont->default_num, thefont->special_num,
+               (thefont->name == NULL) ? "-" : thefont->name);
+    recfontsize = thefont->pointsize;
+    if (thefont->name == NULL) {
+      recfontnum = thefont->default_num;
+    } else {
+      recfontnum = thefont->special_num;
+    };
+  } else if (thefont->name == NULL) {
     setfont(thefont->pointsize, thefont->default_num);
   } else {
     if (thefont->defined == 0) {
       /* define font */
-      fprintf(f, "/%s-ISO /%s setISOfont\n", thefont->name, thefont->name);
-      fprintf(f, "/F%d { /%s-ISO exch selectfont} def\n", 
+      psprintf("/%s-ISO /%s setISOfont\n", thefont->name, thefont->name);
+      psprintf("/F%d { /%s-ISO exch selectfont} def\n", 
                  thefont->special_num, thefont->name);
       thefont->defined = 1;
     }
@@ -2095,7 +2356,7 @@ static void notetext(struct note* n, int* tupleno, double x, struct feature* ft,
       *tupleno = 0;
     };
   };
-  fprintf(f, "\n");
+  psprintf("\n");
   if (n->instructions != NULL && spacing != NULL) {
     setfontstruct(&partsfont);
     showtext(n->instructions, x - ft->xleft, spacing->yinstruct, 
@@ -2149,22 +2410,22 @@ static void drawnote(struct note* n, double x, struct feature* ft,
 /* draw a note */
 {
   handlebeam(n, ft);
-  if (redcolor) fprintf(f,"1.0 0.0 0.0 setrgbcolor\n");
+  if (redcolor) psprintf("1.0 0.0 0.0 setrgbcolor\n");
   drawhead(n, x, ft);
   if (thischord == NULL) {
     if (n->base > 1) {
       if (n->stemup) {
-        fprintf(f, " %.1f su", n->stemlength);
+        psprintf(" %.1f su", n->stemlength);
       } else {
-        fprintf(f, " %.1f sd", n->stemlength);
+        psprintf(" %.1f sd", n->stemlength);
       };
     };
   };
   if (n->beaming == single) {
     singletail(n->base, n->base_exp, n->stemup, n->stemlength);
   };
-  fprintf(f, "\n");
-  if (redcolor) fprintf(f,"0 setgray\n");
+  psprintf("\n");
+  if (redcolor) psprintf("0 setgray\n");
   notetext(n, tupleno, x, ft, spacing);
 }
 
@@ -2173,35 +2434,35 @@ static void drawrest(struct rest* r, double x, struct vertspacing* spacing)
 {
   int i;
 
-  if (redcolor) fprintf(f,"1.0 0.0 0.0 setrgbcolor\n");
+  if (redcolor) psprintf("1.0 0.0 0.0 setrgbcolor\n");
   if (r->multibar > 0) {
-    fprintf(f, "(%d) %.1f %d mrest ", r->multibar, x, 4*TONE_HT);
+    psprintf("(%d) %.1f %d mrest ", r->multibar, x, 4*TONE_HT);
   } else {
     reducef(&r->len);  
     switch (r->base_exp) {
     case 1:
-      fprintf(f, "%.1f %d r0 ", x, 4*TONE_HT);
+      psprintf("%.1f %d r0 ", x, 4*TONE_HT);
       break;
     case 0:
-      fprintf(f, "%.1f %d r1 ", x, 4*TONE_HT);
+      psprintf("%.1f %d r1 ", x, 4*TONE_HT);
       break;
     case -1:
-      fprintf(f, "%.1f %d r2 ", x, 4*TONE_HT);
+      psprintf("%.1f %d r2 ", x, 4*TONE_HT);
       break;
     case -2:
-      fprintf(f, "%.1f %d r4 ", x, 4*TONE_HT);
+      psprintf("%.1f %d r4 ", x, 4*TONE_HT);
       break;
     case -3:
-      fprintf(f, "%.1f %d r8 ", x, 4*TONE_HT);
+      psprintf("%.1f %d r8 ", x, 4*TONE_HT);
       break;
     case -4:
-      fprintf(f, "%.1f %d r16 ", x, 4*TONE_HT);
+      psprintf("%.1f %d r16 ", x, 4*TONE_HT);
       break;
     case -5:
-      fprintf(f, "%.1f %d r32 ", x, 4*TONE_HT);
+      psprintf("%.1f %d r32 ", x, 4*TONE_HT);
       break;
     case -6:
-      fprintf(f, "%.1f %d r64 ", x, 4*TONE_HT);
+      psprintf("%.1f %d r64 ", x, 4*TONE_HT);
       break;
     default:
       event_error("Cannot represent rest length");
@@ -2209,10 +2470,10 @@ static void drawrest(struct rest* r, double x, struct vertspacing* spacing)
     };
   };
   for (i=1; i <= r->dots; i++) {
-    fprintf(f, " %.1f 3.0 dt", (double)(HALF_HEAD+DOT_SPACE*i)); 
+    psprintf(" %.1f 3.0 dt", (double)(HALF_HEAD+DOT_SPACE*i)); 
   };
-  fprintf(f, "\n");
-  if (redcolor) fprintf(f,"0 setgray\n");
+  psprintf("\n");
+  if (redcolor) psprintf("0 setgray\n");
   if (r->instructions != NULL) {
     setfontstruct(&partsfont);
     showtext(r->instructions, x, spacing->yinstruct, 
@@ -2613,17 +2874,17 @@ struct font* afont;
 {
   newblock((double)(afont->pointsize + afont->space), 0.0);
   setfontstruct(afont);
-  fprintf(f, "(");
+  psprintf("(");
   ISOfprintf(s);
   switch (place) {
   case left:
-    fprintf(f, ") 0 0 M show\n");
+    psprintf(") 0 0 M show\n");
     break;
   case right:
-    fprintf(f, ") %.1f 0 M lshow\n", (double) scaledwidth);
+    psprintf(") %.1f 0 M lshow\n", (double) scaledwidth);
     break;
   case centre:
-    fprintf(f, ") %.1f 0 M cshow\n", scaledwidth/2.0);
+    psprintf(") %.1f 0 M cshow\n", scaledwidth/2.0);
     break;
   };
 }
@@ -2661,32 +2922,32 @@ static void draw_tempo(double x_init, double y_init, struct atempo* t)
   if (t != NULL) {
     x = x_init;
     y = y_init;
-    /* fprintf(f, "gsave 0.7 0.7 scale\n"); */
+    /* psprintf("gsave 0.7 0.7 scale\n"); */
     setfont(12, 3);
     if (t->pre != NULL) {
-      fprintf(f, "%.1f %.1f M (", x, y);
+      psprintf("%.1f %.1f M (", x, y);
       ISOfprintf(t->pre);
-      fprintf(f, ") show\n");
+      psprintf(") show\n");
       x = x + stringwidth(t->pre, 12, 3) + HALF_HEAD * 2;
     };
     if (t->count != 0) {
       dots = count_dots(&base, &base_exp, t->basenote.num, t->basenote.denom);
       singlehead(x, y, base, base_exp, dots);
       if (base >= 2) {
-        fprintf(f, " %.1f su", TEMPO_STEMLEN);
+        psprintf(" %.1f su", TEMPO_STEMLEN);
       };
       singletail(base, base_exp, 1, TEMPO_STEMLEN);
       x = x + 20.0;
       sprintf(ticks, "= %d", t->count);
-      fprintf(f, " %.1f %.1f M (%s) show\n", x, y, ticks);
+      psprintf(" %.1f %.1f M (%s) show\n", x, y, ticks);
       x = x + stringwidth(ticks, 12, 3);
     };
     if (t->post != NULL) {
-      fprintf(f, "%.1f %.1f M ( ", x, y);
+      psprintf("%.1f %.1f M ( ", x, y);
       ISOfprintf(t->post);
-      fprintf(f, ") show\n");
+      psprintf(") show\n");
     };
-    /* fprintf(f, "grestore\n"); */
+    /* psprintf("grestore\n"); */
   };
 }
 
@@ -2694,11 +2955,16 @@ static void voicedivider()
 /* This draws a horizontal line. It is used to mark where one voice */
 /* ends and the next one starts */
 {
-  newblock((double)staffsep, 0.0);
-  fprintf(f, " %.1f %.1f M %.1f %.1f L\n", 
-             scaledwidth/4.0, -descend,
-             scaledwidth*3/4.0, -descend);
-  newblock((double)staffsep, 0.0);
+  if (recording) {
+    fprintf(f, "%cD\n", RECORDMARK);
+    recfontsize = 0;
+  } else {
+    newblock((double)staffsep, 0.0);
+    psprintf(" %.1f %.1f M %.1f %.1f L\n", 
+               scaledwidth/4.0, -descend,
+               scaledwidth*3/4.0, -descend);
+    newblock((double)staffsep, 0.0);
+  };
 }
 
 static void resetvoice(struct tune* t, struct voice * v)
@@ -2715,8 +2981,7 @@ static void resetvoice(struct tune* t, struct voice * v)
     v->keysig = newkey(t->keysig->name, t->keysig->sharps, 
                        t->keysig->map, t->keysig->mult);
   } else {
-    free(v->keysig->name);
-    v->keysig->name = addstring(t->keysig->name);
+    v->keysig->name = tunestring(t->keysig->name);
     set_keysig(v->keysig, t->keysig);
     /* v->keysig->sharps = t->keysig->sharps; */
   };
@@ -2749,33 +3014,82 @@ void setup_fonts()
   staffsep = VERT_GAP;
 }
 
-void open_output_file(filename, boundingbox)
-char* filename;
-struct bbox* boundingbox;
-/* open output file and write the abc2ps library to it */
+static void openfile(char* filename, struct bbox* boundingbox)
+/* open output file. The PostScript goes to a temporary file until */
+/* closefile() knows which library routines to write in front of it */
 {
-  f = fopen(filename, "w");
-  if (f == NULL) {
+  psfile = fopen(filename, pdf_out ? "wb" : "w");
+  if (psfile == NULL) {
     printf("Could not open file!!\n");
     exit(0);
   };
-  printf("writing file %s\n", filename);
-  printlib(f, filename, boundingbox);
+  f = tmpfile();
+  if (f == NULL) {
+    printf("Could not create temporary file\n");
+    exit(1);
+  };
+  strncpy(psname, filename, sizeof(psname)-1);
+  psname[sizeof(psname)-1] = '\0';
+  psboxed = (boundingbox != NULL);
+  if (psboxed) {
+    psbox = *boundingbox;
+  };
   fontsize = 0;
   fontnum = 0;
   startpage();
 }
 
-void close_output_file()
+static void closefile()
 /* complete last page and close file */
 {
   if (f != NULL) {
     closepage();
+    if (pdf_out) {
+      printpdf(psfile, psname, psboxed ? &psbox : (struct bbox*)NULL, f);
+    } else {
+      if (psboxed) {
+        printlib(psfile, psname, &psbox, f);
+      } else {
+        printlib(psfile, psname, (struct bbox*)NULL, f);
+      };
+    };
     fclose(f);
+    fclose(psfile);
     f = NULL;
   };
 }
 
+void open_output_file(filename, boundingbox)
+char* filename;
+struct bbox* boundingbox;
+/* open output file and write the abc2ps library to it */
+{
+  if (recording) {
+    if (boundingbox == NULL) {
+      fprintf(f, "%cO 0 0 0 0 0 %s\n", RECORDMARK, filename);
+    } else {
+      fprintf(f, "%cO 1 %d %d %d %d %s\n", RECORDMARK, 
+                 boundingbox->llx, boundingbox->lly,
+                 boundingbox->urx, boundingbox->ury, filename);
+    };
+    recfontsize = 0;
+  } else {
+    openfile(filename, boundingbox);
+  };
+  printf("writing file %s\n", filename);
+}
+
+void close_output_file()
+/* complete last page and close file */
+{
+  if (recording) {
+    fprintf(f, "%cC\n", RECORDMARK);
+    recfontsize = 0;
+  } else {
+    closefile();
+  };
+}
+
 static int endrep(inend, end_string, x1, x2, yend)
 int inend;
 char* end_string;
@@ -2783,7 +3097,7 @@ double x1, x2, yend;
 /* draws either 1st or 2nd ending marker */
 {
   if (inend != 0) {
-    fprintf(f, "%.1f %.1f %.1f (%s) endy1\n", yend, x1, x2, end_string);
+    psprintf("%.1f %.1f %.1f (%s) endy1\n", yend, x1, x2, end_string);
   };
   return(0);
 }
@@ -2840,9 +3154,9 @@ static void drawslurtie(struct slurtie* s)
     };
   };
   if (n->stemup) {
-    fprintf(f, " %.1f %.1f %.1f %.1f slurdown\n", x0, y0, x1, y1); 
+    psprintf(" %.1f %.1f %.1f %.1f slurdown\n", x0, y0, x1, y1); 
   } else {
-    fprintf(f, " %.1f %.1f %.1f %.1f slurup\n", x0, y0, x1, y1); 
+    psprintf(" %.1f %.1f %.1f %.1f slurup\n", x0, y0, x1, y1); 
   };
 }
 
@@ -2882,9 +3196,9 @@ static void close_slurtie(struct slurtie* s)
   x0 = TREBLE_LEFT + TREBLE_RIGHT;
   y0 = y1;
   if (n->stemup) {
-    fprintf(f, " %.1f %.1f %.1f %.1f slurdown\n", x0, y0, x1, y1); 
+    psprintf(" %.1f %.1f %.1f %.1f slurdown\n", x0, y0, x1, y1); 
   } else {
-    fprintf(f, " %.1f %.1f %.1f %.1f slurup\n", x0, y0, x1, y1); 
+    psprintf(" %.1f %.1f %.1f %.1f slurup\n", x0, y0, x1, y1); 
   };
 }
 
@@ -2911,14 +3225,14 @@ static void printbarnumber(double x, int n)
 {
 if (barnums <0 ) return;
 if (x + 15.0 > scaledwidth) return;
-fprintf(f, " %.1f %.1f (%d) bnum\n", x, 28.0, n); 
+psprintf(" %.1f %.1f (%d) bnum\n", x, 28.0, n); 
 }
 
 static void underbar(struct feature* ft)
 /* This is never normally called, but is useful as a debugging routine */
 /* shows width of a graphical element */
 {
-  fprintf(f, " %.1f -10 moveto %.1f -10 lineto stroke\n", ft->x - ft->xleft,
+  psprintf(" %.1f -10 moveto %.1f -10 lineto stroke\n", ft->x - ft->xleft,
                                                        ft->x + ft->xright);
 }
 
@@ -2988,7 +3302,7 @@ static int printvoiceline(struct voice* v)
   if (spacing != NULL) {
     newblock(spacing->height, spacing->descender);
     staveline();
-    fprintf(f, "0 0 M 0 24 L\n");
+    psprintf("0 0 M 0 24 L\n");
   };
   x = 0.0;
   /* now draw the line */
@@ -2997,21 +3311,21 @@ static int printvoiceline(struct voice* v)
     /*  printf("type = %d\n", ft->type); */
     switch (ft->type) {
     case SINGLE_BAR: 
-      fprintf(f, "%.1f bar\n", ft->x);
+      psprintf("%.1f bar\n", ft->x);
       printbarnumber(ft->x, (int)ft->item);
       break;
     case DOUBLE_BAR: 
-      fprintf(f, "%.1f dbar\n", ft->x);
+      psprintf("%.1f dbar\n", ft->x);
       printbarnumber(ft->x, (int)ft->item);
       inend = endrep(inend, endstr, xend, ft->x, spacing->yend);
       break;
     case BAR_REP: 
-      fprintf(f, "%.1f fbar1 %.1f rdots\n", ft->x, ft->x+10);
+      psprintf("%.1f fbar1 %.1f rdots\n", ft->x, ft->x+10);
       printbarnumber(ft->x, (int)ft->item);
       inend = endrep(inend, endstr, xend, ft->x, spacing->yend);
       break;
     case REP_BAR: 
-      fprintf(f, "%.1f rdots %.1f fbar2\n", ft->x, ft->x+10);
+      psprintf("%.1f rdots %.1f fbar2\n", ft->x, ft->x+10);
       printbarnumber(ft->x, (int)ft->item);
       inend = endrep(inend, endstr, xend, ft->x, spacing->yend);
       break;
@@ -3034,7 +3348,7 @@ static int printvoiceline(struct voice* v)
       xend = ft->x + ft->xright;
       break;
     case BAR1: 
-      fprintf(f, "%.1f bar\n", ft->x);
+      psprintf("%.1f bar\n", ft->x);
       printbarnumber(ft->x, (int)ft->item);
       inend = endrep(inend, endstr, xend, ft->x - ft->xleft, spacing->yend);
       inend = 1;
@@ -3042,7 +3356,7 @@ static int printvoiceline(struct voice* v)
       xend = ft->x + ft->xright;
       break;
     case REP_BAR2: 
-      fprintf(f, "%.1f rdots %.1f fbar2\n", ft->x, ft->x+10);
+      psprintf("%.1f rdots %.1f fbar2\n", ft->x, ft->x+10);
       printbarnumber(ft->x, (int)ft->item);
       inend = endrep(inend, endstr, xend, ft->x - ft->xleft, spacing->yend);
       inend = 2;
@@ -3050,16 +3364,16 @@ static int printvoiceline(struct voice* v)
       xend = ft->x + ft->xright;
       break;
     case DOUBLE_REP: 
-      fprintf(f, "%.1f fbar1 %.1f rdots %.1f fbar2 %.1f rdots\n", 
+      psprintf("%.1f fbar1 %.1f rdots %.1f fbar2 %.1f rdots\n", 
               ft->x, ft->x+10, ft->x+2, ft->x-8);
       inend = endrep(inend, endstr, xend, ft->x, spacing->yend);
       break;
     case THICK_THIN: 
-      fprintf(f, "%.1f fbar1\n", ft->x);
+      psprintf("%.1f fbar1\n", ft->x);
       inend = endrep(inend, endstr, xend, ft->x, spacing->yend);
       break;
     case THIN_THICK: 
-      fprintf(f, "%.1f fbar2\n", ft->x);
+      psprintf("%.1f fbar2\n", ft->x);
       inend = endrep(inend, endstr, xend, ft->x, spacing->yend);
       break;
     case PART: 
@@ -3454,7 +3768,42 @@ struct tune* t;
   return(height);
 }
 
-void printtune(struct tune* t)
+static void fitpage(double height)
+/* start a new page if a tune of the given height will not fit on this one */
+{
+  if (recording) {
+    fprintf(f, "%cT %.17g\n", RECORDMARK, height);
+    recfontsize = 0;
+  } else {
+    if ((totlen > 0.0) && 
+        (totlen+descend+height > scaledlen-(double)(pagenumbering))) {
+      newpage();
+    };
+  };
+}
+
+static void voiceline(int firstvoice)
+/* join up the staves of a multi-voice tune after each line of music */
+{
+  double lastvline;
+
+  if (recording) {
+    fprintf(f, "%cV %d\n", RECORDMARK, firstvoice);
+  } else {
+    if (firstvoice) {
+      firstvline = totlen;
+    } else {
+      lastvline = totlen;
+      if (lastvline > firstvline) {
+        psprintf("0 24 M 0 %.1f L\n", 
+            lastvline - firstvline);
+      };
+      firstvline = totlen;
+    };
+  };
+}
+
+static void layouttune(struct tune* t)
 /* draws the PostScript for an entire abc tune */
 {
   int i;
@@ -3465,7 +3814,6 @@ void printtune(struct tune* t)
   int titleno;
   struct voice* thisvoice;
   int doneline;
-  double firstvline, lastvline;
   struct voice* firstvoice;
   char xtitle[200];
   struct bbox boundingbox;
@@ -3497,14 +3845,11 @@ void printtune(struct tune* t)
       boundingbox.urx = xmargin + pagewidth;
       boundingbox.ury = ymargin + pagelen;
     };
-    sprintf(outputname, "%s%d.eps", outputroot, t->no);
+    sprintf(outputname, "%s%d.%s", outputroot, t->no, pdf_out ? "pdf" : "eps");
     open_output_file(outputname, &boundingbox);
   } else {
     make_open();
-    if ((totlen > 0.0) && 
-        (totlen+descend+tuneheight(t) > scaledlen-(double)(pagenumbering))) {
-      newpage();
-    };
+    fitpage(tuneheight(t));
   };
   resettune(t);
   notesdone = 0;
@@ -3586,16 +3931,7 @@ void printtune(struct tune* t)
       doneline = 0;
       while (thisvoice != NULL) {
         doneline = (printvoiceline(thisvoice) || doneline);
-        if (thisvoice == firstvoice) {
-          firstvline = totlen;
-        } else {
-          lastvline = totlen;
-          if (lastvline > firstvline) {
-            fprintf(f, "0 24 M 0 %.1f L\n", 
-                lastvline - firstvline);
-          };
-          firstvline = totlen;
-        };
+        voiceline(thisvoice == firstvoice);
         thisvoice = nextitem(&t->voices);
       };
     };
@@ -3611,3 +3947,423 @@ void printtune(struct tune* t)
   };
 }
 
+#ifdef LAYOUTFORK
+/* the files one layout process writes its parts of the output to */
+struct layoutjob {
+  FILE* ps;      /* PostScript with markers */
+  FILE* text;    /* what was written to stdout */
+  pid_t pid;
+  char buf[8192]; /* for replay() */
+  int pos, len, done;
+};
+
+static struct layoutjob jobs[MAXLAYOUTJOBS];
+static int worker = -1;  /* job done by this process, -1 if none */
+static int partno = 0;   /* number of tunes printed so far */
+static FILE* discard;
+
+static FILE* newtemp()
+/* create a temporary file for the output of a layout process */
+{
+  FILE* tmp;
+
+  tmp = tmpfile();
+  if (tmp == NULL) {
+    printf("yaps: cannot create temporary file\n");
+    exit(1);
+  };
+  return(tmp);
+}
+
+static struct font* layoutfont(int n)
+/* find the font structure with special number n */
+{
+  static struct font* fonts[] = {
+    &textfont, &titlefont, &subtitlefont, &wordsfont,
+    &composerfont, &vocalfont, &gchordfont, &partsfont
+  };
+  int i;
+
+  for (i = 0; i < (int)(sizeof(fonts)/sizeof(fonts[0])); i++) {
+    if (fonts[i]->special_num == n) {
+      return(fonts[i]);
+    };
+  };
+  return(NULL);
+}
+
+static void replaymark(char* m)
+/* carry out a page or font change recorded by a layout process */
+{
+  int n, pos;
+  double x, y;
+  char* end;
+  struct font afont;
+  struct font* thefont;
+  struct bbox box;
+
+  switch (*m) {
+  case 'B':
+    x = strtod(m+1, &end);
+    y = strtod(end, NULL);
+    newblock(x, y);
+    break;
+  case 'P':
+    newpage();
+    break;
+  case 'T':
+    sscanf(m+1, "%lf", &x);
+    fitpage(x);
+    break;
+  case 'V':
+    sscanf(m+1, "%d", &n);
+    voiceline(n);
+    break;
+  case 'D':
+    voicedivider();
+    break;
+  case 'F':
+    n = (int)strtol(m+1, &end, 10);
+    setfont(n, (int)strtol(end, NULL, 10));
+    break;
+  case 'S':
+    pos = 0;
+    sscanf(m+1, "%d %d %d %n", &afont.pointsize, &afont.default_num,
+           &afont.special_num, &pos);
+    afont.space = 0;
+    afont.name = NULL;
+    if (strcmp(m+1+pos, "-") != 0) {
+      afont.name = m+1+pos;
+    };
+    /* whether the font is defined yet goes with the real structure */
+    /* so that replayed and directly written output agree about it  */
+    thefont = layoutfont(afont.special_num);
+    afont.defined = (thefont == NULL) ? 0 : thefont->defined;
+    setfontstruct(&afont);
+    if (thefont != NULL) {
+      thefont->defined = afont.defined;
+    };
+    break;
+  case 'R':
+    sscanf(m+1, "%d", &n);
+    thefont = layoutfont(n);
+    if (thefont != NULL) {
+      thefont->defined = 0;
+    };
+    break;
+  case 'O':
+    pos = 0;
+    sscanf(m+1, "%d %d %d %d %d %n", &n, &box.llx, &box.lly, 
+           &box.urx, &box.ury, &pos);
+    if (n) {
+      openfile(m+1+pos, &box);
+    } else {
+      openfile(m+1+pos, (struct bbox*)NULL);
+    };
+    break;
+  case 'C':
+    closefile();
+    break;
+  default:
+    break;
+  };
+}
+
+static int replay(struct layoutjob* job)
+/* copy the next part of a job's PostScript to f, acting on the markers */
+/* in it. Returns 0 if this was the last part.                          */
+{
+  char* mark;
+  char* eol;
+  int stop, n;
+
+  while (1) {
+    mark = memchr(job->buf+job->pos, RECORDMARK, job->len-job->pos);
+    eol = NULL;
+    if (mark != NULL) {
+      eol = memchr(mark, '\n', job->buf+job->len-mark);
+    };
+    if (eol != NULL) {
+      fwrite(job->buf+job->pos, 1, mark-(job->buf+job->pos), f);
+      job->pos = eol+1-job->buf;
+      if (mark[1] == 'N') {
+        return(1);
+      };
+      *eol = '\0';
+      replaymark(mark+1);
+    } else {
+      /* copy up to any incomplete marker and read some more */
+      if ((mark == NULL) || job->done) {
+        stop = job->len;
+      } else {
+        stop = mark-job->buf;
+      };
+      fwrite(job->buf+job->pos, 1, stop-job->pos, f);
+      job->len = job->len - stop;
+      memmove(job->buf, job->buf+stop, job->len);
+      job->pos = 0;
+      if (job->done) {
+        return(0);
+      };
+      n = fread(job->buf+job->len, 1, sizeof(job->buf)-job->len, job->ps);
+      if (n == 0) {
+        job->done = 1;
+      };
+      job->len = job->len + n;
+    };
+  };
+}
+
+static int copytext(FILE* text)
+/* copy the next part of what a job wrote to stdout */
+/* returns 0 if this was the last part */
+{
+  int c;
+
+  while ((c = getc(text)) != EOF) {
+    if (c == RECORDMARK) {
+      /* skip the rest of the marker line */
+      while ((c != EOF) && (c != '\n')) {
+        c = getc(text);
+      };
+      return(1);
+    };
+    putchar(c);
+  };
+  return(0);
+}
+
+static void copyfile(FILE* from, FILE* to, long n)
+/* copy n characters, or up to the end of the file if n < 0 */
+{
+  char buf[8192];
+  int len;
+
+  while (n != 0) {
+    len = sizeof(buf);
+    if ((n > 0) && (n < len)) {
+      len = (int)n;
+    };
+    len = fread(buf, 1, len, from);
+    if (len == 0) {
+      break;
+    };
+    fwrite(buf, 1, len, to);
+    if (n > 0) {
+      n = n - len;
+    };
+  };
+}
+
+static void savelayout(char* name, char* key, FILE* ps, FILE* text)
+/* write a newly made layout to the cache. It is written under a  */
+/* temporary name and renamed so that a cache file is either      */
+/* complete or absent, even with several processes writing to it. */
+{
+  static int warned = 0;
+  char tempname[300];
+  FILE* out;
+
+  sprintf(tempname, "%s/%s.%d", layoutcache, key, (int)getpid());
+  out = fopen(tempname, "wb");
+  if (out == NULL) {
+    if (!warned) {
+      printf("yaps: cannot write to layout cache %s\n", layoutcache);
+      warned = 1;
+    };
+    return;
+  };
+  fprintf(out, "yaps layout %ld\n", ftell(text));
+  rewind(text);
+  copyfile(text, out, -1L);
+  rewind(ps);
+  copyfile(ps, out, -1L);
+  if ((fclose(out) != 0) || (rename(tempname, name) != 0)) {
+    remove(tempname);
+  };
+}
+
+static void cachedtune(struct tune* t)
+/* With -C the output of layouttune() for each tune is kept in the  */
+/* cache directory, with what it wrote to stdout, in the same form */
+/* as the files written with -j. When a tune turns up again with   */
+/* the same text and settings, the layout is read back and only    */
+/* the page breaks and fonts are worked out again by replay().     */
+{
+  static struct layoutjob cachejob;
+  char settings[512];
+  char key[20];
+  char name[300];
+  FILE* block;
+  FILE* text;
+  FILE* out;
+  long textlen;
+  int oldstdout, wasrecording;
+
+  sprintf(settings, "%.17g %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %s\n",
+          scale, pagelen, pagewidth, xmargin, ymargin, landscape,
+          separate_voices, print_xref, pagenumbering, 
+          (barnums < 0) ? -1 : nnbars, titleleft, titlecaps, 
+          gchords_above, staffsep, debugging, eps_out, pdf_out, 
+          eps_out ? outputroot : "");
+  if ((layoutcache == NULL) || (strlen(layoutcache) > 256) ||
+      (tunekey(t, settings, key) == 0)) {
+    layouttune(t);
+    return;
+  };
+  if (!eps_out) {
+    make_open();
+  };
+  sprintf(name, "%s/%s.lay", layoutcache, key);
+  block = fopen(name, "rb");
+  if ((block != NULL) && (fscanf(block, "yaps layout %ld", &textlen) == 1) &&
+      (getc(block) == '\n')) {
+    /* found it */
+    copyfile(block, stdout, textlen);
+  } else {
+    if (block != NULL) {
+      fclose(block);
+    };
+    block = newtemp();
+    text = newtemp();
+    fflush(stdout);
+    oldstdout = dup(1);
+    dup2(fileno(text), 1);
+    out = f;
+    wasrecording = recording;
+    f = block;
+    recording = 1;
+    recfontsize = 0;
+    layouttune(t);
+    fflush(stdout);
+    dup2(oldstdout, 1);
+    close(oldstdout);
+    f = out;
+    recording = wasrecording;
+    savelayout(name, key, block, text);
+    rewind(text);
+    copyfile(text, stdout, -1L);
+    fclose(text);
+    rewind(block);
+  };
+  if (recording) {
+    /* a -j layout process; the main process will replay it */
+    copyfile(block, f, -1L);
+  } else {
+    cachejob.ps = block;
+    cachejob.pos = 0;
+    cachejob.len = 0;
+    cachejob.done = 0;
+    replay(&cachejob);
+  };
+  fclose(block);
+  recfontsize = 0;
+}
+
+static void selectpart()
+/* send the next part of the output to this job's files if it is */
+/* this process that lays the tune out and nowhere otherwise     */
+{
+  fflush(stdout);
+  if (partno % layoutjobs == worker) {
+    dup2(fileno(jobs[worker].text), 1);
+    f = jobs[worker].ps;
+  } else {
+    dup2(fileno(discard), 1);
+    f = discard;
+  };
+  recfontsize = 0;
+}
+
+void start_layout_jobs()
+/* With -j the file is parsed by layoutjobs processes, each of which */
+/* lays out every layoutjobs'th tune. The main process waits for    */
+/* them, copies their parts of the output into place in order and   */
+/* exits.                                                           */
+{
+  int k, status, more, exitcode;
+  pid_t pid;
+
+  if (layoutjobs < 2) {
+    return;
+  };
+  fflush(stdout);
+  for (k = 0; k < layoutjobs; k++) {
+    jobs[k].ps = newtemp();
+    jobs[k].text = newtemp();
+    pid = fork();
+    if (pid < 0) {
+      printf("yaps: cannot start process\n");
+      exit(1);
+    };
+    if (pid == 0) {
+      worker = k;
+      discard = fopen("/dev/null", "w");
+      if (discard == NULL) {
+        exit(1);
+      };
+      recording = 1;
+      selectpart();
+      return;
+    };
+    jobs[k].pid = pid;
+  };
+  exitcode = 0;
+  for (k = 0; k < layoutjobs; k++) {
+    if ((waitpid(jobs[k].pid, &status, 0) != jobs[k].pid) ||
+        !WIFEXITED(status)) {
+      printf("yaps: layout process failed\n");
+      exit(1);
+    };
+    if (WEXITSTATUS(status) != 0) {
+      exitcode = WEXITSTATUS(status);
+    };
+    rewind(jobs[k].ps);
+    rewind(jobs[k].text);
+    jobs[k].pos = 0;
+    jobs[k].len = 0;
+    jobs[k].done = 0;
+  };
+  f = NULL;
+  k = 0;
+  more = 1;
+  while (more) {
+    more = copytext(jobs[k].text);
+    more = replay(&jobs[k]) && more;
+    k = (k + 1) % layoutjobs;
+  };
+  fflush(stdout);
+  exit(exitcode);
+}
+
+void printtune(struct tune* t)
+/* draws the PostScript for an entire abc tune */
+{
+  if (worker == -1) {
+    cachedtune(t);
+  } else {
+    if (partno % layoutjobs == worker) {
+      cachedtune(t);
+      fprintf(f, "%cN\n", RECORDMARK);
+      printf("%cN\n", RECORDMARK);
+    } else {
+      /* keep track of the output file being opened */
+      if (!eps_out) {
+        make_open();
+      };
+    };
+    partno = partno + 1;
+    selectpart();
+  };
+}
+#else
+void start_layout_jobs()
+{
+}
+
+void printtune(struct tune* t)
+/* draws the PostScript for an entire abc tune */
+{
+  layouttune(t);
+}
+#endif
@@ -4,6 +4,14 @@
 /* for Microsoft Visual C++ version 6.0 or higher */
 
 extern int eps_out;
+/* -pdf, write PDF instead of PostScript */
+extern int pdf_out;
+extern int pdf_compress;
+/* -j, number of tunes laid out at once */
+#define MAXLAYOUTJOBS 64
+extern int layoutjobs;
+/* -C, directory to keep the layout of each tune in */
+extern char* layoutcache;
 /* bounding box for encapsulated PostScript */
 struct bbox {
   int llx, lly, urx, ury;
@@ -17,6 +25,7 @@ extern void newpage(void);
 extern void centretext(char* s);
 extern void lefttext(char* s);
 extern void vskip(double gap);
+extern void start_layout_jobs(void);
 #else
 extern void setmargins();
 extern void setpagesize();
@@ -26,4 +35,5 @@ extern void newpage();
 extern void centretext();
 extern void lefttext();
 extern void vskip();
+extern void start_layout_jobs();
 #endif
@@ -51,9 +51,9 @@ abcmatch.exe : abcmatch.o matchsup.o parseabc.o
 
 
 
-yaps.exe : parseabc.o yapstree.o drawtune.o debug.o pslib.o position.o parser2.o
+yaps.exe : parseabc.o yapstree.o drawtune.o debug.o pslib.o pdflib.o position.o parser2.o
 	$(LNK) -o yaps.exe parseabc.o yapstree.o drawtune.o debug.o \
-	position.o pslib.o parser2.o
+	position.o pslib.o pdflib.o parser2.o -lm
 
 # common parser object code
 #
@@ -111,6 +111,9 @@ drawtune.o: drawtune.c structs.h sizes.h abc.h drawtune.h
 pslib.o: pslib.c drawtune.h
 	$(CC) $(CFLAGS) pslib.c
 
+pdflib.o: pdflib.c drawtune.h
+	$(CC) $(CFLAGS) pdflib.c
+
 position.o: position.c abc.h structs.h sizes.h
 	$(CC) $(CFLAGS) position.c
 
@@ -45,8 +45,8 @@ mftext.exe : midifile.obj mftext.obj crack.obj
 midicopy.exe : midicopy.obj
 	$(LNK) $(LDFLAGS) midicopy.exe $(LDFLAGS2) FILE midicopy.obj
 
-yaps.exe : parseabc.obj yapstree.obj drawtune.obj debug.obj pslib.obj position.obj parser2.obj
-	$(LNK) $(LDFLAGS) yaps.exe $(LDFLAGS2) FILE parseabc.obj FILE yapstree.obj FILE drawtune.obj FILE debug.obj FILE position.obj FILE pslib.obj FILE parser2.obj 
+yaps.exe : parseabc.obj yapstree.obj drawtune.obj debug.obj pslib.obj pdflib.obj position.obj parser2.obj
+	$(LNK) $(LDFLAGS) yaps.exe $(LDFLAGS2) FILE parseabc.obj FILE yapstree.obj FILE drawtune.obj FILE debug.obj FILE position.obj FILE pslib.obj FILE pdflib.obj FILE parser2.obj 
 
 
 abcmatch.exe : abcmatch.obj matchsup.obj parseabc.obj
@@ -101,6 +101,9 @@ drawtune.obj: drawtune.c structs.h sizes.h abc.h drawtune.h
 pslib.obj: pslib.c drawtune.h
 	$(CC) $(CFLAGS) pslib.c
 
+pdflib.obj: pdflib.c drawtune.h
+	$(CC) $(CFLAGS) pdflib.c
+
 position.obj: position.c abc.h structs.h sizes.h
 	$(CC) $(CFLAGS) position.c
 
@@ -58,9 +58,9 @@ midi2abc : midifile.o midi2abc.o
 mftext : midifile.o mftext.o crack.o
 	$(LNK) midifile.o mftext.o crack.o -o mftext
 
-yaps : parseabc.o yapstree.o drawtune.o debug.o pslib.o position.o parser2.o
+yaps : parseabc.o yapstree.o drawtune.o debug.o pslib.o pdflib.o position.o parser2.o
 	$(LNK) -o yaps parseabc.o yapstree.o drawtune.o debug.o \
-	position.o pslib.o parser2.o -o yaps
+	position.o pslib.o pdflib.o parser2.o -o yaps -lm
 
 midicopy : midicopy.o
 	$(LNK) -o midicopy midicopy.o
@@ -104,6 +104,8 @@ drawtune.o: drawtune.c structs.h sizes.h abc.h drawtune.h
 
 pslib.o: pslib.c drawtune.h
 
+pdflib.o: pdflib.c drawtune.h
+
 position.o: position.c abc.h structs.h sizes.h
 
 debug.o: debug.c structs.h abc.h
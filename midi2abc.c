@@ -46,7 +46,7 @@
  * based on public domain 'midifilelib' package.
  */
 
-#define VERSION "2.99 October 18 2015"
+#define VERSION "3.00 October 18 2026"
 #define SPLITCODE
 
 /* Microsoft Visual C++ Version 6.0 or higher */
@@ -73,6 +73,14 @@ extern char* malloc();
 extern char* strchr();
 #endif
 #include "midifile.h"
+/* batch mode runs each conversion in a child process */
+#if !defined(_WIN32) && !defined(__MSDOS__)
+#define BATCHFORK
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+#include <unistd.h>
+#endif
 #define BUFFSIZE 200
 /* declare MIDDLE C */
 #define MIDDLE 72
@@ -80,7 +88,7 @@ void initfuncs();
 void setupkey(int);
 int testtrack(int trackno, int barbeats, int anacrusis);
 int open_note(int chan, int pitch, int vol);
-int close_note(int chan, int pitch, int *initvol);
+long close_note(int chan, int pitch, int *initvol);
 
 
 /* Global variables and structures */
@@ -143,6 +151,8 @@ int last_asig, last_ksig; /* last time signature printed        */
 int barsize; /* barsize in parts_per_unitlen units                   */
 int Qval;        /* tempo - quarter notes per minute            */
 int verbosity=0; /* control amount of detail messages in abcfile*/
+int batchmode=0; /* flag - convert several files, one .abc for each */
+int batchjobs=1; /* number of files converted at the same time  */
 
 /* global arguments dependent on command line options or computed */
 
@@ -198,8 +208,9 @@ struct atrack {
   int drumtrack;
 };
 
-/* can cope with up to 64 track MIDI files */
-struct atrack track[64];
+/* track array is sized from the MIDI header and grown if needed */
+struct atrack* track = NULL;
+int maxtracks = 0;  /* number of entries allocated in track[] */
 int trackcount = 0;
 int maxbarcount = 0;
 /* maxbarcount  is used to return the numbers of bars created.*/
@@ -211,13 +222,17 @@ struct dlistx {
   struct dlistx* next;
   struct dlistx* last;
   struct anote* note;
+  long end;   /* chordclock value when the note finishes */
 };
 
-int notechan[2048],notechanvol[2048]; /*for linking on and off midi
-					channel commands            */
+/* for linking on and off midi channel commands */
+#define NOTECHANSIZE (16*128)
+long* notechan = NULL;
+int* notechanvol = NULL;
 int last_tick; /* for getting last pulse number in MIDI file */
 
 char *title = NULL; /* for pasting title from argv[] */
+char *midifilename = NULL; /* name of MIDI file being converted */
 char *origin = NULL; /* for adding O: info from argv[] */
 
 
@@ -292,6 +307,24 @@ char* s;
   return(p);
 }
 
+void growtracks(n)
+/* make sure track[] has room for at least n tracks */
+int n;
+{
+  int newmax;
+
+  if (n <= maxtracks) return;
+  newmax = 2*maxtracks;
+  if (newmax < n) newmax = n;
+  track = (struct atrack*) realloc(track, newmax*sizeof(struct atrack));
+  if (track == NULL) {
+    fatal_error("Out of memory error - cannot malloc!");
+  };
+  memset(track + maxtracks, 0, (newmax - maxtracks)*sizeof(struct atrack));
+  maxtracks = newmax;
+}
+
+
 void addtext(s, type)
 /* add structure for text */
 /* used when parsing MIDI file */
@@ -462,6 +495,7 @@ int xformat, ntrks, ldivision;
 {
     division = ldivision; 
     format = xformat;
+    growtracks(ntrks);
     if (format != 0) {
     /*  fprintf(outhandle,"%% format %d file %d tracks\n", format, ntrks);*/
       if(summary>0) printf("This midi file has %d tracks\n\n",ntrks);
@@ -481,6 +515,7 @@ int xformat, ntrks, ldivision;
 void txt_trackstart()
 {
   laston = 0L;
+  growtracks(trackno+1);
   track[trackno].notes = 0;
   track[trackno].head = NULL;
   track[trackno].tail = NULL;
@@ -496,6 +531,7 @@ void txt_trackend()
   if (playinghead != NULL) {
     printf("Error in MIDI file - notes still on at end of track!\n");
   };
+  growtracks(trackno+1);
   track[trackno].tracklen = Mf_currtime - track[trackno].tracklen;
   trackno = trackno + 1;
   trackcount = trackcount + 1;
@@ -754,7 +790,7 @@ int leng;
 void print_txt_noteon(chan, pitch, vol)
 int chan, pitch, vol;
 {
-int start_time;
+long start_time;
 int initvol;
 if (vol > 0)
 open_note(chan, pitch, vol);
@@ -766,7 +802,7 @@ else {
        (double) Mf_currtime/(double) division,
        trackno+1, chan +1, pitch,initvol);
      */
-       printf("%d %ld %d %d %d %d\n",
+       printf("%ld %ld %d %d %d %d\n",
        start_time, Mf_currtime, trackno+1, chan +1, pitch,initvol);
 
       if(Mf_currtime > last_tick) last_tick = Mf_currtime;
@@ -778,7 +814,8 @@ else {
 void print_txt_noteoff(chan, pitch, vol)
 int chan, pitch, vol;
 {
-int start_time,initvol;
+long start_time;
+int initvol;
 
 start_time = close_note(chan, pitch, &initvol);
 if (start_time >= 0)
@@ -788,7 +825,7 @@ if (start_time >= 0)
      (double) Mf_currtime/(double) division,
      trackno+1, chan+1, pitch,initvol);
 */
-     printf("%d %ld %d %d %d %d\n",
+     printf("%ld %ld %d %d %d %d\n",
        start_time, Mf_currtime, trackno+1, chan +1, pitch,initvol);
     if(Mf_currtime > last_tick) last_tick = Mf_currtime;
 }
@@ -800,14 +837,18 @@ if (start_time >= 0)
  * the notechan array. When a midi pitch (0-127) is switched
  * on for a particular channel, we record the time that it
  * was turned on in the notechan array. As there are 16 channels
- * and 128 pitches, we initialize an array 128*16 = 2048 elements
- * long.
+ * and 128 pitches, we allocate an array of 128*16 = 2048 elements.
+ * Times are kept as long so that long files do not overflow.
 **/
 void init_notechan()
 {
 /* signal that there are no active notes */
  int i;
- for (i = 0; i < 2048; i++) notechan[i] = -1;
+ if (notechan == NULL) {
+   notechan = (long*) checkmalloc(NOTECHANSIZE*sizeof(long));
+   notechanvol = checkmalloc(NOTECHANSIZE*sizeof(int));
+   }
+ for (i = 0; i < NOTECHANSIZE; i++) notechan[i] = -1;
 }
 
 
@@ -823,9 +864,10 @@ int open_note(int chan, int pitch, int vol)
 }
 
 
-int close_note(int chan, int pitch, int *initvol)
+long close_note(int chan, int pitch, int *initvol)
 {
-    int index, start_tick;
+    int index;
+    long start_tick;
     index = 128 * chan + pitch;
     if (notechan[index] < 0)
 	return -1;
@@ -1464,13 +1506,12 @@ int guessana(barbeats)
 int barbeats;
 /* try to guess length of anacrusis */
 {
-  int score[64];
+  int* score;
   int min, minplace;
   int i,j;
 
-  if (barbeats > 64) {
-    fatal_error("Bar size exceeds static limit of 64 units!");
-  };
+  if (barbeats < 1) return(0);
+  score = checkmalloc(barbeats*sizeof(int));
   for (j=0; j<barbeats; j++) {
     score[j] = 0;
     for (i=0; i<trackcount; i++) {
@@ -1487,6 +1528,7 @@ int barbeats;
       minplace = i;
     };
   };
+  free(score);
   return(minplace);
 }
 
@@ -1599,8 +1641,30 @@ int maintrack;
 
 /* head and tail of list of notes in current chord playing */
 /* used while abc is being generated */
+/* The list is ordered by pitch for printing. The same notes are   */
+/* also kept in a binary heap ordered by the time they finish, so  */
+/* that the next note to end is found without scanning the chord. */
+/* Rather than shortening every note on each step, chordclock      */
+/* counts the units advanced and a note has (end - chordclock)     */
+/* units left to play. note->playnum is brought up to date when    */
+/* the note leaves the chord or by syncchord().                    */
 struct dlistx* chordhead;
 struct dlistx* chordtail;
+struct dlistx** chordheap = NULL;
+int chordheapsize = 0;
+int chordheapmax = 0;
+long chordclock = 0;
+
+/* saved chord state, used when switching between split numbers */
+struct chordstate {
+  struct dlistx* head;
+  struct dlistx* tail;
+  struct dlistx** heap;
+  int heapsize;
+  int heapmax;
+  long clock;
+};
+struct chordstate splitchord[10]; /* chord state for splitnum */
 
 
 void printchordlist()
@@ -1611,7 +1675,7 @@ void printchordlist()
   i = chordhead;
   printf("----CHORD LIST------\n");
   while(i != NULL) {
-    printf("pitch %d len %d\n", i->note->pitch, i->note->playnum);
+    printf("pitch %d len %ld\n", i->note->pitch, i->end - chordclock);
     if (i->next == i) {
       fatal_error("Loopback problem!");
     };
@@ -1656,6 +1720,120 @@ void checkchordlist()
   /* checkchordlist(); */
 }
 
+void clearchord()
+/* start with an empty chord */
+{
+  chordhead = NULL;
+  chordtail = NULL;
+  chordheapsize = 0;
+  chordclock = 0;
+}
+
+void syncchord()
+/* update playnum for every note in the chord */
+{
+  struct dlistx* i;
+
+  i = chordhead;
+  while (i != NULL) {
+    i->note->playnum = (int) (i->end - chordclock);
+    i = i->next;
+  };
+}
+
+void savechord(c)
+/* copy the current chord state to c */
+struct chordstate* c;
+{
+  syncchord();
+  c->head = chordhead;
+  c->tail = chordtail;
+  c->heap = chordheap;
+  c->heapsize = chordheapsize;
+  c->heapmax = chordheapmax;
+  c->clock = chordclock;
+}
+
+void restorechord(c)
+/* make c the current chord state */
+struct chordstate* c;
+{
+  chordhead = c->head;
+  chordtail = c->tail;
+  chordheap = c->heap;
+  chordheapsize = c->heapsize;
+  chordheapmax = c->heapmax;
+  chordclock = c->clock;
+}
+
+void initsplitchords()
+/* give every split number its own empty chord */
+{
+  int j;
+
+  for (j=0;j<10;j++) {
+    if ((splitchord[j].heap != NULL) && (splitchord[j].heap != chordheap)) {
+      free(splitchord[j].heap);
+    };
+  };
+  if (chordheap != NULL) free(chordheap);
+  chordheap = NULL;
+  chordheapmax = 0;
+  clearchord();
+  for (j=0;j<10;j++) {
+    savechord(&splitchord[j]);
+  };
+}
+
+void pushchordheap(x)
+/* add note to the heap of notes ordered by end time */
+struct dlistx* x;
+{
+  int k, parent;
+
+  if (chordheapsize >= chordheapmax) {
+    chordheapmax = (chordheapmax == 0) ? 32 : 2*chordheapmax;
+    chordheap = (struct dlistx**) realloc(chordheap,
+                      chordheapmax*sizeof(struct dlistx*));
+    if (chordheap == NULL) {
+      fatal_error("Out of memory error - cannot malloc!");
+    };
+  };
+  k = chordheapsize;
+  chordheapsize = chordheapsize + 1;
+  while (k > 0) {
+    parent = (k-1)/2;
+    if (chordheap[parent]->end <= x->end) break;
+    chordheap[k] = chordheap[parent];
+    k = parent;
+  };
+  chordheap[k] = x;
+}
+
+struct dlistx* popchordheap()
+/* remove and return the note which ends first */
+{
+  struct dlistx* top;
+  struct dlistx* x;
+  int k, child;
+
+  top = chordheap[0];
+  chordheapsize = chordheapsize - 1;
+  x = chordheap[chordheapsize];
+  k = 0;
+  while ((child = 2*k+1) < chordheapsize) {
+    if ((child+1 < chordheapsize) &&
+        (chordheap[child+1]->end < chordheap[child]->end)) {
+      child = child + 1;
+    };
+    if (x->end <= chordheap[child]->end) break;
+    chordheap[k] = chordheap[child];
+    k = child;
+  };
+  if (chordheapsize > 0) chordheap[k] = x;
+  return(top);
+}
+
 void addtochord(p)
 /* used when printing out abc */
 struct anote* p;
@@ -1667,11 +1845,12 @@ struct anote* p;
   newx->note = p;
   newx->next = NULL;
   newx->last = NULL;
+  newx->end = chordclock + p->playnum;
+  pushchordheap(newx);
 
   if (chordhead == NULL) {
     chordhead = newx;
     chordtail = newx;
-    checkchordlist();
     return;
   };
   place = chordhead;
@@ -1682,25 +1861,23 @@ struct anote* p;
     newx->next = chordhead;
     chordhead->last = newx;
     chordhead = newx;
-    checkchordlist();
     return;
   };
   if (place == NULL) {
     newx->last = chordtail;
     chordtail->next = newx;
     chordtail = newx;
-    checkchordlist();
     return;
   };
   newx->next = place;
   newx->last = place->last;
   place->last = newx;
   newx->last->next = newx;
-  checkchordlist();
 }
 
 struct dlistx* removefromchord(i)
 /* used when printing out abc */
+/* the caller has already taken i off the heap */
 struct dlistx* i;
 {
   struct dlistx* newi;
@@ -1720,7 +1897,6 @@ struct dlistx* i;
   };
   newi = i->next;
   free(i);
-  checkchordlist();
   return(newi);
 }
 
@@ -1728,19 +1904,15 @@ int findshortest(gap)
 /* find the first note in the chord to terminate */
 int gap;
 {
-  int min, v;
-  struct dlistx* p;
+  long v;
 
-  p = chordhead;
-  min = gap;
-  while (p != NULL) {
-    v = p->note->playnum;
-    if (v < min) {
-      min = v;
+  if (chordheapsize > 0) {
+    v = chordheap[0]->end - chordclock;
+    if (v < gap) {
+      return((int) v);
     };
-    p = p->next;
   };
-  return(min);
+  return(gap);
 }
 
 void advancechord(len)
@@ -1748,22 +1920,18 @@ void advancechord(len)
 int len;
 {
   struct dlistx* p;
-
-  p = chordhead;
-  while (p != NULL) {
-    if (p->note->playnum <= len) {
-      if (p->note->playnum < len) {
-        fatal_error("Error - note too short!");
-      };
-      /* remove note */
-      checkchordlist();
-      p = removefromchord(p);
-    } 
-    else {
-      /* shorten note */
-      p->note->playnum = p->note->playnum - len;
-      p = p->next;
+  long start;
+
+  start = chordclock;
+  chordclock = chordclock + len;
+  while ((chordheapsize > 0) && (chordheap[0]->end <= chordclock)) {
+    p = popchordheap();
+    if (p->end < chordclock) {
+      fatal_error("Error - note too short!");
     };
+    /* remove note, leaving playnum as it was before this step */
+    p->note->playnum = (int) (p->end - start);
+    removefromchord(p);
   };
 }
 
@@ -1818,8 +1986,7 @@ int trackno, barbeats, anacrusis;
   int breakcount;
 
   breakcount = 0;
-  chordhead = NULL;
-  chordtail = NULL;
+  clearchord();
   i = track[trackno].head;
   gap = 0;
   if (anacrusis > 0) {
@@ -1964,7 +2131,7 @@ int len;
       printpitch(i->note);
       printfract(len, parts_per_unitlen);
       midline = 1;
-      if (len < i->note->playnum) {
+      if (len < i->end - chordclock) {
         fprintf(outhandle,"-");
       };
     } 
@@ -1973,7 +2140,7 @@ int len;
       while (i != NULL) {
         printpitch(i->note);
         printfract(len, parts_per_unitlen);
-        if (len < i->note->playnum) {
+        if (len < i->end - chordclock) {
           fprintf(outhandle,"-");
         };
       if (nogr && i->next != NULL) fprintf(outhandle," ");
@@ -2200,8 +2367,6 @@ int endposnum; /* posnum at last note in linked list */
 struct anote* prevnote[10]; /*previous note in linked list */
 struct listx*  last_i[10];  /*note after finishing processing bar*/
 int existingsplits[10]; /* existing splits in active bar */
-struct dlistx* splitchordhead[10]; /* chordhead list for splitnum */
-struct dlistx* splitchordtail[10]; /* chordtail list for splitnum */
 int splitgap[10]; /* gap to next note at end of split measure */
 
 void label_split(struct anote *note, int activesplit)
@@ -2372,7 +2537,6 @@ int trackno,  anacrusis;
   int featurecount;
   int last_barsize,barnotes_correction;
   int splitnum = 0;
-  int j;
   int nlines;
   int done;
 
@@ -2384,10 +2548,7 @@ int trackno,  anacrusis;
   inkaraoke = 0;
   now = 0L;
   broken = ' ';
-  for (j=0;j<10;j++) {
-      splitchordhead[j] = NULL;
-      splitchordtail[j] = NULL;
-      }
+  initsplitchords();
   i = track[trackno].head;
   textplace = track[trackno].texthead;
   textplace0 = track[0].texthead;
@@ -2408,8 +2569,7 @@ int trackno,  anacrusis;
   active_keysig = header_keysig;
   handletext(now, &textplace, trackno);
   splitnum = 0;
-  chordhead = splitchordhead[splitnum]; 
-  chordtail = splitchordtail[splitnum]; 
+  restorechord(&splitchord[splitnum]);
   gap = splitgap[splitnum];
 
   while((i != NULL)||(gap != 0)) {
@@ -2469,12 +2629,13 @@ int trackno,  anacrusis;
         if (nlines > 5000) {
             printf("\nProbably infinite loop: aborting\n");
             fprintf(outhandle,"\n\nProbably infinite loop: aborting\n");
+            /* keep the heap, which may have moved, with its split */
+            savechord(&splitchord[splitnum]);
             return;
             }
 /* save state for the last splitnum before going to the next */
         last_i[splitnum] = i;
-        splitchordhead[splitnum] = chordhead;
-        splitchordtail[splitnum] = chordtail;
+        savechord(&splitchord[splitnum]);
         splitgap[splitnum] = gap;
 
 /*     look for the next splitnum which contains notes in
@@ -2502,8 +2663,7 @@ int trackno,  anacrusis;
            done = 1;
            }
 /* restore state for the next splitnum */
-       chordhead = splitchordhead[splitnum];
-       chordtail = splitchordtail[splitnum];
+       restorechord(&splitchord[splitnum]);
        checkchordlist();
        gap = splitgap[splitnum];
        i = last_i[splitnum];
@@ -2548,13 +2708,11 @@ int trackno,  anacrusis;
    if (i == NULL) /* end of track before end of measure ? */
     {
      last_i[splitnum] = i;
-     splitchordhead[splitnum] = chordhead;
-     splitchordtail[splitnum] = chordtail;
+     savechord(&splitchord[splitnum]);
      splitgap[splitnum] = gap;
      splitnum = nextsplitnum(splitnum);
      if (splitnum == -1) break;
-     chordhead = splitchordhead[splitnum];
-     chordtail = splitchordtail[splitnum];
+     restorechord(&splitchord[splitnum]);
      gap = splitgap[splitnum];
      i = last_i[splitnum];
      if (barnotes != barsize) fprintf(outhandle, " & ");
@@ -2599,8 +2757,7 @@ int trackno,  anacrusis;
   inkaraoke = 0;
   now = 0L;
   broken = ' ';
-  chordhead = NULL;
-  chordtail = NULL;
+  clearchord();
   i = track[trackno].head;
   textplace = track[trackno].texthead;
   textplace0 = track[0].texthead;
@@ -2714,6 +2871,7 @@ int trackno,  anacrusis;
     };
   if (i == NULL && gap == 0) 
     {
+    syncchord(); /* notes left over are seen again from the head */
     i = track[trackno].head;
     splitnum = nextsplitnum(splitnum);
     lastnote_in_split = 0;
@@ -2762,8 +2920,7 @@ int trackno,  anacrusis;
   inkaraoke = 0;
   now = 0L;
   broken = ' ';
-  chordhead = NULL;
-  chordtail = NULL;
+  clearchord();
   i = track[trackno].head;
   textplace = track[trackno].texthead;
   textplace0 = track[0].texthead;
@@ -3263,8 +3420,27 @@ int argc;
 
   if(guessk) ksig_set=1;
 
+  arg = getarg("-j",argc,argv);
+  if ((arg != -1) && (arg < argc)) {
+    batchjobs = readnum(argv[arg]);
+    if (batchjobs < 1) batchjobs = 1;
+    batchmode = 1;
+  };
+  if (getarg("-batch",argc,argv) != -1) batchmode = 1;
+  if (getarg("-list",argc,argv) != -1) batchmode = 1;
+
   arg = getarg("-o",argc,argv);
-  if ((arg != -1) && (arg < argc))  {
+  /* batch mode only writes abc files, named after the input files */
+  if (batchmode && (arg != -1)) {
+    fatal_error("-o cannot be used with -batch, -list or -j");
+  };
+  if (batchmode && (midiprint != 0)) {
+    fatal_error("-midigram and -mftext cannot be used with -batch, -list or -j");
+  };
+  if (batchmode) {
+    outhandle = stdout; /* each file gets its own .abc in batch mode */
+  }
+  else if ((arg != -1) && (arg < argc))  {
     outhandle = efopen(argv[arg],"w");  /* open output abc file */
   } 
   else {
@@ -3293,6 +3469,8 @@ int argc;
        }
   
 
+  if (batchmode) return -1;
+
   arg = getarg("-f", argc, argv);
   if (arg == -1) {
     arg = huntfilename(argc, argv);
@@ -3300,6 +3478,7 @@ int argc;
 
   if ((arg != -1) && (arg < argc)) {
     F = efopen(argv[arg],"rb");
+    midifilename = argv[arg];
 /*    fprintf(outhandle,"%% input file %s\n", argv[arg]); */
   }
   else {
@@ -3338,6 +3517,10 @@ int argc;
     printf("         -origin <string> Adds O: field containing string\n");
     printf("         -midigram   Prints midigram instead of abc file\n");
     printf("         -mftext mftext output\n"); 
+    printf("         -batch  Convert every input file to its own .abc file\n");
+    printf("         -list <file> Read batch input file names from file\n");
+    printf("         -j <number> of files converted at the same time\n");
+    printf("           -o, -midigram and -mftext cannot be used in batch mode\n");
     printf("         -ver version number\n");
     printf(" None or only one of the options -gu, -b, -Q -u should\n");
     printf(" be specified. If none are present, midi2abc will uses the\n");
@@ -3360,12 +3543,9 @@ int arg;
 int voiceno;
 int accidentals; /* used for printing summary */
 int j;
-int argc;
 
 /* initialization */
   trackno = 0;
-  track[trackno].texthead = NULL;
-  track[trackno].texttail = NULL;
   initfuncs();
   playinghead = NULL;
   playingtail = NULL;
@@ -3379,10 +3559,10 @@ int argc;
 
 /* count MIDI tracks with notes */
   maintrack = 0;
-  while ((track[maintrack].notes == 0) && (maintrack < trackcount)) {
+  while ((maintrack < trackcount) && (track[maintrack].notes == 0)) {
     maintrack = maintrack + 1;
   };
-  if (track[maintrack].notes == 0) {
+  if (maintrack >= trackcount) {
     fatal_error("MIDI file has no notes!");
   };
 
@@ -3398,13 +3578,12 @@ int argc;
   };
 
 /* print abc header block */
-  argc = huntfilename(arg, argv);
   fprintf(outhandle,"X: 1\n"); 
 
   if (title != NULL) 
   fprintf(outhandle,"T: %s\n",title);
   else
-  fprintf(outhandle,"T: from %s\n",argv[argc]); 
+  fprintf(outhandle,"T: from %s\n",midifilename); 
 
   if (origin != NULL)
   fprintf(outhandle,"O: %s\n",origin);
@@ -3561,6 +3740,202 @@ mfread();
 }
 
 
+/* Batch mode. Every input file is converted in its own child
+ * process so that the global state used by the parser and by
+ * printtrack starts fresh for each file. Up to batchjobs children
+ * run at the same time. The abc output is written next to the
+ * input file with the extension replaced by .abc.
+ */
+
+/* options which are followed by an argument */
+static char *argoptions[] = {
+  "-a", "-m", "-b", "-Q", "-k", "-c", "-o", "-u", "-f", "-ppu",
+  "-aul", "-bps", "-bpl", "-sr", "-title", "-origin", "-j", "-list",
+  NULL
+};
+
+int takesargument(option)
+char *option;
+{
+  int i;
+
+  for (i=0; argoptions[i] != NULL; i++) {
+    if (strcmp(option, argoptions[i]) == 0) return 1;
+  };
+  return 0;
+}
+
+char** batchfiles = NULL;
+int nbatchfiles = 0;
+int maxbatchfiles = 0;
+
+void addbatchfile(name)
+char *name;
+{
+  if (nbatchfiles >= maxbatchfiles) {
+    maxbatchfiles = (maxbatchfiles == 0) ? 64 : 2*maxbatchfiles;
+    batchfiles = (char**) realloc(batchfiles, maxbatchfiles*sizeof(char*));
+    if (batchfiles == NULL) {
+      fatal_error("Out of memory error - cannot malloc!");
+    };
+  };
+  batchfiles[nbatchfiles] = addstring(name);
+  nbatchfiles = nbatchfiles + 1;
+}
+
+void collectbatchfiles(argc, argv)
+/* input files are all arguments which are not options or option */
+/* values, followed by the names listed in the -list file        */
+char *argv[];
+int argc;
+{
+  int j;
+  int arg;
+  FILE *listfile;
+  char line[1024];
+  char *p;
+
+  j = 1;
+  while (j < argc) {
+    if (*argv[j] == '-') {
+      if ((strcmp(argv[j], "-f") == 0) && (j+1 < argc)) {
+        addbatchfile(argv[j+1]);
+      };
+      if (takesargument(argv[j])) j = j + 1;
+    }
+    else {
+      addbatchfile(argv[j]);
+    };
+    j = j + 1;
+  };
+  arg = getarg("-list", argc, argv);
+  if ((arg != -1) && (arg < argc)) {
+    listfile = efopen(argv[arg], "r");
+    while (fgets(line, sizeof(line), listfile) != NULL) {
+      p = line + strlen(line);
+      while ((p > line) && isspace(*(p-1))) p--;
+      *p = '\0';
+      if (*line != '\0') addbatchfile(line);
+    };
+    fclose(listfile);
+  };
+}
+
+char* batchoutname(name)
+/* name of the abc file produced from MIDI file name */
+char *name;
+{
+  char *out;
+  char *dot;
+  char *slash;
+
+  out = (char*) checkmalloc(strlen(name) + 5);
+  strcpy(out, name);
+  dot = strrchr(out, '.');
+  slash = strrchr(out, '/');
+  if ((dot != NULL) && (slash == NULL || dot > slash)) *dot = '\0';
+  strcat(out, ".abc");
+  return(out);
+}
+
+#ifdef BATCHFORK
+double secondssince(t0)
+struct timeval *t0;
+{
+  struct timeval t1;
+
+  gettimeofday(&t1, NULL);
+  return (double) (t1.tv_sec - t0->tv_sec) +
+         (double) (t1.tv_usec - t0->tv_usec)/1000000.0;
+}
+
+int batchconvert(argc, argv)
+char *argv[];
+int argc;
+{
+  pid_t *pids;
+  struct timeval *starts;
+  struct timeval t0;
+  char **outnames;
+  pid_t pid;
+  int status;
+  int next, running, k;
+  int nfailed;
+
+  collectbatchfiles(argc, argv);
+  if (nbatchfiles == 0) {
+    fatal_error("No input files for batch mode!");
+  };
+  pids = (pid_t*) checkmalloc(nbatchfiles*sizeof(pid_t));
+  starts = (struct timeval*) checkmalloc(nbatchfiles*sizeof(struct timeval));
+  outnames = (char**) checkmalloc(nbatchfiles*sizeof(char*));
+  gettimeofday(&t0, NULL);
+  next = 0;
+  running = 0;
+  nfailed = 0;
+  while ((next < nbatchfiles) || (running > 0)) {
+    /* start as many conversions as we are allowed */
+    while ((running < batchjobs) && (next < nbatchfiles)) {
+      outnames[next] = batchoutname(batchfiles[next]);
+      fflush(stdout);
+      fflush(stderr);
+      gettimeofday(&starts[next], NULL);
+      pid = fork();
+      if (pid < 0) {
+        fatal_error("Error - cannot start batch process");
+      };
+      if (pid == 0) {
+        F = efopen(batchfiles[next], "rb");
+        midifilename = batchfiles[next];
+        outhandle = efopen(outnames[next], "w");
+        midi2abc(argc, argv);
+        exit(0);
+      };
+      pids[next] = pid;
+      next = next + 1;
+      running = running + 1;
+    };
+    /* wait for one of them to finish and report it */
+    pid = wait(&status);
+    if (pid < 0) break;
+    for (k=0; k<next; k++) {
+      if (pids[k] == pid) break;
+    };
+    if (k == next) continue;
+    running = running - 1;
+    if (WIFEXITED(status) && (WEXITSTATUS(status) == 0)) {
+      printf("%s -> %s ok %.3f s\n", batchfiles[k], outnames[k],
+             secondssince(&starts[k]));
+    }
+    else {
+      nfailed = nfailed + 1;
+      unlink(outnames[k]);
+      if (WIFSIGNALED(status)) {
+        printf("%s failed (signal %d) %.3f s\n", batchfiles[k],
+               WTERMSIG(status), secondssince(&starts[k]));
+      }
+      else {
+        printf("%s failed (exit %d) %.3f s\n", batchfiles[k],
+               WEXITSTATUS(status), secondssince(&starts[k]));
+      };
+    };
+    fflush(stdout);
+  };
+  printf("%d files converted, %d failed in %.3f s\n",
+         nbatchfiles - nfailed, nfailed, secondssince(&t0));
+  return (nfailed > 0);
+}
+#else
+int batchconvert(argc, argv)
+char *argv[];
+int argc;
+{
+  fatal_error("Batch mode is not supported on this system");
+  return 1;
+}
+#endif
+
+
 int main(argc,argv)
 char *argv[];
 int argc;
@@ -3569,6 +3944,7 @@ int argc;
   int arg;
 
   arg = process_command_line_arguments(argc,argv);
+  if (batchmode) return batchconvert(argc,argv);
   if(midiprint ==1) midigram(argc,argv);
   else if(midiprint ==2) mftext(argc,argv);
   else midi2abc(argc,argv); 
@@ -49,9 +49,7 @@
 #endif
 
 #include <stdio.h>
-
-char *strcpy (), *strcat ();
-int strcmp();
+#include <string.h>
 
 /* Functions to be called while processing the MIDI file. */
 int (*Mf_arbitrary) () = NULLFUNC;
@@ -72,6 +70,8 @@ void append_to_string ();
 void winamp_compatibility_measure ();
 void writechanmsg_at_0 ();
 void copy_noteoff (int chan, int c1, int c2);
+void finish_track ();
+void write_segments (int ntracks);
 
 int Mf_nomerge = 0;		/* 1 => continue'ed system exclusives are */
 		       /* not collapsed. */
@@ -103,14 +103,21 @@ long to32bit ();
 int read16bit ();
 int to16bit ();
 char *msg ();
-int seconds_to_tick (float seconds);
-float tick_to_seconds (int tick);
+int seconds_to_tick (double seconds);
+double tick_to_seconds (int tick);
+long output_tempo (long tempo);
+void add_tempo (long tick, long tempo, long outtempo);
 
 /* following declaration added 27/8/96 JRA (James Allwright)*/
 void badbyte (int);
 void metaevent (int);
 void sysex ();
 void chanmessage (int, int, int);
+void send_chanmessage (int, int, int);
+void send_metaevent (int);
+void send_sysex ();
+void start_segments ();
+int end_segments ();
 void msginit ();
 int msgleng ();
 void msgadd ();
@@ -118,7 +125,8 @@ void biggermsg ();
 void WriteVarLen (long);
 
 
-int notechan[2048];		/* keeps track of running voices */
+int playing[2048];		/* running voices for a single time window */
+int *notechan = playing;	/* keeps track of running voices */
 int tocopy[32];			/* tracks to copy */
 int ctocopy[16];		/* channels to copy */
 int chnflag = 0;		/* flag indicating not all channels selected */
@@ -127,18 +135,49 @@ int verbatim = 1;		/* flag for verbatim transfer */
 FILE *F_in, *fp;
 int format, ntrks, division;
 int start_tick, end_tick, flag_metaeot;
-float start_seconds, end_seconds;
+double start_seconds, end_seconds;
 int use_seconds = 0;
 int current_tempo = 500000;
-float seconds_output;
-
+double seconds_output;
+
+/* The tempo map built from the tempo changes in track 1. For each
+   change it holds the time from the start of the file in units of
+   one microsecond/division (the sum of ticks times tempo), both for
+   the input and for the output after -tempo or -speed. These sums
+   are whole numbers and are held exactly in a double for any file
+   shorter than a few thousand hours, so converting between seconds
+   and ticks only needs a binary search and one division.
+*/
 struct tempostruc
 {
   int tick;
-  int tempo;
-  float seconds;
-} tempo_array[2000];
-int temposize, tempo_index;
+  long tempo, outtempo;
+  double elapsed, outelapsed;
+} *tempo_array = NULL;
+int temposize, tempospace, tempo_index;
+
+/* With -segments, -segsec or -segbeat several time windows are
+   copied to separate output files while the input is read once.
+   Each event decoded by readtrack() is passed to every window
+   which has not yet ended; load_segment() and save_segment() swap
+   the state of a window in and out of the variables used by the
+   copy_ functions.
+*/
+struct segment
+{
+  double from, to;		/* window as given, -1 for none */
+  int start_tick, end_tick;
+  char *name;
+  FILE *fp;
+  char *trackdata;
+  long trackdata_length, trackdata_size;
+  long currcopytime;
+  int notechan[2048];
+  int nochanmsg, flag_metaeot;
+  int done;			/* window has ended in this track */
+} *segment = NULL;
+int nsegments = 0;
+int segunit = 0;		/* 0 ticks, 1 seconds, 2 beats */
 
 /*          Support stuff                         */
 
@@ -204,13 +243,18 @@ turn_off_all_playing_notes ()
 void
 append_to_string (int c)
 {
-  trackdata[trackdata_length] = c;
-  trackdata_length++;
-  if (trackdata_length > trackdata_size)
+  if (trackdata_length >= trackdata_size)
     {
-      printf ("trackdata overflow\n");
-      exit (1);
+      trackdata_size = trackdata_size * 2 + 1024;
+      trackdata = (char *) realloc (trackdata, trackdata_size);
+      if (trackdata == NULL)
+	{
+	  printf ("trackdata overflow\n");
+	  exit (1);
+	}
     }
+  trackdata[trackdata_length] = c;
+  trackdata_length++;
 }
 
 
@@ -574,7 +618,10 @@ readtrack ()
   Mf_currcopytime = 0;
   currentseconds = 0.0;
 
-  alloc_trackdata ();
+  if (nsegments > 0)
+    start_segments ();
+  else
+    alloc_trackdata ();
 
   if (cut_beginning ())
     {
@@ -587,7 +634,12 @@ readtrack ()
 
       delta_time = readvarinum ();
       Mf_currtime += delta_time;
-      if (cut_ending ())
+      if (nsegments > 0)
+	{
+	  if (end_segments () == nsegments)
+	    break;
+	}
+      else if (cut_ending ())
 	{
 	  flag_metaeot = 1;
 	  /*   delta_time += end_tick - Mf_currtime; */
@@ -634,12 +686,12 @@ readtrack ()
 	  if (running)
 	    {
 	      c1 = c;
-	      chanmessage (laststatus, c1, (needed > 1) ? egetc () : 0);
+	      send_chanmessage (laststatus, c1, (needed > 1) ? egetc () : 0);
 	    }
 	  else
 	    {
 	      c1 = egetc ();
-	      chanmessage (status, c1, (needed > 1) ? egetc () : 0);
+	      send_chanmessage (status, c1, (needed > 1) ? egetc () : 0);
 	    }
 	  continue;;
 	}
@@ -657,7 +709,7 @@ readtrack ()
 	  while (Mf_toberead > lookfor)
 	    msgadd (egetc ());
 
-	  metaevent (type);
+	  send_metaevent (type);
 	  break;
 
 	case 0xf0:		/* start of system exclusive */
@@ -671,7 +723,7 @@ readtrack ()
 	    msgadd (c = egetc ());
 
 	  if (c == 0xf7 || Mf_nomerge == 0)
-	    sysex ();
+	    send_sysex ();
 	  else
 	    sysexcontinue = 1;	/* merge into next msg */
 	  break;
@@ -694,7 +746,7 @@ readtrack ()
 	    }
 	  else if (c == 0xf7)
 	    {
-	      sysex ();
+	      send_sysex ();
 	      sysexcontinue = 0;
 	    }
 	  break;
@@ -886,7 +938,6 @@ metaevent (int type)
 {
   int leng;
   unsigned char *m;
-  long qnote;			/* [SS] 2013-09-06 */
 
   leng = msgleng ();
   m = msg ();
@@ -918,16 +969,7 @@ metaevent (int type)
       copy_metaeot ();
       break;
     case 0x51:			/* Set tempo */
-      if (newtempo > 0)		/* [SS] 2013-09-04 */
-	mf_write_tempo (newtempo);
-      else if (newspeed)
-	{
-	  qnote = m[2] + m[1] * 256 + m[0] * 65536;
-	  qnote = (int) ((float) qnote / speedfactor);
-	  mf_write_tempo (qnote);
-	}
-      else
-	mf_write_tempo (to32bit (0, m[0], m[1], m[2]));
+      mf_write_tempo (output_tempo (to32bit (0, m[0], m[1], m[2])));
       break;
     case 0x54:
       mf_write_meta_event (0x54, m, 5);
@@ -1004,6 +1046,147 @@ chanmessage (int status, int c1, int c2)
 
 
 
+void
+load_segment (int k)
+/* make segment k the one the copy_ functions write to */
+{
+  struct segment *s = &segment[k];
+
+  start_tick = s->start_tick;
+  end_tick = s->end_tick;
+  fp = s->fp;
+  trackdata = s->trackdata;
+  trackdata_length = s->trackdata_length;
+  trackdata_size = s->trackdata_size;
+  Mf_currcopytime = s->currcopytime;
+  notechan = s->notechan;
+  nochanmsg = s->nochanmsg;
+  flag_metaeot = s->flag_metaeot;
+}
+
+
+void
+save_segment (int k)
+/* keep what the copy_ functions have changed for segment k */
+{
+  struct segment *s = &segment[k];
+
+  s->trackdata = trackdata;
+  s->trackdata_length = trackdata_length;
+  s->trackdata_size = trackdata_size;
+  s->currcopytime = Mf_currcopytime;
+  s->nochanmsg = nochanmsg;
+  s->flag_metaeot = flag_metaeot;
+}
+
+
+void
+start_segments ()
+/* called by readtrack at the start of each track */
+{
+  int k;
+  for (k = 0; k < nsegments; k++)
+    {
+      load_segment (k);
+      trackdata_length = 0;
+      Mf_currcopytime = 0;
+      if (cut_beginning ())
+	Mf_currcopytime = start_tick;	/* to avoid long gap at begining */
+      nochanmsg = 1;
+      flag_metaeot = 0;
+      init_notechan ();
+      segment[k].done = 0;
+      save_segment (k);
+    }
+}
+
+
+int
+end_segments ()
+/* end the track for every segment whose time window is over */
+/* and return the number of segments which have ended        */
+{
+  int k, ended;
+  ended = 0;
+  for (k = 0; k < nsegments; k++)
+    {
+      if (!segment[k].done)
+	{
+	  load_segment (k);
+	  if (cut_ending ())
+	    {
+	      flag_metaeot = 1;
+	      finish_track ();
+	      segment[k].done = 1;
+	      save_segment (k);
+	    }
+	}
+      if (segment[k].done)
+	ended++;
+    }
+  return ended;
+}
+
+
+void
+send_chanmessage (int status, int c1, int c2)
+{
+  int k;
+  if (nsegments == 0)
+    {
+      chanmessage (status, c1, c2);
+      return;
+    }
+  for (k = 0; k < nsegments; k++)
+    if (!segment[k].done)
+      {
+	load_segment (k);
+	chanmessage (status, c1, c2);
+	save_segment (k);
+      }
+}
+
+
+void
+send_metaevent (int type)
+{
+  int k;
+  if (nsegments == 0)
+    {
+      metaevent (type);
+      return;
+    }
+  for (k = 0; k < nsegments; k++)
+    if (!segment[k].done)
+      {
+	load_segment (k);
+	metaevent (type);
+	save_segment (k);
+      }
+}
+
+
+void
+send_sysex ()
+{
+  int k;
+  if (nsegments == 0)
+    {
+      sysex ();
+      return;
+    }
+  for (k = 0; k < nsegments; k++)
+    if (!segment[k].done)
+      {
+	load_segment (k);
+	sysex ();
+	save_segment (k);
+      }
+}
+
+
+
+
 /* readvarinum - read a varying-length number, and return the */
 /* number of characters it took. */
 long
@@ -1202,10 +1385,7 @@ mfwrite (format, ntracks, division, fp)
 
   seconds_output = 0.0;
   temposize = 0;
-  tempo_array[temposize].tempo = current_tempo;
-  tempo_array[temposize].tick = 0;
-  tempo_array[temposize].seconds = 0.0;
-  temposize++;
+  add_tempo (0, current_tempo, current_tempo);
 
   get_tempo_info_from_track_1 ();
   if (start_seconds >= 0.0)
@@ -1213,6 +1393,12 @@ mfwrite (format, ntracks, division, fp)
   if (end_seconds >= 0.0)
     end_tick = seconds_to_tick (end_seconds);
 
+  if (nsegments > 0)
+    {
+      write_segments (ntracks);
+      return;
+    }
+
   /* The rest of the file is a series of tracks */
   for (i = 0; i < ntracks; i++)
     {
@@ -1227,11 +1413,7 @@ mfwrite (format, ntracks, division, fp)
 	  track_time = (float) readtrack ();
 	  if (track_time > seconds_output)
 	    seconds_output = track_time;
-	  turn_off_all_playing_notes ();
-	  if (i > 1 && nochanmsg)
-	    winamp_compatibility_measure ();
-	  if (flag_metaeot)
-	    copy_metaeot ();	/*need end of track message */
+	  finish_track ();
 	  ignore_rest_of_track ();
 	}
       if (tocopy[i] == 1)
@@ -1239,6 +1421,62 @@ mfwrite (format, ntracks, division, fp)
     }
 }
 
+void
+finish_track ()
+/* turn off the notes still playing at the end of the time window */
+{
+  turn_off_all_playing_notes ();
+  if (activetrack > 1 && nochanmsg)
+    winamp_compatibility_measure ();
+  if (flag_metaeot)
+    copy_metaeot ();		/*need end of track message */
+}
+
+void
+write_segments (int ntracks)
+/* copy every track of the input to all the segment files at once */
+{
+  int i, k;
+
+  for (k = 0; k < nsegments; k++)
+    {
+      switch (segunit)
+	{
+	case 1:
+	  segment[k].start_tick = (segment[k].from < 0.0) ? -1 :
+	    seconds_to_tick (segment[k].from);
+	  segment[k].end_tick = (segment[k].to < 0.0) ? -1 :
+	    seconds_to_tick (segment[k].to);
+	  break;
+	case 2:
+	  segment[k].start_tick = (segment[k].from < 0.0) ? -1 :
+	    (int) (division * segment[k].from);
+	  segment[k].end_tick = (segment[k].to < 0.0) ? -1 :
+	    (int) (division * segment[k].to);
+	  break;
+	default:
+	  segment[k].start_tick = (int) segment[k].from;
+	  segment[k].end_tick = (int) segment[k].to;
+	  break;
+	}
+    }
+  for (i = 0; i < ntracks; i++)
+    {
+      activetrack = i;
+      readtrack ();
+      for (k = 0; k < nsegments; k++)
+	{
+	  load_segment (k);
+	  if (!segment[k].done)
+	    finish_track ();
+	  if (tocopy[i] == 1)
+	    mf_write_track_chunk (i, fp);
+	  save_segment (k);
+	}
+      ignore_rest_of_track ();
+    }
+}
+
 void
 winamp_compatibility_measure ()
 {
@@ -1435,19 +1673,60 @@ mf_write_meta_event (int type, char *data, int size)
 
 
 
+long
+output_tempo (long tempo)
+/* the tempo written to the output in place of tempo */
+{
+  if (newtempo > 0)		/* [SS] 2013-09-04 */
+    return newtempo;
+  if (newspeed)			/* [SS] 2013-09-06 */
+    return (int) ((float) tempo / speedfactor);
+  return tempo;
+}
+
+
+void
+add_tempo (long tick, long tempo, long outtempo)
+/* add a tempo change at tick to the end of the tempo map */
+{
+  struct tempostruc *t, *last;
+
+  if (temposize == tempospace)
+    {
+      tempospace = tempospace * 2 + 256;
+      tempo_array = (struct tempostruc *) realloc (tempo_array,
+						   tempospace *
+						   sizeof (struct
+							   tempostruc));
+      if (tempo_array == NULL)
+	mferror ("malloc error!");
+    }
+  t = &tempo_array[temposize];
+  if (temposize == 0)
+    {
+      t->elapsed = 0.0;
+      t->outelapsed = 0.0;
+    }
+  else
+    {
+      last = t - 1;
+      t->elapsed = last->elapsed + (double) (tick - last->tick) * last->tempo;
+      t->outelapsed = last->outelapsed +
+	(double) (tick - last->tick) * last->outtempo;
+    }
+  t->tick = tick;
+  t->tempo = tempo;
+  t->outtempo = outtempo;
+  temposize++;
+}
+
+
 void
 mf_get_tempo_event (tempo)
      long tempo;
 {
-  tempo_array[temposize].seconds
-    = (float) (Mf_currtime - tempo_array[temposize - 1].tick) *
-    (float) current_tempo
-    / (division * 1000000.0f) + tempo_array[temposize - 1].seconds;
-  tempo_array[temposize].tick = Mf_currtime;
-  tempo_array[temposize].tempo = tempo;
+  add_tempo (Mf_currtime, tempo, output_tempo (tempo));
   current_tempo = tempo;
-  if (temposize < 1999)
-    temposize++;
 }
 
 
@@ -1577,70 +1856,54 @@ eputc (char c)
 
 
 int
-seconds_to_tick (float seconds)
+find_tempo (double elapsed, int tick)
+/* binary search the tempo map for the last change at or before the
+   given elapsed time, or if elapsed < 0 before the given tick */
 {
-  int i, ind;
-  float tick, fraction;
-  for (i = 0; i < temposize; i++)
-    {
-      ind = i;
-      if (seconds < tempo_array[ind].seconds)
-	break;
-    }
+  int lo, hi, mid;
 
-  if (seconds < tempo_array[ind].seconds)
+  lo = 0;
+  hi = temposize - 1;
+  while (lo < hi)
     {
-      fraction = (seconds - tempo_array[ind - 1].seconds)
-	/ (tempo_array[ind].seconds - tempo_array[ind - 1].seconds);
-      tick = tempo_array[ind - 1].tick + fraction * (tempo_array[ind].tick -
-						     tempo_array[ind -
-								 1].tick);
-      return (int) tick;
+      mid = (lo + hi + 1) / 2;
+      if (elapsed >= 0.0 ? tempo_array[mid].elapsed <= elapsed
+	  : tempo_array[mid].tick <= tick)
+	lo = mid;
+      else
+	hi = mid - 1;
     }
+  return lo;
+}
+
+
+int
+seconds_to_tick (double seconds)
+{
+  int ind;
+  double elapsed;
 
-  tick = tempo_array[ind].tick +
-    (seconds - tempo_array[ind].seconds) * division * 1000000.0f /
-    tempo_array[ind].tempo;
-  return (int) tick;
+  elapsed = seconds * division * 1000000.0;
+  if (elapsed < 0.0)
+    return 0;
+  ind = find_tempo (elapsed, 0);
+  return tempo_array[ind].tick +
+    (int) ((elapsed - tempo_array[ind].elapsed) / tempo_array[ind].tempo);
 }
 
 
-float
+double
 tick_to_seconds (int tick)
+/* playing time of the output up to tick */
 {
-  int i, ind;
-  float seconds;
-  float delta;
-  long tempo;
-  for (i = 0; i < temposize; i++)
-    {
-      ind = i;
-      if (tick < tempo_array[ind].tick)
-	break;
-    }
-  if (tick < tempo_array[ind].tick && ind == 0)
+  int ind;
+
+  if (tick < 0)
     return 0.0;
-  if (tick < tempo_array[ind].tick)
-    {
-      tempo = tempo_array[ind - 1].tempo;	/* [SS] 2013-09-08 and etc. */
-      if (newtempo)
-	tempo = newtempo;
-      if (newspeed)
-	tempo = (int) ((float) tempo / speedfactor);
-      delta = (float) (tick - tempo_array[ind - 1].tick) *
-	(float) tempo / ((float) (division * 1000000.0));
-      seconds = tempo_array[ind - 1].seconds + delta;
-      return seconds;
-    }
-  tempo = tempo_array[ind].tempo;	/* [SS] 2013-09-08 and etc. */
-  if (newtempo)
-    tempo = newtempo;
-  if (newspeed)
-    tempo = (int) ((float) tempo / speedfactor);
-  delta = (float) (tick - tempo_array[ind].tick) *
-    (float) tempo / ((float) (division * 1000000.0));
-  seconds = tempo_array[ind].seconds + delta;
-  return seconds;
+  ind = find_tempo (-1.0, tick);
+  return (tempo_array[ind].outelapsed +
+	  (double) (tick - tempo_array[ind].tick) *
+	  tempo_array[ind].outtempo) / (division * 1000000.0);
 }
 
 
@@ -1680,6 +1943,114 @@ getarg (char *option, int argc, char *argv[])
 
 
 
+void
+add_segment (char *window, char *name, char *outname)
+/* add a time window written as start-end to the list of segments.
+   Either end may be left out. Without a name the output goes to
+   outname with the number of the segment before the extension.
+*/
+{
+  struct segment *s;
+  char *p, *ext, *slash;
+  char root[201];		/* at most 200 characters of outname */
+
+  segment = (struct segment *) realloc (segment,
+					(nsegments + 1) *
+					sizeof (struct segment));
+  if (segment == NULL)
+    {
+      printf ("too many segments\n");
+      exit (1);
+    }
+  s = &segment[nsegments];
+  nsegments++;
+  s->from = -1.0;
+  s->to = -1.0;
+  p = window;
+  if (*p != '-')
+    s->from = strtod (window, &p);
+  if (*p == '-')
+    {
+      p++;
+      if (*p != '\0')
+	s->to = strtod (p, &p);
+    }
+  if (*p != '\0' || p == window)
+    printf ("cannot read segment %s\n", window);
+  if (name == NULL)
+    {
+      sprintf (root, "%.200s", outname);
+      ext = strrchr (root, '.');
+      slash = strrchr (root, '/');
+      if (ext != NULL && (slash == NULL || slash < ext))
+	{
+	  *ext = '\0';
+	  ext = outname + (ext - root);
+	}
+      else
+	ext = ".mid";
+      s->name = (char *) malloc (256);
+      sprintf (s->name, "%s%d%.40s", root, nsegments, ext);
+    }
+  else
+    {
+      s->name = (char *) malloc (256);
+      sprintf (s->name, "%.255s", name);
+    }
+  s->trackdata = NULL;
+  s->trackdata_length = 0;
+  s->trackdata_size = 0;
+  s->fp = NULL;
+}
+
+
+void
+read_segments (char *list, char *outname)
+/* read a comma separated list of windows, or with @file a file
+   with a window and optionally an output file name on each line */
+{
+  FILE *segfile;
+  char line[512], window[256], name[256];
+  char *p, *next;
+  int n;
+
+  if (*list != '@')
+    {
+      p = list;
+      while (p != NULL)
+	{
+	  next = p;
+	  while (*next != '\0' && *next != ',')
+	    next++;
+	  if (*next == ',')
+	    *next++ = '\0';
+	  else
+	    next = NULL;
+	  add_segment (p, NULL, outname);
+	  p = next;
+	}
+      return;
+    }
+  segfile = fopen (list + 1, "r");
+  if (segfile == NULL)
+    {
+      printf ("cannot open segment file %s\n", list + 1);
+      exit (1);
+    }
+  while (fgets (line, sizeof (line), segfile) != NULL)
+    {
+      if (line[0] == '#')
+	continue;
+      n = sscanf (line, "%255s %255s", window, name);
+      if (n == 1)
+	add_segment (window, NULL, outname);
+      if (n == 2)
+	add_segment (window, name, outname);
+    }
+  fclose (segfile);
+}
+
+
 int
 main (int argc, char *argv[])
 {
@@ -1739,6 +2110,11 @@ main (int argc, char *argv[])
       printf ("-drumfocus n (35 - 81) m (0 - 127)\n");	/* [SS] 2013-09-07 */
       printf ("-mutenodrum [level] \n");	/* [SS] 2013-09-15 */
       printf ("-setdrumloudness n (35-81) m (0 -127)\n"); /* [SS] 2013-10-01 */
+      printf ("-segments t1-t2,t3-t4,.. (in midi ticks) or @file\n");
+      printf ("-segsec s1-s2,s3-s4,.. (in seconds) or @file\n");
+      printf ("-segbeat b1-b2,b3-b4,.. (in beats) or @file\n");
+      printf ("   copies each window to its own file, numbered from\n");
+      printf ("   the output file name unless given in the file\n");
       exit (1);
     }
 
@@ -1811,14 +2187,14 @@ main (int argc, char *argv[])
   arg = getarg ("-fromsec", argc, argv);
   if (arg >= 0)
     {
-      sscanf (argv[arg], "%f", &start_seconds);
+      sscanf (argv[arg], "%lf", &start_seconds);
       use_seconds = 1;
       verbatim = 0;
     }
   arg = getarg ("-tosec", argc, argv);
   if (arg >= 0)
     {
-      sscanf (argv[arg], "%f", &end_seconds);
+      sscanf (argv[arg], "%lf", &end_seconds);
       use_seconds = 1;
       verbatim = 0;
     }
@@ -1914,6 +2290,16 @@ main (int argc, char *argv[])
     }
 
 
+  arg = getarg ("-segments", argc, argv);
+  if (arg < 0 && (arg = getarg ("-segsec", argc, argv)) >= 0)
+    segunit = 1;
+  if (arg < 0 && (arg = getarg ("-segbeat", argc, argv)) >= 0)
+    segunit = 2;
+  if (arg >= 0)
+    {
+      read_segments (argv[arg], argv[argc - 1]);
+      verbatim = 0;
+    }
 
   repflag = getarg ("-replace", argc, argv);
   if (repflag >= 0)
@@ -1925,11 +2311,23 @@ main (int argc, char *argv[])
       printf ("cannot open input file %s\n", argv[argc - 2]);
       exit (1);
     }
-  fp = fopen (argv[argc - 1], "wb");
-  if (fp == NULL)
+  if (nsegments == 0)
     {
-      printf ("cannot open out file %s\n", argv[argc - 1]);
-      exit (2);
+      fp = fopen (argv[argc - 1], "wb");
+      if (fp == NULL)
+	{
+	  printf ("cannot open out file %s\n", argv[argc - 1]);
+	  exit (2);
+	}
+    }
+  for (i = 0; i < nsegments; i++)
+    {
+      segment[i].fp = fopen (segment[i].name, "wb");
+      if (segment[i].fp == NULL)
+	{
+	  printf ("cannot open out file %s\n", segment[i].name);
+	  exit (2);
+	}
     }
 
 
@@ -1957,13 +2355,35 @@ main (int argc, char *argv[])
   if (xtrks > 0)
     mtrks = ntrks - xtrks;
 
-  mf_write_header_chunk (format, mtrks, division);
+  if (nsegments == 0)
+    mf_write_header_chunk (format, mtrks, division);
+  for (i = 0; i < nsegments; i++)
+    {
+      fp = segment[i].fp;
+      mf_write_header_chunk (format, mtrks, division);
+    }
 
   if (repflag >= 0)
     replace_byte_in_file (trknum, byteloc, val, fp, mtrks);
   else
     mfwrite (format, ntrks, division, fp);
 
+  if (nsegments > 0)
+    {
+      for (i = 0; i < nsegments; i++)
+	{
+	  free (segment[i].trackdata);
+	  fclose (segment[i].fp);
+	  start_tick = segment[i].start_tick;
+	  end_tick = segment[i].end_tick;
+	  if (end_tick < 0)
+	    end_tick = max_currtime;
+	  printf ("%s %f\n", segment[i].name,
+		  tick_to_seconds (end_tick) - tick_to_seconds (start_tick));
+	}
+      fclose (F_in);
+      return (0);
+    }
   free (trackdata);
   fclose (F_in);
   fclose (fp);
@@ -99,6 +99,9 @@ int decorators_passback[DECSIZE];
 char inputline[512];		/* [SS] 2011-06-07 2012-11-22 */
 char *linestart;		/* [SS] 2011-07-18 */
 int lineposition;		/* [SS] 2011-07-18 */
+int itemposition;		/* start of item being parsed in music line */
+int copysource = 0;		/* keep whole of line for abc2abc -c */
+struct vstring sourceline;	/* line as read, before parsing */
 char timesigstring[16];		/* [SS] 2011-08-19 links with stresspat.c */
 
 int nokey = 0;			/* K: none was encountered */
@@ -2268,6 +2271,7 @@ parsemusic (field)
   while (*p != '\0')
     {
       lineposition = p - linestart;	/* [SS] 2011-07-18 */
+      itemposition = lineposition;
 
       if (*p == '.' && *(p+1) == '(') {  /* [SS] 2015-04-28 dotted slur */
           p = p+1;
@@ -2708,6 +2712,18 @@ parseline (line)
 
   /*printf("%d parsing : %s\n", lineno, line); */
   strncpy (inputline, line, sizeof inputline);	/* [SS] 2011-06-07 [PHDM] 2012-11-27 */
+  if (copysource)
+    {
+      if (sourceline.st == NULL)
+	{
+	  initvstring (&sourceline);
+	}
+      else
+	{
+	  clearvstring (&sourceline);
+	};
+      addtext (line, &sourceline);
+    };
 
   p = line;
   linestart = p;		/* [SS] 2011-07-18 */
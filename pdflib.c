@@ -0,0 +1,2799 @@
+/*
+ * yaps - abc to PostScript converter
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ *
+ */
+
+/* pdflib.c */
+/* part of yaps - abc to PostScript converter */
+/* This file writes the output of yaps as PDF (yaps -pdf).             */
+/* The PostScript which printlib() would write is run through a small  */
+/* interpreter that knows the operators used by the library in pslib.c */
+/* and by drawtune.c. Paths and text go into one content stream per    */
+/* page, optionally deflate-compressed. A path which is drawn again,   */
+/* such as a note head, clef or accidental, is stored once as a Form   */
+/* XObject and each later use just places that glyph.                  */
+/* Text uses the standard 14 PDF fonts, so no font data is embedded.   */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdarg.h>
+#ifdef ANSILIBS
+#include <time.h>
+#endif
+#include "drawtune.h"
+
+extern void printlib();
+extern int pagelen, pagewidth, xmargin, ymargin;
+extern int landscape;
+extern double timesbold_width[224];
+extern double helvetica_width[224];
+
+#define MAXSTACK 1000
+#define MAXGSAVE 50
+#define MAXDICTS 20
+#define NAMEHASH 1024
+#define GLYPHHASH 65536
+/* shortest path, in points, worth keeping as a glyph */
+#define GLYPHMIN 5
+#define MAXERRORS 20
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+/* PostScript object types */
+#define T_NULL 0
+#define T_NUM 1
+#define T_BOOL 2
+#define T_NAME 3
+#define T_LITNAME 4
+#define T_STRING 5
+#define T_PROC 6
+#define T_OP 7
+#define T_MARK 8
+#define T_FONT 9
+
+struct psobj {
+  int type;
+  union {
+    double num;
+    int i; /* bool, name or standard font */
+    struct psstring* str;
+    struct psproc* proc;
+    void (*op)(void);
+  } u;
+};
+
+struct psstring {
+  int len;
+  unsigned char* text;
+};
+
+struct psproc {
+  int len;
+  struct psobj* item;
+};
+
+struct psname {
+  char* text;
+  int next;       /* hash chain */
+  int defined;
+  int warned;
+  int font;       /* standard font given by definefont, -1 if none */
+  struct psobj value;
+};
+
+/* growable output buffer */
+struct pdfbuf {
+  char* text;
+  long len, size;
+};
+
+/* graphics state, saved by gsave */
+struct pdfstate {
+  double ctm[6];
+  double linewidth;
+  int cap, join;
+  double rgb[3];
+  int font;
+  double fontsize;
+  int havepoint;
+  double x, y;          /* current point in device space */
+  double startx, starty; /* start of current subpath */
+  char* pathop;         /* saved path */
+  double* pathpt;
+  int pathlen, pointcount;
+};
+
+/* path that has been seen before, possibly stored as an XObject */
+struct glyph {
+  unsigned long hash;
+  int len;
+  int* key;
+  int number;  /* XObject /G<number>, 0 until the path is seen twice */
+  int object;  /* PDF object holding the XObject */
+  int next;
+};
+
+static char* stdfonts[14] = {
+  "Times-Roman", "Times-Bold", "Times-Italic", "Times-BoldItalic",
+  "Helvetica", "Helvetica-Bold", "Helvetica-Oblique",
+  "Helvetica-BoldOblique", "Courier", "Courier-Bold", "Courier-Oblique",
+  "Courier-BoldOblique", "Symbol", "ZapfDingbats"
+};
+
+/* Adobe font metrics for characters 32-126 */
+static short times_roman[95] = {
+  250, 333, 408, 500, 500, 833, 778, 333, 333, 333, 500, 564, 250, 564,
+  250, 278, 500, 500, 500, 500, 500, 500, 500, 500, 500, 500, 278, 278,
+  564, 564, 564, 444, 921, 722, 667, 667, 722, 611, 556, 722, 722, 333,
+  389, 722, 611, 889, 722, 722, 556, 722, 667, 556, 611, 722, 722, 944,
+  722, 722, 611, 333, 278, 333, 469, 500, 333, 444, 500, 444, 500, 444,
+  333, 500, 500, 278, 278, 500, 278, 778, 500, 500, 500, 500, 333, 389,
+  278, 500, 500, 722, 500, 500, 444, 480, 200, 480, 541
+};
+
+static short times_italic[95] = {
+  250, 333, 420, 500, 500, 833, 778, 333, 333, 333, 500, 675, 250, 675,
+  250, 278, 500, 500, 500, 500, 500, 500, 500, 500, 500, 500, 333, 333,
+  675, 675, 675, 500, 920, 611, 611, 667, 722, 611, 611, 722, 722, 333,
+  444, 667, 556, 833, 667, 722, 611, 722, 611, 500, 556, 722, 611, 833,
+  611, 556, 556, 389, 278, 389, 422, 500, 333, 500, 500, 444, 500, 444,
+  278, 500, 500, 278, 278, 444, 278, 722, 500, 500, 500, 500, 389, 389,
+  278, 500, 444, 667, 444, 444, 389, 400, 275, 400, 541
+};
+
+/* character of similar width for ISO Latin 1 characters 160-255 */
+static char latin1base[] =
+  " !0000|0'Oa0+-O-o+rr'u0.,ro0%%%?AAAAAAMCEEEEIIIIDNOOOOO+OUUUUYPbaaaaaaeceeeeiiiionooooo+ouuuuypy";
+
+static short bold_width[224];
+static short sans_width[224];
+
+/* interpreter state */
+static FILE* psin;
+static unsigned char inbuf[8192];
+static int inpos, inlen;
+static struct psobj stack[MAXSTACK];
+static int sp;
+static int exiting;
+static int errors;
+static int curname;
+static int dictstack[MAXDICTS];
+static int dictdepth;
+static struct psname* names;
+static int namecount, namesize;
+static int namehash[NAMEHASH];
+
+/* memory which lasts until the file is complete */
+static char* arenap;
+static size_t arenaleft;
+static void* arenachunks;
+
+static struct pdfstate gs;
+static struct pdfstate saved[MAXGSAVE];
+static int gdepth;
+static char* pathop;
+static double* pathpt;
+static int pathlen, pointcount, opsize, ptsize;
+
+/* state already set in the page content stream */
+static double fillrgb[3], strokergb[3];
+static double setwidth;
+static int setcap, setjoin;
+
+/* PDF output */
+static FILE* pdffile;
+static long pdfpos;
+static long* offsets;
+static int objcount, objsize;
+static int* kids;
+static int pagecount, kidsize;
+static int compress;
+static int fontused[14];
+static double mediabox[4];
+static struct pdfbuf page;
+static struct pdfbuf zbuf;
+static struct pdfbuf work;
+static struct glyph* glyphs;
+static int glyphcount, glyphsize;
+static int* glyphhash;
+static int* keybuf;
+static int keysize;
+static int xobjects;
+
+static void outofmemory()
+{
+  printf("Out of memory\n");
+  exit(1);
+}
+
+static void* checkmalloc(size_t n)
+{
+  void* p;
+
+  p = malloc(n);
+  if (p == NULL) {
+    outofmemory();
+  };
+  return(p);
+}
+
+static void* checkrealloc(void* p, size_t n)
+{
+  p = realloc(p, n);
+  if (p == NULL) {
+    outofmemory();
+  };
+  return(p);
+}
+
+static void* arena(size_t n)
+/* allocate memory which is freed by freearena() */
+{
+  char* chunk;
+  size_t size;
+  void* p;
+
+  n = (n + 7) & ~(size_t)7;
+  if (n > arenaleft) {
+    size = 65536;
+    if (n > size) {
+      size = n;
+    };
+    chunk = (char*)checkmalloc(size + 8);
+    *(void**)chunk = arenachunks;
+    arenachunks = (void*)chunk;
+    arenap = chunk + 8;
+    arenaleft = size;
+  };
+  p = (void*)arenap;
+  arenap = arenap + n;
+  arenaleft = arenaleft - n;
+  return(p);
+}
+
+static void freearena()
+{
+  void* next;
+
+  while (arenachunks != NULL) {
+    next = *(void**)arenachunks;
+    free(arenachunks);
+    arenachunks = next;
+  };
+  arenap = NULL;
+  arenaleft = 0;
+}
+
+static void pserror(char* msg, char* name)
+/* report a problem with the PostScript; the page is still written */
+{
+  if (errors < MAXERRORS) {
+    printf("PDF output: %s %s\n", msg, name);
+  };
+  errors = errors + 1;
+}
+
+/* output buffers */
+
+static void bufroom(struct pdfbuf* b, long n)
+{
+  if (b->len + n > b->size) {
+    b->size = 2 * b->size + n + 4096;
+    b->text = (char*)checkrealloc(b->text, b->size);
+  };
+}
+
+static void bufchar(struct pdfbuf* b, int c)
+{
+  if (b->len >= b->size) {
+    bufroom(b, 1);
+  };
+  b->text[b->len] = (char)c;
+  b->len = b->len + 1;
+}
+
+static void bufstr(struct pdfbuf* b, char* s)
+{
+  long n;
+
+  n = strlen(s);
+  bufroom(b, n);
+  memcpy(b->text + b->len, s, n);
+  b->len = b->len + n;
+}
+
+static void bufnum(struct pdfbuf* b, double x, int places)
+/* write x with at most places (2 or 4) decimals, and a space */
+{
+  char digits[24];
+  long n, unit, ip, frac;
+  int i, neg;
+
+  if (x != x) {
+    x = 0.0;
+  };
+  if (x > 1.0e9) {
+    x = 1.0e9;
+  };
+  if (x < -1.0e9) {
+    x = -1.0e9;
+  };
+  unit = (places == 4) ? 10000L : 100L;
+  neg = (x < 0.0);
+  if (neg) {
+    x = -x;
+  };
+  n = (long)(x * unit + 0.5);
+  bufroom(b, 24);
+  if ((neg) && (n != 0)) {
+    b->text[b->len++] = '-';
+  };
+  ip = n / unit;
+  frac = n % unit;
+  i = 0;
+  do {
+    digits[i++] = (char)('0' + ip % 10);
+    ip = ip / 10;
+  } while (ip > 0);
+  while (i > 0) {
+    b->text[b->len++] = digits[--i];
+  };
+  if (frac != 0) {
+    b->text[b->len++] = '.';
+    for (i=places-1; i>=0; i--) {
+      digits[i] = (char)('0' + frac % 10);
+      frac = frac / 10;
+    };
+    i = places;
+    while (digits[i-1] == '0') {
+      i = i - 1;
+    };
+    memcpy(b->text + b->len, digits, i);
+    b->len = b->len + i;
+  };
+  b->text[b->len++] = ' ';
+}
+
+static void bufpdfstring(struct pdfbuf* b, unsigned char* s, int len)
+/* write a PDF string, using octal escapes outside printable ASCII */
+{
+  int i, c;
+
+  bufroom(b, 4 * len + 2);
+  b->text[b->len++] = '(';
+  for (i=0; i<len; i++) {
+    c = s[i];
+    if ((c == '(') || (c == ')') || (c == '\\')) {
+      b->text[b->len++] = '\\';
+      b->text[b->len++] = (char)c;
+    } else {
+      if ((c < 32) || (c > 126)) {
+        b->text[b->len++] = '\\';
+        b->text[b->len++] = (char)('0' + (c >> 6));
+        b->text[b->len++] = (char)('0' + ((c >> 3) & 7));
+        b->text[b->len++] = (char)('0' + (c & 7));
+      } else {
+        b->text[b->len++] = (char)c;
+      };
+    };
+  };
+  b->text[b->len++] = ')';
+}
+
+/* deflate compression (RFC 1950/1951) with the fixed Huffman codes */
+
+#define ZWINDOW 32768
+#define ZHASHBITS 15
+#define ZCHAIN 32
+#define ZMAXMATCH 258
+
+static int* zhead;
+static int* zprev;
+static unsigned long zbits;
+static int zbitcount;
+static struct pdfbuf* zout;
+
+static int lenbase[29] = {
+  3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59,
+  67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static int lenextra[29] = {
+  0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4,
+  5, 5, 5, 5, 0
+};
+static int distbase[30] = {
+  1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385,
+  513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+static int distextra[30] = {
+  0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10,
+  11, 11, 12, 12, 13, 13
+};
+
+static void putbits(unsigned int value, int n)
+/* deflate packs bits starting from the least significant */
+{
+  zbits = zbits | ((unsigned long)value << zbitcount);
+  zbitcount = zbitcount + n;
+  while (zbitcount >= 8) {
+    bufchar(zout, (int)(zbits & 0xff));
+    zbits = zbits >> 8;
+    zbitcount = zbitcount - 8;
+  };
+}
+
+static void putcode(unsigned int code, int len)
+/* Huffman codes are packed starting from the most significant bit */
+{
+  unsigned int rev;
+  int i;
+
+  rev = 0;
+  for (i=0; i<len; i++) {
+    rev = (rev << 1) | ((code >> i) & 1);
+  };
+  putbits(rev, len);
+}
+
+static void putliteral(int c)
+{
+  if (c < 144) {
+    putcode(0x30 + c, 8);
+  } else {
+    if (c < 256) {
+      putcode(0x190 + c - 144, 9);
+    } else {
+      if (c < 280) {
+        putcode(c - 256, 7);
+      } else {
+        putcode(0xc0 + c - 280, 8);
+      };
+    };
+  };
+}
+
+static void putmatch(int len, int dist)
+{
+  int i;
+
+  i = 28;
+  while (lenbase[i] > len) {
+    i = i - 1;
+  };
+  putliteral(257 + i);
+  putbits(len - lenbase[i], lenextra[i]);
+  i = 29;
+  while (distbase[i] > dist) {
+    i = i - 1;
+  };
+  putcode(i, 5);
+  putbits(dist - distbase[i], distextra[i]);
+}
+
+static void deflate(struct pdfbuf* in, struct pdfbuf* out)
+/* compress in to out in zlib format */
+{
+  unsigned char* data;
+  long n, i, j;
+  int h, cand, next, chain, len, best, dist, maxlen;
+  unsigned long a, b;
+
+  if (zhead == NULL) {
+    zhead = (int*)checkmalloc((1 << ZHASHBITS) * sizeof(int));
+    zprev = (int*)checkmalloc(ZWINDOW * sizeof(int));
+  };
+  for (i=0; i < (1 << ZHASHBITS); i++) {
+    zhead[i] = -1;
+  };
+  data = (unsigned char*)in->text;
+  n = in->len;
+  out->len = 0;
+  zout = out;
+  zbits = 0;
+  zbitcount = 0;
+  bufchar(out, 0x78);
+  bufchar(out, 0x01);
+  putbits(1, 1); /* final block */
+  putbits(1, 2); /* fixed Huffman codes */
+  i = 0;
+  while (i < n) {
+    best = 0;
+    dist = 0;
+    if (i + 3 <= n) {
+      maxlen = (n - i < ZMAXMATCH) ? (int)(n - i) : ZMAXMATCH;
+      h = ((data[i] << 10) ^ (data[i+1] << 5) ^ data[i+2]) &
+          ((1 << ZHASHBITS) - 1);
+      cand = zhead[h];
+      chain = ZCHAIN;
+      while ((cand >= 0) && (i - cand <= ZWINDOW) && (chain > 0)) {
+        if (data[cand + best] == data[i + best]) {
+          len = 0;
+          while ((len < maxlen) && (data[cand + len] == data[i + len])) {
+            len = len + 1;
+          };
+          if (len > best) {
+            best = len;
+            dist = (int)(i - cand);
+            if (len == maxlen) {
+              break;
+            };
+          };
+        };
+        next = zprev[cand & (ZWINDOW - 1)];
+        if (next >= cand) {
+          break;
+        };
+        cand = next;
+        chain = chain - 1;
+      };
+      zprev[i & (ZWINDOW - 1)] = zhead[h];
+      zhead[h] = (int)i;
+    };
+    if (best >= 3) {
+      putmatch(best, dist);
+      for (j=i+1; j<i+best; j++) {
+        if (j + 3 <= n) {
+          h = ((data[j] << 10) ^ (data[j+1] << 5) ^ data[j+2]) &
+              ((1 << ZHASHBITS) - 1);
+          zprev[j & (ZWINDOW - 1)] = zhead[h];
+          zhead[h] = (int)j;
+        };
+      };
+      i = i + best;
+    } else {
+      putliteral(data[i]);
+      i = i + 1;
+    };
+  };
+  putliteral(256);
+  if (zbitcount > 0) {
+    putbits(0, 8 - zbitcount);
+  };
+  /* Adler-32 checksum */
+  a = 1;
+  b = 0;
+  for (i=0; i<n; i++) {
+    a = (a + data[i]) % 65521L;
+    b = (b + a) % 65521L;
+  };
+  bufchar(out, (int)((b >> 8) & 0xff));
+  bufchar(out, (int)(b & 0xff));
+  bufchar(out, (int)((a >> 8) & 0xff));
+  bufchar(out, (int)(a & 0xff));
+}
+
+/* PDF file structure */
+
+static void pdfwrite(char* s, long n)
+{
+  fwrite(s, 1, n, pdffile);
+  pdfpos = pdfpos + n;
+}
+
+static void pdfprintf(char* fmt, ...)
+{
+  char buffer[256];
+  va_list ap;
+
+  va_start(ap, fmt);
+  vsprintf(buffer, fmt, ap);
+  va_end(ap);
+  pdfwrite(buffer, strlen(buffer));
+}
+
+static int newobj()
+/* reserve an object number */
+{
+  if (objcount >= objsize) {
+    objsize = 2 * objsize + 64;
+    offsets = (long*)checkrealloc(offsets, objsize * sizeof(long));
+  };
+  offsets[objcount] = 0;
+  objcount = objcount + 1;
+  return(objcount - 1);
+}
+
+static void startobj(int n)
+{
+  offsets[n] = pdfpos;
+  pdfprintf("%d 0 obj\n", n);
+}
+
+static void writestream(int n, char* dict, struct pdfbuf* b)
+/* write b as stream object n with dict entries in dict */
+{
+  struct pdfbuf* data;
+
+  startobj(n);
+  if (compress) {
+    deflate(b, &zbuf);
+    data = &zbuf;
+    pdfprintf("<< %s/Length %ld /Filter /FlateDecode >>\nstream\n", dict,
+              data->len);
+  } else {
+    data = b;
+    pdfprintf("<< %s/Length %ld >>\nstream\n", dict, data->len);
+  };
+  pdfwrite(data->text, data->len);
+  pdfprintf("\nendstream\nendobj\n");
+}
+
+/* the glyph set */
+
+static unsigned long hashkey(int* key, int len)
+{
+  unsigned long h;
+  int i;
+
+  h = 2166136261UL;
+  for (i=0; i<len; i++) {
+    h = ((h ^ (unsigned long)key[i]) * 16777619UL) & 0xffffffffUL;
+  };
+  return(h);
+}
+
+static int makekey(int stroking, double width)
+/* describe the current path relative to its first point */
+/* in hundredths of a point */
+{
+  int i, j, k, n;
+  double x0, y0;
+
+  if (keysize < 2 + pathlen + 2 * pointcount) {
+    keysize = 2 + pathlen + 2 * pointcount + 64;
+    keybuf = (int*)checkrealloc(keybuf, keysize * sizeof(int));
+  };
+  x0 = pathpt[0];
+  y0 = pathpt[1];
+  keybuf[0] = stroking;
+  keybuf[1] = stroking ? (int)(width * 100.0 + 0.5) : 0;
+  k = 2;
+  j = 0;
+  for (i=0; i<pathlen; i++) {
+    keybuf[k++] = pathop[i];
+    n = 0;
+    switch (pathop[i]) {
+    case 'm':
+    case 'l':
+      n = 1;
+      break;
+    case 'c':
+      n = 3;
+      break;
+    default:
+      break;
+    };
+    while (n > 0) {
+      keybuf[k++] = (int)floor((pathpt[j] - x0) * 100.0 + 0.5);
+      keybuf[k++] = (int)floor((pathpt[j+1] - y0) * 100.0 + 0.5);
+      j = j + 2;
+      n = n - 1;
+    };
+  };
+  return(k);
+}
+
+static void makexobject(struct glyph* g)
+/* write the glyph as a Form XObject */
+{
+  int i, k, n, stroking;
+  double x, y, pad, llx, lly, urx, ury;
+  char dict[120];
+
+  work.len = 0;
+  stroking = g->key[0];
+  if (stroking) {
+    bufnum(&work, g->key[1] / 100.0, 2);
+    bufstr(&work, "w\n");
+  };
+  llx = lly = urx = ury = 0.0;
+  k = 2;
+  while (k < g->len) {
+    n = 0;
+    if ((g->key[k] == 'm') || (g->key[k] == 'l')) {
+      n = 1;
+    };
+    if (g->key[k] == 'c') {
+      n = 3;
+    };
+    if (g->key[k] == 'h') {
+      bufstr(&work, "h\n");
+    };
+    for (i=0; i<n; i++) {
+      x = g->key[k+1+2*i] / 100.0;
+      y = g->key[k+2+2*i] / 100.0;
+      bufnum(&work, x, 2);
+      bufnum(&work, y, 2);
+      if (x < llx) llx = x;
+      if (x > urx) urx = x;
+      if (y < lly) lly = y;
+      if (y > ury) ury = y;
+    };
+    if (n > 0) {
+      bufstr(&work, (g->key[k] == 'c') ? "c\n" :
+                    ((g->key[k] == 'm') ? "m\n" : "l\n"));
+    };
+    k = k + 1 + 2 * n;
+  };
+  bufstr(&work, stroking ? "S\n" : "f\n");
+  pad = 1.0 + g->key[1] / 100.0;
+  xobjects = xobjects + 1;
+  g->number = xobjects;
+  sprintf(dict, "/Type /XObject /Subtype /Form /BBox [%d %d %d %d] ",
+          (int)floor(llx - pad), (int)floor(lly - pad),
+          (int)ceil(urx + pad), (int)ceil(ury + pad));
+  g->object = newobj();
+  writestream(g->object, dict, &work);
+}
+
+static struct glyph* findglyph(int stroking, double width)
+/* look the current path up in the glyph set, adding it if it is new */
+/* returns the glyph to use, or NULL to draw the path directly */
+{
+  int len, i;
+  unsigned long h;
+  struct glyph* g;
+
+  len = makekey(stroking, width);
+  h = hashkey(keybuf, len);
+  i = glyphhash[h & (GLYPHHASH - 1)];
+  while (i != -1) {
+    g = &glyphs[i];
+    if ((g->hash == h) && (g->len == len) &&
+        (memcmp(g->key, keybuf, len * sizeof(int)) == 0)) {
+      if (g->number == 0) {
+        makexobject(g);
+      };
+      return(g);
+    };
+    i = g->next;
+  };
+  if (glyphcount >= glyphsize) {
+    glyphsize = 2 * glyphsize + 256;
+    glyphs = (struct glyph*)checkrealloc(glyphs,
+                                         glyphsize * sizeof(struct glyph));
+  };
+  g = &glyphs[glyphcount];
+  g->hash = h;
+  g->len = len;
+  g->key = (int*)arena(len * sizeof(int));
+  memcpy(g->key, keybuf, len * sizeof(int));
+  g->number = 0;
+  g->object = 0;
+  g->next = glyphhash[h & (GLYPHHASH - 1)];
+  glyphhash[h & (GLYPHHASH - 1)] = glyphcount;
+  glyphcount = glyphcount + 1;
+  return(NULL);
+}
+
+/* fonts */
+
+static int stdfont(char* name)
+/* choose the standard PDF font nearest to a PostScript font */
+{
+  char lower[80];
+  int i, family, bold, italic;
+
+  for (i=0; i<14; i++) {
+    if (strcmp(name, stdfonts[i]) == 0) {
+      return(i);
+    };
+  };
+  for (i=0; (name[i] != '\0') && (i < 79); i++) {
+    lower[i] = (char)(((name[i] >= 'A') && (name[i] <= 'Z')) ?
+                      name[i] - 'A' + 'a' : name[i]);
+  };
+  lower[i] = '\0';
+  if (strstr(lower, "symbol") != NULL) {
+    return(12);
+  };
+  if (strstr(lower, "dingbat") != NULL) {
+    return(13);
+  };
+  bold = ((strstr(lower, "bold") != NULL) || (strstr(lower, "black") != NULL)
+          || (strstr(lower, "heavy") != NULL) || (strstr(lower, "demi") != NULL));
+  italic = ((strstr(lower, "italic") != NULL) ||
+            (strstr(lower, "oblique") != NULL));
+  family = 0;
+  if ((strstr(lower, "helvetica") != NULL) || (strstr(lower, "arial") != NULL)
+      || (strstr(lower, "sans") != NULL)) {
+    family = 4;
+  };
+  if ((strstr(lower, "courier") != NULL) || (strstr(lower, "mono") != NULL)) {
+    family = 8;
+  };
+  if (family == 0) {
+    return(bold + 2*italic);
+  } else {
+    return(family + bold + 2*italic);
+  };
+}
+
+static void makewidths()
+/* widths for Times-Bold and Helvetica come from the tables in drawtune.c */
+{
+  int i;
+
+  for (i=0; i<224; i++) {
+    bold_width[i] = (short)(timesbold_width[i] * 1000.0 / 13.0 + 0.5);
+    sans_width[i] = (short)(helvetica_width[i] * 1000.0 / 12.0 + 0.5);
+  };
+}
+
+static int charwidth(int font, int c)
+/* width of character c in thousandths of the font size */
+/* the ISO Latin 1 encoding is assumed, as set up by pslib.c */
+{
+  if (c < 32) {
+    return(0);
+  };
+  switch (font) {
+  case 1:
+  case 3:
+    return(bold_width[c - 32]);
+  case 4:
+  case 5:
+  case 6:
+  case 7:
+    return(sans_width[c - 32]);
+  case 8:
+  case 9:
+  case 10:
+  case 11:
+    return(600);
+  case 12:
+  case 13:
+    return(500);
+  default:
+    break;
+  };
+  if (c >= 160) {
+    c = latin1base[c - 160];
+  };
+  if (c >= 127) {
+    return(333);
+  };
+  if (font == 2) {
+    return(times_italic[c - 32]);
+  } else {
+    return(times_roman[c - 32]);
+  };
+}
+
+static double textwidth(int font, unsigned char* s, int len)
+{
+  long w;
+  int i;
+
+  w = 0;
+  for (i=0; i<len; i++) {
+    w = w + charwidth(font, s[i]);
+  };
+  return((double)w / 1000.0);
+}
+
+/* names */
+
+static int findname(char* text, int len)
+/* return index of name, adding it if it is new */
+{
+  unsigned int h;
+  int i;
+  struct psname* p;
+
+  h = 0;
+  for (i=0; i<len; i++) {
+    h = h * 31 + (unsigned char)text[i];
+  };
+  h = h % NAMEHASH;
+  i = namehash[h];
+  while (i != -1) {
+    if ((strncmp(names[i].text, text, len) == 0) &&
+        (names[i].text[len] == '\0')) {
+      return(i);
+    };
+    i = names[i].next;
+  };
+  if (namecount >= namesize) {
+    namesize = 2 * namesize + 256;
+    names = (struct psname*)checkrealloc(names,
+                                         namesize * sizeof(struct psname));
+  };
+  p = &names[namecount];
+  p->text = (char*)arena(len + 1);
+  memcpy(p->text, text, len);
+  p->text[len] = '\0';
+  p->next = namehash[h];
+  p->defined = 0;
+  p->warned = 0;
+  p->font = -1;
+  p->value.type = T_NULL;
+  namehash[h] = namecount;
+  namecount = namecount + 1;
+  return(namecount - 1);
+}
+
+/* operand stack */
+
+static void push(struct psobj* o)
+{
+  if (sp >= MAXSTACK) {
+    pserror("stack overflow at", names[curname].text);
+    return;
+  };
+  stack[sp] = *o;
+  sp = sp + 1;
+}
+
+static void pushnum(double x)
+{
+  struct psobj o;
+
+  o.type = T_NUM;
+  o.u.num = x;
+  push(&o);
+}
+
+static void pushbool(int b)
+{
+  struct psobj o;
+
+  o.type = T_BOOL;
+  o.u.i = b;
+  push(&o);
+}
+
+static int need(int n)
+/* check that the current operator has n operands */
+{
+  if (sp < n) {
+    pserror("stack underflow at", names[curname].text);
+    sp = 0;
+    return(0);
+  };
+  return(1);
+}
+
+static double popnum()
+{
+  if (!need(1)) {
+    return(0.0);
+  };
+  sp = sp - 1;
+  if (stack[sp].type != T_NUM) {
+    pserror("number expected by", names[curname].text);
+    return(0.0);
+  };
+  return(stack[sp].u.num);
+}
+
+static int popint()
+{
+  double x;
+
+  x = popnum();
+  return((int)floor(x + 0.5));
+}
+
+static int popbool()
+{
+  if (!need(1)) {
+    return(0);
+  };
+  sp = sp - 1;
+  if (stack[sp].type != T_BOOL) {
+    pserror("boolean expected by", names[curname].text);
+    return(0);
+  };
+  return(stack[sp].u.i);
+}
+
+static struct psproc* popproc()
+{
+  if (!need(1)) {
+    return(NULL);
+  };
+  sp = sp - 1;
+  if (stack[sp].type != T_PROC) {
+    pserror("procedure expected by", names[curname].text);
+    return(NULL);
+  };
+  return(stack[sp].u.proc);
+}
+
+static struct psstring* popstring()
+{
+  if (!need(1)) {
+    return(NULL);
+  };
+  sp = sp - 1;
+  if (stack[sp].type != T_STRING) {
+    pserror("string expected by", names[curname].text);
+    return(NULL);
+  };
+  return(stack[sp].u.str);
+}
+
+static int popname()
+/* pop a literal name, returning -1 for anything else */
+{
+  if (!need(1)) {
+    return(-1);
+  };
+  sp = sp - 1;
+  if ((stack[sp].type != T_LITNAME) && (stack[sp].type != T_NAME)) {
+    pserror("name expected by", names[curname].text);
+    return(-1);
+  };
+  return(stack[sp].u.i);
+}
+
+/* execution */
+
+static void execproc(struct psproc* p);
+
+static void execname(int n)
+{
+  struct psname* p;
+
+  p = &names[n];
+  if (!p->defined) {
+    if (!p->warned) {
+      pserror("unknown PostScript name", p->text);
+      p->warned = 1;
+    };
+    return;
+  };
+  switch (p->value.type) {
+  case T_OP:
+    curname = n;
+    (*p->value.u.op)();
+    break;
+  case T_PROC:
+    execproc(p->value.u.proc);
+    break;
+  default:
+    push(&p->value);
+    break;
+  };
+}
+
+static void execproc(struct psproc* p)
+{
+  int i;
+  struct psobj* o;
+
+  if (p == NULL) {
+    return;
+  };
+  for (i=0; (i < p->len) && (!exiting); i++) {
+    o = &p->item[i];
+    if (o->type == T_NAME) {
+      execname(o->u.i);
+    } else {
+      push(o);
+    };
+  };
+}
+
+static int equal(struct psobj* a, struct psobj* b)
+{
+  if (a->type != b->type) {
+    if (((a->type == T_NAME) || (a->type == T_LITNAME)) &&
+        ((b->type == T_NAME) || (b->type == T_LITNAME))) {
+      return(a->u.i == b->u.i);
+    };
+    return(0);
+  };
+  switch (a->type) {
+  case T_NUM:
+    return(a->u.num == b->u.num);
+  case T_STRING:
+    return((a->u.str->len == b->u.str->len) &&
+           (memcmp(a->u.str->text, b->u.str->text, a->u.str->len) == 0));
+  case T_PROC:
+    return(a->u.proc == b->u.proc);
+  case T_OP:
+    return(a->u.op == b->u.op);
+  case T_NULL:
+  case T_MARK:
+    return(1);
+  default:
+    return(a->u.i == b->u.i);
+  };
+}
+
+/* arithmetic, stack and control operators */
+
+static void op_add()
+{
+  double b;
+
+  b = popnum();
+  pushnum(popnum() + b);
+}
+
+static void op_sub()
+{
+  double b;
+
+  b = popnum();
+  pushnum(popnum() - b);
+}
+
+static void op_mul()
+{
+  double b;
+
+  b = popnum();
+  pushnum(popnum() * b);
+}
+
+static void op_div()
+{
+  double a, b;
+
+  b = popnum();
+  a = popnum();
+  if (b == 0.0) {
+    pserror("division by zero in", names[curname].text);
+    pushnum(0.0);
+  } else {
+    pushnum(a / b);
+  };
+}
+
+static void op_neg()
+{
+  pushnum(-popnum());
+}
+
+static void op_abs()
+{
+  pushnum(fabs(popnum()));
+}
+
+static void op_eq()
+{
+  if (need(2)) {
+    sp = sp - 2;
+    pushbool(equal(&stack[sp], &stack[sp+1]));
+  };
+}
+
+static void op_ne()
+{
+  if (need(2)) {
+    sp = sp - 2;
+    pushbool(!equal(&stack[sp], &stack[sp+1]));
+  };
+}
+
+static int compare()
+/* -1, 0 or 1 for the top two numbers on the stack */
+{
+  double a, b;
+
+  b = popnum();
+  a = popnum();
+  if (a < b) {
+    return(-1);
+  };
+  return(a > b);
+}
+
+static void op_lt()
+{
+  pushbool(compare() < 0);
+}
+
+static void op_le()
+{
+  pushbool(compare() <= 0);
+}
+
+static void op_gt()
+{
+  pushbool(compare() > 0);
+}
+
+static void op_ge()
+{
+  pushbool(compare() >= 0);
+}
+
+static void op_not()
+{
+  pushbool(!popbool());
+}
+
+static void op_and()
+{
+  int b;
+
+  b = popbool();
+  pushbool(popbool() && b);
+}
+
+static void op_or()
+{
+  int b;
+
+  b = popbool();
+  pushbool(popbool() || b);
+}
+
+static void op_pop()
+{
+  if (need(1)) {
+    sp = sp - 1;
+  };
+}
+
+static void op_exch()
+{
+  struct psobj o;
+
+  if (need(2)) {
+    o = stack[sp-1];
+    stack[sp-1] = stack[sp-2];
+    stack[sp-2] = o;
+  };
+}
+
+static void op_dup()
+{
+  if (need(1)) {
+    push(&stack[sp-1]);
+  };
+}
+
+static void op_copy()
+{
+  int n, i;
+
+  n = popint();
+  if ((n < 0) || (!need(n)) || (sp + n > MAXSTACK)) {
+    return;
+  };
+  for (i=0; i<n; i++) {
+    stack[sp+i] = stack[sp-n+i];
+  };
+  sp = sp + n;
+}
+
+static void op_index()
+{
+  int n;
+
+  n = popint();
+  if ((n >= 0) && (need(n+1))) {
+    push(&stack[sp-1-n]);
+  };
+}
+
+static void op_roll()
+{
+  int n, j, i;
+  struct psobj o;
+
+  j = popint();
+  n = popint();
+  if ((n <= 0) || (!need(n))) {
+    return;
+  };
+  j = j % n;
+  if (j < 0) {
+    j = j + n;
+  };
+  while (j > 0) {
+    o = stack[sp-1];
+    for (i=sp-1; i>sp-n; i--) {
+      stack[i] = stack[i-1];
+    };
+    stack[sp-n] = o;
+    j = j - 1;
+  };
+}
+
+static void op_mark()
+{
+  struct psobj o;
+
+  o.type = T_MARK;
+  o.u.i = 0;
+  push(&o);
+}
+
+static void op_counttomark()
+{
+  int i;
+
+  i = sp - 1;
+  while ((i >= 0) && (stack[i].type != T_MARK)) {
+    i = i - 1;
+  };
+  if (i < 0) {
+    pserror("no mark for", names[curname].text);
+    pushnum(0.0);
+  } else {
+    pushnum((double)(sp - 1 - i));
+  };
+}
+
+static void op_if()
+{
+  struct psproc* p;
+
+  p = popproc();
+  if (popbool()) {
+    execproc(p);
+  };
+}
+
+static void op_ifelse()
+{
+  struct psproc* p1;
+  struct psproc* p2;
+
+  p2 = popproc();
+  p1 = popproc();
+  if (popbool()) {
+    execproc(p1);
+  } else {
+    execproc(p2);
+  };
+}
+
+static void op_repeat()
+{
+  struct psproc* p;
+  int n;
+
+  p = popproc();
+  n = popint();
+  while ((n > 0) && (!exiting) && (p != NULL)) {
+    execproc(p);
+    n = n - 1;
+  };
+  exiting = 0;
+}
+
+static void op_loop()
+{
+  struct psproc* p;
+  long n;
+
+  p = popproc();
+  n = 0;
+  while ((!exiting) && (p != NULL)) {
+    execproc(p);
+    n = n + 1;
+    if (n > 1000000L) {
+      pserror("endless loop in", names[curname].text);
+      break;
+    };
+  };
+  exiting = 0;
+}
+
+static void op_exit()
+{
+  exiting = 1;
+}
+
+static void op_for()
+{
+  struct psproc* p;
+  double i, step, limit;
+
+  p = popproc();
+  limit = popnum();
+  step = popnum();
+  i = popnum();
+  if ((step == 0.0) || (p == NULL)) {
+    return;
+  };
+  while ((!exiting) && ((step > 0.0) ? (i <= limit) : (i >= limit))) {
+    pushnum(i);
+    execproc(p);
+    i = i + step;
+  };
+  exiting = 0;
+}
+
+static void op_def()
+{
+  struct psobj o;
+  int n;
+
+  if (!need(2)) {
+    return;
+  };
+  o = stack[sp-1];
+  sp = sp - 1;
+  n = popname();
+  /* entries of a font dictionary being built are not needed */
+  if ((n != -1) && (dictdepth == 0)) {
+    names[n].value = o;
+    names[n].defined = 1;
+  };
+}
+
+static void op_store()
+{
+  struct psobj o;
+  int n;
+
+  if (!need(2)) {
+    return;
+  };
+  o = stack[sp-1];
+  sp = sp - 1;
+  n = popname();
+  if (n != -1) {
+    names[n].value = o;
+    names[n].defined = 1;
+  };
+}
+
+static void op_bind()
+{
+}
+
+static void op_string()
+{
+  struct psobj o;
+  int n;
+
+  n = popint();
+  if (n < 0) {
+    n = 0;
+  };
+  o.type = T_STRING;
+  o.u.str = (struct psstring*)arena(sizeof(struct psstring));
+  o.u.str->len = n;
+  o.u.str->text = (unsigned char*)arena(n + 1);
+  memset(o.u.str->text, 0, n + 1);
+  push(&o);
+}
+
+static void op_cvs()
+{
+  struct psstring* s;
+  struct psobj o;
+  char text[40];
+  int n;
+
+  s = popstring();
+  if ((s == NULL) || (!need(1))) {
+    return;
+  };
+  sp = sp - 1;
+  o = stack[sp];
+  switch (o.type) {
+  case T_NUM:
+    if ((o.u.num == floor(o.u.num)) && (fabs(o.u.num) < 1.0e9)) {
+      sprintf(text, "%ld", (long)o.u.num);
+    } else {
+      sprintf(text, "%g", o.u.num);
+    };
+    break;
+  case T_BOOL:
+    strcpy(text, o.u.i ? "true" : "false");
+    break;
+  case T_NAME:
+  case T_LITNAME:
+    strncpy(text, names[o.u.i].text, 39);
+    text[39] = '\0';
+    break;
+  default:
+    strcpy(text, "--nostringval--");
+    break;
+  };
+  n = strlen(text);
+  if (n > s->len) {
+    n = s->len;
+  };
+  memcpy(s->text, text, n);
+  o.type = T_STRING;
+  o.u.str = (struct psstring*)arena(sizeof(struct psstring));
+  o.u.str->len = n;
+  o.u.str->text = s->text;
+  push(&o);
+}
+
+static void op_length()
+{
+  if (!need(1)) {
+    return;
+  };
+  sp = sp - 1;
+  switch (stack[sp].type) {
+  case T_STRING:
+    pushnum((double)stack[sp].u.str->len);
+    break;
+  case T_PROC:
+    pushnum((double)stack[sp].u.proc->len);
+    break;
+  case T_LITNAME:
+    pushnum((double)strlen(names[stack[sp].u.i].text));
+    break;
+  default:
+    /* size of a font dictionary */
+    pushnum(20.0);
+    break;
+  };
+}
+
+/* font operators */
+/* A font is just the standard PDF font it maps to. The dictionary */
+/* operators only support re-encoding a font, as done by setISOfont. */
+
+static void pushfont(int font)
+{
+  struct psobj o;
+
+  o.type = T_FONT;
+  o.u.i = font;
+  push(&o);
+}
+
+static int namedfont(int n)
+{
+  if (names[n].font != -1) {
+    return(names[n].font);
+  };
+  return(stdfont(names[n].text));
+}
+
+static void op_findfont()
+{
+  int n;
+
+  n = popname();
+  if (n != -1) {
+    pushfont(namedfont(n));
+  };
+}
+
+static void op_dict()
+{
+  popnum();
+  pushfont(-1);
+}
+
+static void op_begin()
+{
+  if (!need(1)) {
+    return;
+  };
+  sp = sp - 1;
+  if (dictdepth < MAXDICTS) {
+    dictstack[dictdepth] = (stack[sp].type == T_FONT) ? stack[sp].u.i : -1;
+    dictdepth = dictdepth + 1;
+  };
+}
+
+static void op_end()
+{
+  if (dictdepth > 0) {
+    dictdepth = dictdepth - 1;
+  };
+}
+
+static void op_currentdict()
+{
+  pushfont((dictdepth > 0) ? dictstack[dictdepth-1] : -1);
+}
+
+static void op_forall()
+{
+  popproc();
+  if (!need(1)) {
+    return;
+  };
+  sp = sp - 1;
+  /* copying a font into the current dictionary */
+  if ((stack[sp].type == T_FONT) && (dictdepth > 0)) {
+    dictstack[dictdepth-1] = stack[sp].u.i;
+  };
+}
+
+static void op_definefont()
+{
+  int n, font;
+
+  if (!need(2)) {
+    return;
+  };
+  sp = sp - 1;
+  font = (stack[sp].type == T_FONT) ? stack[sp].u.i : -1;
+  n = popname();
+  if (n == -1) {
+    return;
+  };
+  if (font == -1) {
+    font = stdfont(names[n].text);
+  };
+  names[n].font = font;
+  pushfont(font);
+}
+
+static void op_selectfont()
+{
+  double size;
+
+  size = popnum();
+  if (!need(1)) {
+    return;
+  };
+  sp = sp - 1;
+  if (stack[sp].type == T_FONT) {
+    gs.font = (stack[sp].u.i == -1) ? 0 : stack[sp].u.i;
+  } else {
+    if ((stack[sp].type == T_LITNAME) || (stack[sp].type == T_NAME)) {
+      gs.font = namedfont(stack[sp].u.i);
+    } else {
+      pserror("font expected by", names[curname].text);
+      return;
+    };
+  };
+  gs.fontsize = size;
+}
+
+/* path construction - the path is kept in device space */
+
+static void addpath(int op, double* pts, int n)
+/* add segment op with n device space points to the path */
+{
+  int i;
+
+  if ((op == 'm') && (pathlen > 0) && (pathop[pathlen-1] == 'm')) {
+    /* a moveto replaces the one before it */
+    pathlen = pathlen - 1;
+    pointcount = pointcount - 1;
+  };
+  if (pathlen >= opsize) {
+    opsize = 2 * opsize + 64;
+    pathop = (char*)checkrealloc(pathop, opsize);
+  };
+  if (pointcount + n > ptsize) {
+    ptsize = 2 * ptsize + 64;
+    pathpt = (double*)checkrealloc(pathpt, 2 * ptsize * sizeof(double));
+  };
+  pathop[pathlen] = (char)op;
+  pathlen = pathlen + 1;
+  for (i=0; i<2*n; i++) {
+    pathpt[2*pointcount+i] = pts[i];
+  };
+  pointcount = pointcount + n;
+}
+
+static void transform(double x, double y, double* out)
+{
+  out[0] = gs.ctm[0]*x + gs.ctm[2]*y + gs.ctm[4];
+  out[1] = gs.ctm[1]*x + gs.ctm[3]*y + gs.ctm[5];
+}
+
+static void dtransform(double dx, double dy, double* out)
+/* move relative to the current point */
+{
+  out[0] = gs.x + gs.ctm[0]*dx + gs.ctm[2]*dy;
+  out[1] = gs.y + gs.ctm[1]*dx + gs.ctm[3]*dy;
+}
+
+static void moveto(double* p)
+{
+  addpath('m', p, 1);
+  gs.havepoint = 1;
+  gs.x = p[0];
+  gs.y = p[1];
+  gs.startx = p[0];
+  gs.starty = p[1];
+}
+
+static void lineto(double* p)
+{
+  if (!gs.havepoint) {
+    pserror("no current point at", names[curname].text);
+    return;
+  };
+  addpath('l', p, 1);
+  gs.x = p[0];
+  gs.y = p[1];
+}
+
+static void curveto(double* p)
+{
+  if (!gs.havepoint) {
+    pserror("no current point at", names[curname].text);
+    return;
+  };
+  addpath('c', p, 3);
+  gs.x = p[4];
+  gs.y = p[5];
+}
+
+static void newpath()
+{
+  pathlen = 0;
+  pointcount = 0;
+  gs.havepoint = 0;
+}
+
+static void op_moveto()
+{
+  double p[2], x, y;
+
+  y = popnum();
+  x = popnum();
+  transform(x, y, p);
+  moveto(p);
+}
+
+static void op_rmoveto()
+{
+  double p[2], x, y;
+
+  y = popnum();
+  x = popnum();
+  if (!gs.havepoint) {
+    pserror("no current point at", names[curname].text);
+    return;
+  };
+  dtransform(x, y, p);
+  moveto(p);
+}
+
+static void op_lineto()
+{
+  double p[2], x, y;
+
+  y = popnum();
+  x = popnum();
+  transform(x, y, p);
+  lineto(p);
+}
+
+static void op_rlineto()
+{
+  double p[2], x, y;
+
+  y = popnum();
+  x = popnum();
+  dtransform(x, y, p);
+  lineto(p);
+}
+
+static void op_curveto()
+{
+  double a[6], p[6];
+  int i;
+
+  for (i=5; i>=0; i--) {
+    a[i] = popnum();
+  };
+  for (i=0; i<6; i=i+2) {
+    transform(a[i], a[i+1], &p[i]);
+  };
+  curveto(p);
+}
+
+static void op_rcurveto()
+{
+  double a[6], p[6];
+  int i;
+
+  for (i=5; i>=0; i--) {
+    a[i] = popnum();
+  };
+  for (i=0; i<6; i=i+2) {
+    dtransform(a[i], a[i+1], &p[i]);
+  };
+  curveto(p);
+}
+
+static void op_arc()
+/* counterclockwise arc drawn as Bezier curves of at most 90 degrees */
+{
+  double x, y, r, a1, a2, step, k, c1, s1, c2, s2;
+  double p[6];
+  int n, i;
+
+  a2 = popnum();
+  a1 = popnum();
+  r = popnum();
+  y = popnum();
+  x = popnum();
+  while (a2 < a1) {
+    a2 = a2 + 360.0;
+  };
+  n = (int)ceil((a2 - a1) / 90.0);
+  if (n < 1) {
+    n = 1;
+  };
+  step = (a2 - a1) / n * M_PI / 180.0;
+  k = 4.0 / 3.0 * tan(step / 4.0);
+  a1 = a1 * M_PI / 180.0;
+  c1 = cos(a1);
+  s1 = sin(a1);
+  transform(x + r*c1, y + r*s1, p);
+  if (gs.havepoint) {
+    lineto(p);
+  } else {
+    moveto(p);
+  };
+  for (i=0; i<n; i++) {
+    c2 = cos(a1 + (i+1) * step);
+    s2 = sin(a1 + (i+1) * step);
+    transform(x + r*(c1 - k*s1), y + r*(s1 + k*c1), &p[0]);
+    transform(x + r*(c2 + k*s2), y + r*(s2 - k*c2), &p[2]);
+    transform(x + r*c2, y + r*s2, &p[4]);
+    curveto(p);
+    c1 = c2;
+    s1 = s2;
+  };
+}
+
+static void op_closepath()
+{
+  if ((pathlen > 0) && (pathop[pathlen-1] != 'h')) {
+    addpath('h', NULL, 0);
+    gs.x = gs.startx;
+    gs.y = gs.starty;
+  };
+}
+
+static void op_newpath()
+{
+  newpath();
+}
+
+static void op_currentpoint()
+/* current point back in user space */
+{
+  double det, dx, dy;
+
+  if (!gs.havepoint) {
+    pserror("no current point at", names[curname].text);
+    pushnum(0.0);
+    pushnum(0.0);
+    return;
+  };
+  det = gs.ctm[0]*gs.ctm[3] - gs.ctm[1]*gs.ctm[2];
+  dx = gs.x - gs.ctm[4];
+  dy = gs.y - gs.ctm[5];
+  pushnum((gs.ctm[3]*dx - gs.ctm[2]*dy) / det);
+  pushnum((gs.ctm[0]*dy - gs.ctm[1]*dx) / det);
+}
+
+/* graphics state */
+
+static void op_gsave()
+{
+  if (gdepth >= MAXGSAVE) {
+    pserror("too many gsave at", names[curname].text);
+    return;
+  };
+  saved[gdepth] = gs;
+  saved[gdepth].pathlen = pathlen;
+  saved[gdepth].pointcount = pointcount;
+  saved[gdepth].pathop = NULL;
+  saved[gdepth].pathpt = NULL;
+  if (pathlen > 0) {
+    saved[gdepth].pathop = (char*)checkmalloc(pathlen);
+    memcpy(saved[gdepth].pathop, pathop, pathlen);
+    saved[gdepth].pathpt = (double*)checkmalloc(2 * pointcount *
+                                                sizeof(double));
+    memcpy(saved[gdepth].pathpt, pathpt, 2 * pointcount * sizeof(double));
+  };
+  gdepth = gdepth + 1;
+}
+
+static void op_grestore()
+{
+  if (gdepth == 0) {
+    return;
+  };
+  gdepth = gdepth - 1;
+  gs = saved[gdepth];
+  pathlen = gs.pathlen;
+  pointcount = gs.pointcount;
+  if (pathlen > 0) {
+    memcpy(pathop, gs.pathop, pathlen);
+    memcpy(pathpt, gs.pathpt, 2 * pointcount * sizeof(double));
+    free(gs.pathop);
+    free(gs.pathpt);
+  };
+  gs.pathop = NULL;
+  gs.pathpt = NULL;
+}
+
+static void concat(double a, double b, double c, double d, double e, double f)
+/* ctm = [a b c d e f] x ctm */
+{
+  double m[6];
+
+  m[0] = a*gs.ctm[0] + b*gs.ctm[2];
+  m[1] = a*gs.ctm[1] + b*gs.ctm[3];
+  m[2] = c*gs.ctm[0] + d*gs.ctm[2];
+  m[3] = c*gs.ctm[1] + d*gs.ctm[3];
+  m[4] = e*gs.ctm[0] + f*gs.ctm[2] + gs.ctm[4];
+  m[5] = e*gs.ctm[1] + f*gs.ctm[3] + gs.ctm[5];
+  memcpy(gs.ctm, m, sizeof(m));
+}
+
+static void op_translate()
+{
+  double x, y;
+
+  y = popnum();
+  x = popnum();
+  concat(1.0, 0.0, 0.0, 1.0, x, y);
+}
+
+static void op_scale()
+{
+  double x, y;
+
+  y = popnum();
+  x = popnum();
+  concat(x, 0.0, 0.0, y, 0.0, 0.0);
+}
+
+static void op_rotate()
+{
+  double a, c, s;
+
+  a = popnum();
+  /* keep right angles exact */
+  if (fmod(a, 90.0) == 0.0) {
+    switch (((int)fmod(a, 360.0) + 360) % 360) {
+    case 90:
+      c = 0.0;
+      s = 1.0;
+      break;
+    case 180:
+      c = -1.0;
+      s = 0.0;
+      break;
+    case 270:
+      c = 0.0;
+      s = -1.0;
+      break;
+    default:
+      c = 1.0;
+      s = 0.0;
+      break;
+    };
+  } else {
+    c = cos(a * M_PI / 180.0);
+    s = sin(a * M_PI / 180.0);
+  };
+  concat(c, s, -s, c, 0.0, 0.0);
+}
+
+static void op_setlinewidth()
+{
+  gs.linewidth = popnum();
+}
+
+static void op_setlinecap()
+{
+  gs.cap = popint();
+}
+
+static void op_setlinejoin()
+{
+  gs.join = popint();
+}
+
+static void op_setrgbcolor()
+{
+  gs.rgb[2] = popnum();
+  gs.rgb[1] = popnum();
+  gs.rgb[0] = popnum();
+}
+
+static void op_setgray()
+{
+  gs.rgb[0] = gs.rgb[1] = gs.rgb[2] = popnum();
+}
+
+/* painting */
+
+static void setcolor(double* rgb, double* current, char* op)
+/* bring the fill or stroke colour of the content stream up to date */
+{
+  if ((rgb[0] == current[0]) && (rgb[1] == current[1]) &&
+      (rgb[2] == current[2])) {
+    return;
+  };
+  if ((rgb[0] == rgb[1]) && (rgb[1] == rgb[2])) {
+    bufnum(&page, rgb[0], 4);
+    bufstr(&page, (op[0] == 'r') ? "g\n" : "G\n");
+  } else {
+    bufnum(&page, rgb[0], 4);
+    bufnum(&page, rgb[1], 4);
+    bufnum(&page, rgb[2], 4);
+    bufstr(&page, op);
+    bufstr(&page, "\n");
+  };
+  current[0] = rgb[0];
+  current[1] = rgb[1];
+  current[2] = rgb[2];
+}
+
+static void writepath(struct pdfbuf* b, int user)
+/* write the current path, converted back to user space if user is set */
+{
+  int i, j, k, n;
+  double det, dx, dy, x, y;
+
+  det = gs.ctm[0]*gs.ctm[3] - gs.ctm[1]*gs.ctm[2];
+  j = 0;
+  for (i=0; i<pathlen; i++) {
+    n = (pathop[i] == 'c') ? 3 : ((pathop[i] == 'h') ? 0 : 1);
+    for (k=0; k<n; k++) {
+      x = pathpt[j];
+      y = pathpt[j+1];
+      if (user) {
+        dx = x - gs.ctm[4];
+        dy = y - gs.ctm[5];
+        x = (gs.ctm[3]*dx - gs.ctm[2]*dy) / det;
+        y = (gs.ctm[0]*dy - gs.ctm[1]*dx) / det;
+      };
+      bufnum(b, x, 2);
+      bufnum(b, y, 2);
+      j = j + 2;
+    };
+    switch (pathop[i]) {
+    case 'm':
+      bufstr(b, "m\n");
+      break;
+    case 'l':
+      bufstr(b, "l\n");
+      break;
+    case 'c':
+      bufstr(b, "c\n");
+      break;
+    default:
+      bufstr(b, "h\n");
+      break;
+    };
+  };
+}
+
+static void drawglyph(struct glyph* g)
+{
+  bufstr(&page, "q 1 0 0 1 ");
+  bufnum(&page, pathpt[0], 2);
+  bufnum(&page, pathpt[1], 2);
+  bufstr(&page, "cm /G");
+  bufnum(&page, (double)g->number, 2);
+  bufstr(&page, "Do Q\n");
+}
+
+static void op_fill()
+{
+  struct glyph* g;
+
+  if (pathlen > 0) {
+    setcolor(gs.rgb, fillrgb, "rg");
+    g = NULL;
+    if (pointcount >= GLYPHMIN) {
+      g = findglyph(0, 0.0);
+    };
+    if (g != NULL) {
+      drawglyph(g);
+    } else {
+      writepath(&page, 0);
+      bufstr(&page, "f\n");
+    };
+  };
+  newpath();
+}
+
+static void op_stroke()
+{
+  double width;
+  struct glyph* g;
+  int i;
+
+  if (pathlen == 0) {
+    newpath();
+    return;
+  };
+  setcolor(gs.rgb, strokergb, "RG");
+  if (gs.cap != setcap) {
+    bufnum(&page, (double)gs.cap, 2);
+    bufstr(&page, "J\n");
+    setcap = gs.cap;
+  };
+  if (gs.join != setjoin) {
+    bufnum(&page, (double)gs.join, 2);
+    bufstr(&page, "j\n");
+    setjoin = gs.join;
+  };
+  if ((fabs(gs.ctm[0] - gs.ctm[3]) < 1.0e-6) &&
+      (fabs(gs.ctm[1] + gs.ctm[2]) < 1.0e-6)) {
+    /* line width is the same in every direction */
+    width = gs.linewidth *
+            sqrt(fabs(gs.ctm[0]*gs.ctm[3] - gs.ctm[1]*gs.ctm[2]));
+    g = NULL;
+    if (pointcount >= GLYPHMIN) {
+      g = findglyph(1, width);
+    };
+    if (g != NULL) {
+      drawglyph(g);
+    } else {
+      if (width != setwidth) {
+        bufnum(&page, width, 2);
+        bufstr(&page, "w\n");
+        setwidth = width;
+      };
+      writepath(&page, 0);
+      bufstr(&page, "S\n");
+    };
+  } else {
+    /* stroke in user space so that the pen is transformed too */
+    bufstr(&page, "q ");
+    for (i=0; i<4; i++) {
+      bufnum(&page, gs.ctm[i], 4);
+    };
+    bufnum(&page, gs.ctm[4], 2);
+    bufnum(&page, gs.ctm[5], 2);
+    bufstr(&page, "cm\n");
+    bufnum(&page, gs.linewidth, 2);
+    bufstr(&page, "w\n");
+    writepath(&page, 1);
+    bufstr(&page, "S Q\n");
+  };
+  newpath();
+}
+
+/* text */
+
+static void showtext(unsigned char* s, int len)
+/* show s at the current point and move the current point past it */
+{
+  double w;
+
+  if (!gs.havepoint) {
+    pserror("no current point at", names[curname].text);
+    return;
+  };
+  if (gs.font == -1) {
+    pserror("no current font at", names[curname].text);
+    return;
+  };
+  setcolor(gs.rgb, fillrgb, "rg");
+  fontused[gs.font] = 1;
+  bufstr(&page, "BT /F");
+  bufnum(&page, (double)gs.font, 2);
+  if ((gs.ctm[1] == 0.0) && (gs.ctm[2] == 0.0) && (gs.ctm[0] == gs.ctm[3])
+      && (gs.ctm[0] > 0.0)) {
+    bufnum(&page, gs.fontsize * gs.ctm[0], 2);
+    bufstr(&page, "Tf ");
+    bufnum(&page, gs.x, 2);
+    bufnum(&page, gs.y, 2);
+    bufstr(&page, "Td ");
+  } else {
+    bufstr(&page, "1 Tf ");
+    bufnum(&page, gs.fontsize * gs.ctm[0], 4);
+    bufnum(&page, gs.fontsize * gs.ctm[1], 4);
+    bufnum(&page, gs.fontsize * gs.ctm[2], 4);
+    bufnum(&page, gs.fontsize * gs.ctm[3], 4);
+    bufnum(&page, gs.x, 2);
+    bufnum(&page, gs.y, 2);
+    bufstr(&page, "Tm ");
+  };
+  bufpdfstring(&page, s, len);
+  bufstr(&page, "Tj ET\n");
+  w = textwidth(gs.font, s, len) * gs.fontsize;
+  gs.x = gs.x + gs.ctm[0] * w;
+  gs.y = gs.y + gs.ctm[1] * w;
+}
+
+static void op_show()
+{
+  struct psstring* s;
+
+  s = popstring();
+  if ((s != NULL) && (s->len > 0)) {
+    showtext(s->text, s->len);
+  };
+}
+
+static void op_stringwidth()
+{
+  struct psstring* s;
+
+  s = popstring();
+  if ((s != NULL) && (gs.font != -1)) {
+    pushnum(textwidth(gs.font, s->text, s->len) * gs.fontsize);
+  } else {
+    pushnum(0.0);
+  };
+  pushnum(0.0);
+}
+
+static void op_widthshow()
+/* show string, moving by cx cy after each occurrence of char */
+{
+  struct psstring* s;
+  double cx, cy, p[2];
+  int c, i, start;
+
+  s = popstring();
+  c = popint();
+  cy = popnum();
+  cx = popnum();
+  if (s == NULL) {
+    return;
+  };
+  start = 0;
+  for (i=0; i<s->len; i++) {
+    if (s->text[i] == c) {
+      showtext(s->text + start, i + 1 - start);
+      if (!gs.havepoint) {
+        return;
+      };
+      dtransform(cx, cy, p);
+      gs.x = p[0];
+      gs.y = p[1];
+      start = i + 1;
+    };
+  };
+  if (start < s->len) {
+    showtext(s->text + start, s->len - start);
+  };
+}
+
+/* pages */
+
+static void initgraphics()
+{
+  gs.ctm[0] = 1.0;
+  gs.ctm[1] = 0.0;
+  gs.ctm[2] = 0.0;
+  gs.ctm[3] = 1.0;
+  gs.ctm[4] = 0.0;
+  gs.ctm[5] = 0.0;
+  gs.linewidth = 1.0;
+  gs.cap = 0;
+  gs.join = 0;
+  gs.rgb[0] = gs.rgb[1] = gs.rgb[2] = 0.0;
+  newpath();
+  /* the defaults of a PDF content stream */
+  fillrgb[0] = fillrgb[1] = fillrgb[2] = 0.0;
+  strokergb[0] = strokergb[1] = strokergb[2] = 0.0;
+  setwidth = 1.0;
+  setcap = 0;
+  setjoin = 0;
+}
+
+static void endpage()
+/* write the content stream and page object for the current page */
+{
+  int contents, pg;
+
+  contents = newobj();
+  writestream(contents, "", &page);
+  page.len = 0;
+  pg = newobj();
+  startobj(pg);
+  pdfprintf("<< /Type /Page /Parent 2 0 R /MediaBox [%d %d %d %d]",
+            (int)mediabox[0], (int)mediabox[1], (int)mediabox[2],
+            (int)mediabox[3]);
+  if (landscape) {
+    pdfprintf(" /Rotate 90");
+  };
+  pdfprintf("\n/Resources 3 0 R /Contents %d 0 R >>\nendobj\n", contents);
+  if (pagecount >= kidsize) {
+    kidsize = 2 * kidsize + 64;
+    kids = (int*)checkrealloc(kids, kidsize * sizeof(int));
+  };
+  kids[pagecount] = pg;
+  pagecount = pagecount + 1;
+}
+
+static void op_showpage()
+{
+  endpage();
+  while (gdepth > 0) {
+    op_grestore();
+  };
+  initgraphics();
+}
+
+struct psop {
+  char* name;
+  void (*fn)(void);
+};
+
+static struct psop ops[] = {
+  {"add", op_add}, {"sub", op_sub}, {"mul", op_mul}, {"div", op_div},
+  {"neg", op_neg}, {"abs", op_abs}, {"eq", op_eq}, {"ne", op_ne},
+  {"lt", op_lt}, {"le", op_le}, {"gt", op_gt}, {"ge", op_ge},
+  {"not", op_not}, {"and", op_and}, {"or", op_or},
+  {"pop", op_pop}, {"exch", op_exch}, {"dup", op_dup}, {"copy", op_copy},
+  {"index", op_index}, {"roll", op_roll}, {"mark", op_mark},
+  {"counttomark", op_counttomark},
+  {"if", op_if}, {"ifelse", op_ifelse}, {"repeat", op_repeat},
+  {"loop", op_loop}, {"exit", op_exit}, {"for", op_for},
+  {"def", op_def}, {"store", op_store}, {"bind", op_bind},
+  {"string", op_string}, {"cvs", op_cvs}, {"length", op_length},
+  {"findfont", op_findfont}, {"dict", op_dict}, {"begin", op_begin},
+  {"end", op_end}, {"currentdict", op_currentdict}, {"forall", op_forall},
+  {"definefont", op_definefont}, {"selectfont", op_selectfont},
+  {"moveto", op_moveto}, {"rmoveto", op_rmoveto}, {"lineto", op_lineto},
+  {"rlineto", op_rlineto}, {"curveto", op_curveto},
+  {"rcurveto", op_rcurveto}, {"arc", op_arc}, {"closepath", op_closepath},
+  {"newpath", op_newpath}, {"currentpoint", op_currentpoint},
+  {"gsave", op_gsave}, {"grestore", op_grestore},
+  {"translate", op_translate}, {"scale", op_scale}, {"rotate", op_rotate},
+  {"setlinewidth", op_setlinewidth}, {"setlinecap", op_setlinecap},
+  {"setlinejoin", op_setlinejoin}, {"setrgbcolor", op_setrgbcolor},
+  {"setgray", op_setgray}, {"fill", op_fill}, {"stroke", op_stroke},
+  {"show", op_show}, {"stringwidth", op_stringwidth},
+  {"widthshow", op_widthshow}, {"showpage", op_showpage},
+  {NULL, NULL}
+};
+
+static void defineops()
+{
+  int i, n;
+
+  for (i=0; ops[i].name != NULL; i++) {
+    n = findname(ops[i].name, strlen(ops[i].name));
+    names[n].value.type = T_OP;
+    names[n].value.u.op = ops[i].fn;
+    names[n].defined = 1;
+  };
+  n = findname("true", 4);
+  names[n].value.type = T_BOOL;
+  names[n].value.u.i = 1;
+  names[n].defined = 1;
+  n = findname("false", 5);
+  names[n].value.type = T_BOOL;
+  names[n].value.u.i = 0;
+  names[n].defined = 1;
+  /* only ever stored in a font dictionary */
+  n = findname("ISOLatin1Encoding", 17);
+  names[n].defined = 1;
+}
+
+/* reading PostScript */
+
+static char* tokbuf;
+static int toksize;
+
+static int nextch()
+{
+  if (inpos >= inlen) {
+    inlen = fread(inbuf, 1, sizeof(inbuf), psin);
+    inpos = 0;
+    if (inlen <= 0) {
+      inlen = 0;
+      return(EOF);
+    };
+  };
+  return(inbuf[inpos++]);
+}
+
+static void tokchar(int len, int c)
+{
+  if (len >= toksize) {
+    toksize = 2 * toksize + 256;
+    tokbuf = (char*)checkrealloc(tokbuf, toksize);
+  };
+  tokbuf[len] = (char)c;
+}
+
+static int isdelim(int c)
+{
+  return((c == EOF) || (c == ' ') || (c == '\n') || (c == '\r') ||
+         (c == '\t') || (c == '\f') || (strchr("()<>[]{}/%", c) != NULL));
+}
+
+static void readstring(struct psobj* o)
+/* string up to the matching ) */
+{
+  int c, len, depth, code, i;
+
+  len = 0;
+  depth = 1;
+  c = nextch();
+  while (c != EOF) {
+    if (c == '\\') {
+      c = nextch();
+      switch (c) {
+      case 'n':
+        c = '\n';
+        break;
+      case 'r':
+        c = '\r';
+        break;
+      case 't':
+        c = '\t';
+        break;
+      case 'b':
+        c = '\b';
+        break;
+      case 'f':
+        c = '\f';
+        break;
+      case '\n':
+        c = nextch();
+        continue;
+      default:
+        if ((c >= '0') && (c <= '7')) {
+          code = c - '0';
+          for (i=0; i<2; i++) {
+            c = nextch();
+            if ((c >= '0') && (c <= '7')) {
+              code = code * 8 + c - '0';
+            } else {
+              if (c != EOF) {
+                inpos = inpos - 1;
+              };
+              break;
+            };
+          };
+          c = code & 0xff;
+        };
+        break;
+      };
+      if (c == EOF) {
+        break;
+      };
+    } else {
+      if (c == '(') {
+        depth = depth + 1;
+      };
+      if (c == ')') {
+        depth = depth - 1;
+        if (depth == 0) {
+          break;
+        };
+      };
+    };
+    tokchar(len, c);
+    len = len + 1;
+    c = nextch();
+  };
+  o->type = T_STRING;
+  o->u.str = (struct psstring*)arena(sizeof(struct psstring));
+  o->u.str->len = len;
+  o->u.str->text = (unsigned char*)arena(len + 1);
+  memcpy(o->u.str->text, tokbuf, len);
+  o->u.str->text[len] = '\0';
+}
+
+static int readtoken(struct psobj* o);
+
+static void readproc(struct psobj* o)
+/* procedure up to the matching } */
+{
+  struct psobj item;
+  struct psobj* items;
+  int n, size, r;
+
+  items = NULL;
+  n = 0;
+  size = 0;
+  while ((r = readtoken(&item)) == 1) {
+    if (n >= size) {
+      size = 2 * size + 16;
+      items = (struct psobj*)checkrealloc(items, size * sizeof(struct psobj));
+    };
+    items[n] = item;
+    n = n + 1;
+  };
+  if (r == 0) {
+    pserror("unterminated procedure", "");
+  };
+  o->type = T_PROC;
+  o->u.proc = (struct psproc*)arena(sizeof(struct psproc));
+  o->u.proc->len = n;
+  o->u.proc->item = (struct psobj*)arena(n * sizeof(struct psobj) + 1);
+  if (n > 0) {
+    memcpy(o->u.proc->item, items, n * sizeof(struct psobj));
+  };
+  if (items != NULL) {
+    free(items);
+  };
+}
+
+static int readtoken(struct psobj* o)
+/* returns 1 for an object, 2 for the end of a procedure, 0 at the end */
+{
+  int c, len, literal, base;
+  char* end;
+  char* hash;
+  double x;
+
+  c = nextch();
+  for (;;) {
+    if (c == EOF) {
+      return(0);
+    };
+    if (c == '%') {
+      while ((c != '\n') && (c != '\r') && (c != EOF)) {
+        c = nextch();
+      };
+    } else {
+      if ((c != ' ') && (c != '\n') && (c != '\r') && (c != '\t') &&
+          (c != '\f')) {
+        break;
+      };
+      c = nextch();
+    };
+  };
+  switch (c) {
+  case '(':
+    readstring(o);
+    return(1);
+  case '{':
+    readproc(o);
+    return(1);
+  case '}':
+    return(2);
+  default:
+    break;
+  };
+  literal = 0;
+  len = 0;
+  if (c == '/') {
+    literal = 1;
+    c = nextch();
+  } else {
+    if (strchr("[]<>", c) != NULL) {
+      tokchar(0, c);
+      o->type = T_NAME;
+      o->u.i = findname(tokbuf, 1);
+      return(1);
+    };
+  };
+  while (!isdelim(c)) {
+    tokchar(len, c);
+    len = len + 1;
+    c = nextch();
+  };
+  if (c != EOF) {
+    inpos = inpos - 1;
+  };
+  tokchar(len, '\0');
+  if ((!literal) && (len > 0) && (strchr("0123456789+-.", tokbuf[0]) != NULL)) {
+    x = strtod(tokbuf, &end);
+    if ((end == tokbuf + len) && (end != tokbuf)) {
+      o->type = T_NUM;
+      o->u.num = x;
+      return(1);
+    };
+    hash = strchr(tokbuf, '#');
+    if (hash != NULL) {
+      base = atoi(tokbuf);
+      if ((base >= 2) && (base <= 36)) {
+        x = (double)strtol(hash + 1, &end, base);
+        if ((end == tokbuf + len) && (end != hash + 1)) {
+          o->type = T_NUM;
+          o->u.num = x;
+          return(1);
+        };
+      };
+    };
+  };
+  o->type = literal ? T_LITNAME : T_NAME;
+  o->u.i = findname(tokbuf, len);
+  return(1);
+}
+
+static void interpret()
+{
+  struct psobj o;
+  int r;
+
+  while ((r = readtoken(&o)) != 0) {
+    if (r == 2) {
+      pserror("unexpected", "}");
+    } else {
+      if (o.type == T_NAME) {
+        execname(o.u.i);
+      } else {
+        push(&o);
+      };
+      exiting = 0;
+    };
+  };
+}
+
+/* the file as a whole */
+
+static void startpdf(FILE* f, struct bbox* boundingbox)
+{
+  int i;
+
+  pdffile = f;
+  pdfpos = 0;
+  compress = pdf_compress;
+  namecount = 0;
+  for (i=0; i<NAMEHASH; i++) {
+    namehash[i] = -1;
+  };
+  defineops();
+  glyphhash = (int*)checkmalloc(GLYPHHASH * sizeof(int));
+  for (i=0; i<GLYPHHASH; i++) {
+    glyphhash[i] = -1;
+  };
+  glyphcount = 0;
+  xobjects = 0;
+  objcount = 0;
+  /* object 0 is always free; 1 to 4 are written at the end */
+  for (i=0; i<5; i++) {
+    newobj();
+  };
+  pagecount = 0;
+  for (i=0; i<14; i++) {
+    fontused[i] = 0;
+  };
+  makewidths();
+  sp = 0;
+  exiting = 0;
+  errors = 0;
+  curname = findname("", 0);
+  dictdepth = 0;
+  gdepth = 0;
+  gs.font = -1;
+  gs.fontsize = 0.0;
+  initgraphics();
+  page.len = 0;
+  inpos = 0;
+  inlen = 0;
+  if (boundingbox != NULL) {
+    mediabox[0] = boundingbox->llx;
+    mediabox[1] = boundingbox->lly;
+    mediabox[2] = boundingbox->urx;
+    mediabox[3] = boundingbox->ury;
+  } else {
+    /* drawtune.c has already swapped the sizes for landscape mode */
+    mediabox[0] = 0;
+    mediabox[1] = 0;
+    if (landscape) {
+      mediabox[2] = pagelen + 2*ymargin;
+      mediabox[3] = pagewidth + 2*xmargin;
+    } else {
+      mediabox[2] = pagewidth + 2*xmargin;
+      mediabox[3] = pagelen + 2*ymargin;
+    };
+  };
+  pdfwrite("%PDF-1.4\n%\342\343\317\323\n", 15);
+}
+
+static void finishpdf(char* filename)
+{
+  int i, encoding;
+  long xref;
+
+  if (page.len > 0) {
+    endpage();
+  };
+  /* the fonts, with the ISOLatin1Encoding of pslib.c */
+  encoding = newobj();
+  startobj(encoding);
+  pdfprintf("<< /Type /Encoding /BaseEncoding /WinAnsiEncoding\n");
+  pdfprintf("/Differences [39 /quoteright 45 /minus 96 /quoteleft\n");
+  pdfprintf("144 /dotlessi /grave /acute /circumflex /tilde /macron /breve\n");
+  pdfprintf("/dotaccent /dieresis /.notdef /ring /cedilla /.notdef\n");
+  pdfprintf("/hungarumlaut /ogonek /caron] >>\nendobj\n");
+  for (i=0; i<14; i++) {
+    if (fontused[i]) {
+      fontused[i] = newobj();
+      startobj(fontused[i]);
+      pdfprintf("<< /Type /Font /Subtype /Type1 /BaseFont /%s", stdfonts[i]);
+      if (i < 12) {
+        pdfprintf(" /Encoding %d 0 R", encoding);
+      };
+      pdfprintf(" >>\nendobj\n");
+    };
+  };
+  startobj(3);
+  pdfprintf("<< /ProcSet [/PDF /Text]\n/Font <<");
+  for (i=0; i<14; i++) {
+    if (fontused[i]) {
+      pdfprintf(" /F%d %d 0 R", i, fontused[i]);
+    };
+  };
+  pdfprintf(" >>\n/XObject <<");
+  for (i=0; i<glyphcount; i++) {
+    if (glyphs[i].number != 0) {
+      pdfprintf("%s/G%d %d 0 R", (glyphs[i].number % 6 == 1) ? "\n" : " ",
+                glyphs[i].number, glyphs[i].object);
+    };
+  };
+  pdfprintf(" >> >>\nendobj\n");
+  startobj(2);
+  pdfprintf("<< /Type /Pages /Count %d\n/Kids [", pagecount);
+  for (i=0; i<pagecount; i++) {
+    pdfprintf("%s%d 0 R", (i % 10 == 0) ? "\n" : " ", kids[i]);
+  };
+  pdfprintf(" ] >>\nendobj\n");
+  startobj(4);
+  pdfprintf("<< /Title ");
+  work.len = 0;
+  bufpdfstring(&work, (unsigned char*)filename, strlen(filename));
+  pdfwrite(work.text, work.len);
+  pdfprintf("\n/Creator (yaps \\(abc to PostScript converter\\))\n");
+#ifdef ANSILIBS
+  {
+    char timebuff[40];
+    time_t now;
+
+    now = time(NULL);
+    strftime(timebuff, (size_t)40, "%Y%m%d%H%M%S", localtime(&now));
+    pdfprintf("/CreationDate (D:%s)\n", timebuff);
+  };
+#endif
+  pdfprintf(">>\nendobj\n");
+  startobj(1);
+  pdfprintf("<< /Type /Catalog /Pages 2 0 R >>\nendobj\n");
+  xref = pdfpos;
+  pdfprintf("xref\n0 %d\n0000000000 65535 f \n", objcount);
+  for (i=1; i<objcount; i++) {
+    pdfprintf("%010ld 00000 n \n", offsets[i]);
+  };
+  pdfprintf("trailer\n<< /Size %d /Root 1 0 R /Info 4 0 R >>\n", objcount);
+  pdfprintf("startxref\n%ld\n%%%%EOF\n", xref);
+}
+
+static void freepdf()
+{
+  while (gdepth > 0) {
+    op_grestore();
+  };
+  free(glyphhash);
+  glyphhash = NULL;
+  freearena();
+}
+
+void printpdf(FILE* f, char* filename, struct bbox* boundingbox, FILE* body)
+/* write the PostScript in body to f as PDF */
+{
+  FILE* ps;
+
+  ps = tmpfile();
+  if (ps == NULL) {
+    printf("Could not create temporary file\n");
+    exit(1);
+  };
+  printlib(ps, filename, boundingbox, body);
+  rewind(ps);
+  psin = ps;
+  startpdf(f, boundingbox);
+  interpret();
+  finishpdf(filename);
+  freepdf();
+  fclose(ps);
+  if (errors > MAXERRORS) {
+    printf("PDF output: %d more problems not shown\n", errors - MAXERRORS);
+  };
+}
@@ -40,26 +40,83 @@
 extern struct tune thetune;
 extern double scaledwidth;
 
-static void addfract(f, n, m)
-struct fract* f;
-int n, m;
-/* add n/m to fraction pointed to by f */
-/* like addunits(), but does not use unitlength */
+/* While spacing, time within a line is counted in ticks. The number of */
+/* ticks in a whole note is worked out once per tune so that every note */
+/* and rest is a whole number of ticks, which makes stepping the voices */
+/* through time integer adds and compares. If a tune needs more than    */
+/* MAXTICKS, the lengths that do not fit are rounded.                   */
+#define MAXTICKS 0x100000L
+
+static long tickspernote;
+
+static long gcd(a, b)
+long a, b;
+/* highest common factor */
+{
+  long t;
+
+  while (b != 0) {
+    t = a % b;
+    a = b;
+    b = t;
+  };
+  return(a);
+}
+
+static void needticks(num, denom)
+int num, denom;
+/* make sure num/denom of a whole note is a whole number of ticks */
 {
-  f->num = n*f->denom + m*f->num;
-  f->denom = m*f->denom;
-  reducef(f);
+  long d, n;
+
+  if (num == 0) {
+    return;
+  };
+  d = denom / gcd(num, denom);
+  n = tickspernote / gcd(tickspernote, d) * d;
+  if (n <= MAXTICKS) {
+    tickspernote = n;
+  };
 }
 
-static void mulfract(f, n, m)
-struct fract* f;
-int n, m;
-/* multiply  n/m to fraction pointed to by f */
-/* like addunits(), but does not use unitlength */
+static long toticks(num, denom)
+int num, denom;
+/* convert num/denom of a whole note to ticks */
 {
-  f->num =   n*f->num;
-  f->denom = m*f->denom;
-  reducef(f);
+  return((num * tickspernote + denom/2) / denom);
+}
+
+static void settickspernote(struct tune* t)
+/* find a number of ticks per whole note which suits every */
+/* note and rest in the tune                               */
+{
+  struct voice* v;
+  struct feature* p;
+  struct note* anote;
+  struct rest* arest;
+
+  tickspernote = 1;
+  v = firstitem(&t->voices);
+  while (v != NULL) {
+    p = v->first;
+    while (p != NULL) {
+      if (p->type == REST) {
+        arest = p->item;
+        needticks(arest->len.num, arest->len.denom);
+      };
+      if (p->type == NOTE) {
+        anote = p->item;
+        if (anote->tuplenotes > 0) {
+          needticks(anote->len.num * v->tuplefactor.num,
+                    anote->len.denom * v->tuplefactor.denom);
+        } else {
+          needticks(anote->len.num, anote->len.denom);
+        };
+      };
+      p = p->next;
+    };
+    v = nextitem(&t->voices);
+  };
 }
 
 static void advance(struct voice* v, int phase, int* items, double* itemspace, double x)
@@ -68,7 +125,7 @@ static void advance(struct voice* v, int phase, int* items, double* itemspace, d
   struct feature* p;
   struct rest* arest;
   struct note* anote;
-  struct fract tuplefactor, notelen;
+  struct fract tuplefactor;
   int done;
   int stepon;
   int zerotime, newline;
@@ -149,20 +206,18 @@ static void advance(struct voice* v, int phase, int* items, double* itemspace, d
         *items = *items + 1;
         if (p->type == REST) {
           arest = p->item;
-          addfract(&v->time, arest->len.num, arest->len.denom);
+          v->time = v->time + toticks(arest->len.num, arest->len.denom);
         };
         if ((p->type == NOTE) && (!v->ingrace)) {
           anote = p->item;
-	  notelen = anote->len;
-
- 	 if (anote->tuplenotes >0) {
-		  mulfract(&notelen,tuplefactor.num,tuplefactor.denom);
-	           }
-
-
-          addfract(&v->time, notelen.num, notelen.denom);
-/*	  printf("%c %d/%d %d/%d\n",anote->pitch,notelen.num,notelen.denom,
-			  v->time.num,v->time.denom);
+          if (anote->tuplenotes > 0) {
+            v->time = v->time + toticks(anote->len.num * tuplefactor.num,
+                                        anote->len.denom * tuplefactor.denom);
+          } else {
+            v->time = v->time + toticks(anote->len.num, anote->len.denom);
+          };
+/*	  printf("%c %d/%d %ld\n",anote->pitch,anote->len.num,anote->len.denom,
+			  v->time);
 */
         };
       };
@@ -204,29 +259,7 @@ static void advance(struct voice* v, int phase, int* items, double* itemspace, d
   };
 }
 
-static int gefract(struct fract* a, struct fract* b)
-/* compare two fractions  a greater than or equal to b */
-/* returns   (a >= b)                                  */
-{
-  if ((a->num*b->denom) >= (b->num*a->denom)) {
-    return(1);
-  } else {
-    return(0);
-  };
-}
-
-static int gtfract(struct fract* a, struct fract* b)
-/* compare two fractions  a greater than b */
-/* returns   (a > b)                       */
-{
-  if ((a->num*b->denom) > (b->num*a->denom)) {
-    return(1);
-  } else {
-    return(0);
-  };
-}
-
-static int spacemultiline(struct fract* mastertime, struct tune* t)
+static int spacemultiline(long* mastertime, struct tune* t)
 /* calculate spacing for one line (but possibly multiple voices) */
 {
   int i;
@@ -237,19 +270,19 @@ static int spacemultiline(struct fract* mastertime, struct tune* t)
   double x, gap;
   int done;
   struct voice* v;
-  struct fract minlen;
+  long minlen;
 
   /* two passes - on the second pass, inter-symbol spacing is */
   /* known so elements can be given their correct x position */
   gap = 0.0;
   for (i=0; i<2; i++) {
-    setfract(mastertime, 0, 1);
+    *mastertime = 0;
     v = firstitem(&t->voices);
     while (v != NULL) {
       v->place = v->lineplace;
       v->ingrace = 0;
       v->atlineend = 0;
-      setfract(&v->time, 0, 1);
+      v->time = 0;
       v = nextitem(&t->voices);
     };
     done = 0;
@@ -264,7 +297,7 @@ static int spacemultiline(struct fract* mastertime, struct tune* t)
       /* first do zero-time symbols */
       v = firstitem(&t->voices);
       while (v != NULL) {
-        if ((!v->atlineend)&&(gefract(mastertime, &v->time))) {
+        if ((!v->atlineend)&&(*mastertime >= v->time)) {
           advance(v, 1, &thisitems, &thiswidth, x);
           if (thisitems > maxitems) {
             maxitems = thisitems;
@@ -280,7 +313,7 @@ static int spacemultiline(struct fract* mastertime, struct tune* t)
         /* advance all voices at or before mastertime */
         v = firstitem(&t->voices);
         while (v != NULL) {
-          if ((!v->atlineend)&&(gefract(mastertime, &v->time))) {
+          if ((!v->atlineend)&&(*mastertime >= v->time)) {
             advance(v, 2, &thisitems, &thiswidth, x);
             if (thisitems > maxitems) {
               maxitems = thisitems;
@@ -293,22 +326,22 @@ static int spacemultiline(struct fract* mastertime, struct tune* t)
         };
         /* calculate new mastertime */
         v = firstitem(&t->voices);
-        setfract(&minlen, 0, 1);
+        minlen = 0;
         done = 1;
         while (v != NULL) {
           if (!v->atlineend) {
             done = 0;
-            if (minlen.num == 0) {
-              setfract(&minlen, v->time.num, v->time.denom);
+            if (minlen == 0) {
+              minlen = v->time;
             } else {
-              if (gtfract(&minlen, &v->time)) {
-                setfract(&minlen, v->time.num, v->time.denom);
+              if (minlen > v->time) {
+                minlen = v->time;
               };
             };
           };
           v = nextitem(&t->voices);
         };
-        setfract(mastertime, minlen.num, minlen.denom);
+        *mastertime = minlen;
       };
       totalitems = totalitems + maxitems;
       totalwidth = totalwidth + maxwidth;
@@ -339,12 +372,13 @@ static int spacemultiline(struct fract* mastertime, struct tune* t)
 
 void spacevoices(struct tune* t)
 {
-  struct fract mastertime;
+  long mastertime;
   int donelines;
   struct voice* v;
   int items;
   double x1;
 
+  settickspernote(t);
   /* initialize voices */
   v = firstitem(&t->voices);
   while (v != NULL) {
@@ -440,6 +474,12 @@ static int spaceline(struct voice* v)
     case CHORDNOTE:
       p->x = (float) lastx;
       break;
+    case REP1:
+    case REP2:
+    case PLAY_ON_REP:
+      /* placed like advance() does, before the next symbol */
+      p->x = (float) (x + p->xleft);
+      break;
     case CLEF:
     case KEY:
     case TIME:
@@ -39,6 +39,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 /*  #define ANSILIBS is just used to access time functions for */
 /*  %%CreationDate . This can safely be removed if it causes   */
@@ -1059,23 +1060,325 @@ FILE* f;
   fprintf(f,"\n");
 }
 
-void printlib(f, filename, boundingbox)
+/* Only the parts of the library which a file uses are written to it. */
+/* The library is cut into definitions at the blank lines and a      */
+/* definition is kept if a name it defines appears in the PostScript  */
+/* for the tunes or in another definition which is being kept. Parts  */
+/* which define nothing (comments, settings) are always kept.         */
+
+#define LIBNAMES 512 /* size of name hash table, a power of 2 */
+#define MAXNAME 40
+
+struct libdef {
+  char* text; /* start of the definition in libtext */
+  int len;
+  int always; /* defines nothing */
+  int keep;
+};
+
+struct libname {
+  char* name; /* points into libtext, ends at a delimiter */
+  int len;
+  int def;
+};
+
+static char* libtext = NULL;
+static struct libdef* libdefs;
+static int libdefcount;
+static struct libname libnames[LIBNAMES];
+static int* wanted; /* definitions to be scanned for the names they use */
+static int wantedcount;
+
+/* state for picking the names out of PostScript */
+struct psscan {
+  int comment;  /* in a % comment */
+  int string;   /* depth of ( ) in a string */
+  int escape;   /* after \ in a string */
+  int len;
+  char name[MAXNAME];
+};
+
+static int isdelimiter(c)
+int c;
+{
+  return((c == ' ') || (c == '\t') || (c == '\n') || (c == '\r') ||
+         (c == '\f') || (c == '(') || (c == ')') || (c == '<') ||
+         (c == '>') || (c == '[') || (c == ']') || (c == '{') ||
+         (c == '}') || (c == '/') || (c == '%') || (c == EOF));
+}
+
+static unsigned int hashname(s, len)
+char* s;
+int len;
+{
+  unsigned int h;
+  int i;
+
+  h = 2166136261u;
+  for (i=0; i<len; i++) {
+    h = (h ^ (unsigned char)s[i]) * 16777619u;
+  };
+  return(h & (LIBNAMES-1));
+}
+
+static int findname(s, len)
+/* return slot for name in libnames */
+char* s;
+int len;
+{
+  unsigned int h;
+
+  h = hashname(s, len);
+  while ((libnames[h].name != NULL) && 
+         ((libnames[h].len != len) || 
+          (strncmp(libnames[h].name, s, len) != 0))) {
+    h = (h + 1) & (LIBNAMES-1);
+  };
+  return(h);
+}
+
+static void usename(s, len)
+/* a name has been found in the PostScript; keep its definition */
+char* s;
+int len;
+{
+  int h, d;
+
+  h = findname(s, len);
+  if (libnames[h].name != NULL) {
+    d = libnames[h].def;
+    if (!libdefs[d].keep) {
+      libdefs[d].keep = 1;
+      wanted[wantedcount] = d;
+      wantedcount = wantedcount + 1;
+    };
+  };
+}
+
+static void scanchar(sc, c)
+/* process next character of PostScript */
+struct psscan* sc;
+int c;
+{
+  if (sc->comment) {
+    if ((c == '\n') || (c == '\r')) {
+      sc->comment = 0;
+    };
+    return;
+  };
+  if (sc->string > 0) {
+    if (sc->escape) {
+      sc->escape = 0;
+    } else {
+      if (c == '\\') {
+        sc->escape = 1;
+      };
+      if (c == '(') {
+        sc->string = sc->string + 1;
+      };
+      if (c == ')') {
+        sc->string = sc->string - 1;
+      };
+    };
+    return;
+  };
+  if (!isdelimiter(c)) {
+    if (sc->len < MAXNAME) {
+      sc->name[sc->len] = (char)c;
+    };
+    sc->len = sc->len + 1;
+    return;
+  };
+  if ((sc->len > 0) && (sc->len <= MAXNAME)) {
+    usename(sc->name, sc->len);
+  };
+  sc->len = 0;
+  if (c == '%') {
+    sc->comment = 1;
+  };
+  if (c == '(') {
+    sc->string = 1;
+  };
+}
+
+static void addlibdef(text, len)
+/* add a definition and the names it defines */
+char* text;
+int len;
+{
+  char* p;
+  char* name;
+  char* eol;
+  int namelen, h;
+
+  libdefs[libdefcount].text = text;
+  libdefs[libdefcount].len = len;
+  libdefs[libdefcount].always = 1;
+  p = text;
+  while (p < text + len) {
+    eol = strchr(p, '\n');
+    if (*p == '/') {
+      name = p + 1;
+      namelen = 0;
+      while (!isdelimiter(name[namelen])) {
+        namelen = namelen + 1;
+      };
+      p = name + namelen;
+      while ((*p == ' ') || (*p == '\t')) {
+        p = p + 1;
+      };
+      /* /name { ... or /name ... def */
+      if ((namelen > 0) && ((*p == '{') || 
+          ((eol - name >= 3) && (strncmp(eol - 3, "def", 3) == 0)))) {
+        h = findname(name, namelen);
+        if (libnames[h].name == NULL) {
+          libnames[h].name = name;
+          libnames[h].len = namelen;
+          libnames[h].def = libdefcount;
+        };
+        libdefs[libdefcount].always = 0;
+      };
+    };
+    p = eol + 1;
+  };
+  libdefcount = libdefcount + 1;
+}
+
+static void makelib()
+/* print the library into memory and cut it into definitions */
+{
+  FILE* lib;
+  long size;
+  char* p;
+  char* start;
+  int count;
+
+  lib = tmpfile();
+  if (lib == NULL) {
+    printf("Could not create temporary file\n");
+    exit(1);
+  };
+  section1(lib);
+  section2(lib);
+  section3(lib);
+  section4(lib);
+  section5(lib);
+  section6(lib);
+  section7(lib);
+  section8(lib);
+  section9(lib);
+  section10(lib);
+  section11(lib);
+  section12(lib);
+  section13(lib);
+  size = ftell(lib);
+  rewind(lib);
+  libtext = (char*)malloc(size + 1);
+  if ((libtext == NULL) || (fread(libtext, 1, size, lib) != (size_t)size)) {
+    printf("Could not read PostScript library\n");
+    exit(1);
+  };
+  libtext[size] = '\0';
+  fclose(lib);
+  /* the definitions end at blank lines */
+  count = 1;
+  for (p = libtext; *p != '\0'; p++) {
+    if (*p == '\n') {
+      count = count + 1;
+    };
+  };
+  libdefs = (struct libdef*)malloc(count * sizeof(struct libdef));
+  wanted = (int*)malloc(count * sizeof(int));
+  if ((libdefs == NULL) || (wanted == NULL)) {
+    printf("Out of memory\n");
+    exit(1);
+  };
+  libdefcount = 0;
+  start = libtext;
+  p = libtext;
+  while (*p != '\0') {
+    p = strchr(p, '\n') + 1;
+    if (*p == '\n') {
+      while (*p == '\n') {
+        p = p + 1;
+      };
+      addlibdef(start, p - start);
+      start = p;
+    };
+  };
+  if (p > start) {
+    addlibdef(start, p - start);
+  };
+}
+
+static void printused(f, body)
+/* print the library definitions used by body */
+FILE* f;
+FILE* body;
+{
+  struct psscan sc;
+  int i, d;
+  char* p;
+  char buffer[8192];
+  size_t n;
+
+  /* parts which are always kept may use names too */
+  wantedcount = 0;
+  for (i=0; i<libdefcount; i++) {
+    libdefs[i].keep = libdefs[i].always;
+    if (libdefs[i].keep) {
+      wanted[wantedcount] = i;
+      wantedcount = wantedcount + 1;
+    };
+  };
+  sc.comment = 0;
+  sc.string = 0;
+  sc.escape = 0;
+  sc.len = 0;
+  rewind(body);
+  while ((n = fread(buffer, 1, sizeof(buffer), body)) > 0) {
+    for (i=0; i<(int)n; i++) {
+      scanchar(&sc, (unsigned char)buffer[i]);
+    };
+  };
+  scanchar(&sc, EOF);
+  while (wantedcount > 0) {
+    wantedcount = wantedcount - 1;
+    d = wanted[wantedcount];
+    sc.comment = 0;
+    sc.string = 0;
+    sc.escape = 0;
+    sc.len = 0;
+    for (p = libdefs[d].text; p < libdefs[d].text + libdefs[d].len; p++) {
+      scanchar(&sc, (unsigned char)*p);
+    };
+    scanchar(&sc, EOF);
+  };
+  for (i=0; i<libdefcount; i++) {
+    if (libdefs[i].keep) {
+      fwrite(libdefs[i].text, 1, libdefs[i].len, f);
+    };
+  };
+}
+
+void printlib(f, filename, boundingbox, body)
+/* write the header and the library routines used by the PostScript */
+/* in body, followed by body itself */
 FILE*f;
 char* filename;
 struct bbox* boundingbox;
+FILE* body;
 {
+  char buffer[8192];
+  size_t n;
+
+  if (libtext == NULL) {
+    makelib();
+  };
   ps_header(f, filename, boundingbox);
-  section1(f);
-  section2(f);
-  section3(f);
-  section4(f);
-  section5(f);
-  section6(f);
-  section7(f);
-  section8(f);
-  section9(f);
-  section10(f);
-  section11(f);
-  section12(f);
-  section13(f);
+  printused(f, body);
+  rewind(body);
+  while ((n = fread(buffer, 1, sizeof(buffer), body)) > 0) {
+    fwrite(buffer, 1, n, f);
+  };
 }
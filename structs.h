@@ -191,7 +191,7 @@ struct voice {
   int atlineend;
   struct feature* place;
   int inmusic;
-  struct fract time;
+  long time; /* in ticks - see position.c */
   /* following are used to determine stem direction of beamed set */
   struct feature* beamroot;
   struct feature* beamend;
@@ -237,4 +237,7 @@ struct llist* newlist();
 void addtolist(struct llist* p, void* item);
 void* firstitem(struct llist* p);
 void* nextitem(struct llist* p);
-void freellist(struct llist* l);
+
+/* memory for the tune tree, released by freetune() */
+void* tunealloc(int bytes);
+char* tunestring(char* s);
@@ -45,6 +45,14 @@
 extern char* strchr();
 #endif
 
+/* -j and a list of -t values run abc2abc in child processes */
+#if !defined(_WIN32) && !defined(__MSDOS__)
+#define TUNEFORK
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
 #define MAX_VOICES 30
 /* should be plenty! */
 
@@ -90,7 +98,9 @@ int ingrace; /* are we in a grace note set { } ? */
 int chordcount; /* number of notes or rests in current chord */
 int inlinefield; /* boolean - are we in [<field>: ] ? */
 int cleanup; /* boolean to indicate -u option (update notation) */
-char tmp[2000]; /* buffer to hold abc output being assembled */
+char* tmp; /* buffer to hold abc output being assembled */
+int tmplen; /* length of the text in tmp */
+static int tmpsize; /* space allocated for tmp */
 int output_on = 1;  /* if 0 suppress output */
 int passthru = 0; /* output original abc file [SS] 2011-06-07 */
 long selected_voices = -1; /* all voices are selected [PHDM] 2013-03-08 */
@@ -101,9 +111,33 @@ int adapt_useflats_to_gchords = 1; /* experimental flag */
 int usekey = 0;
 int drumchan=0; /* flag to suppress transposition */
 int noplus; /* flag for outputting !..! instructions instead of +...+ */
+int copyinput; /* -c option: copy parts of lines which are not altered */
+#define MAXJOBS 64
+#define MAXTRANSPOSE 16
+int tunejobs = 1; /* -j option: number of processes */
+int transposes[MAXTRANSPOSE]; /* -t X,Y,... */
+int transposecount = 1;
+
+/* With -c the output for each line is collected in lineout, and the */
+/* parts of it produced for each item in the input line are recorded */
+/* as spans. Spans which no option has altered are replaced by the   */
+/* input text they came from when the line is written out.           */
+struct span {
+  int pos;    /* value of itemposition for this item */
+  int src;    /* start of item in input line */
+  int out;    /* start of its output in lineout + tmp */
+  int edited; /* output differs from the input */
+};
+static struct span* spans;
+static int spancount, spanlimit;
+static struct vstring lineout;
+static int linecopyable; /* output has not been switched on or off */
 
 extern int nokey; /* signals no key signature assumed */
 extern int nokeysig; /* signals -nokeys or -nokeysf option */
+extern int itemposition; /* from parseabc.c */
+extern int copysource; /* from parseabc.c */
+extern struct vstring sourceline; /* from parseabc.c */
 extern int voicecodes ;  /* from parseabc.c */
 extern char voicecode[16][30]; /*for interpreting V: string */
  
@@ -111,7 +145,7 @@ struct voicetype { /* information needed for each voice */
   int number; /* voice number from V: field */
   int barcount;
   int foundbar;
-  struct abctext* currentline;
+  int currentline; /* position of line in abctext, -1 if none */
   int bars_remaining;
   int bars_complete;
   int drumchan;
@@ -126,15 +160,41 @@ struct lyricwords{
   struct lyricwords* nextverse;
   char* words;
 };  
-struct abctext{ /* linked list used to store output before re-formatting */
-  struct abctext* next;
+struct abctext{ /* element of array used to store output before re-formatting */
   char* text;
   enum abctype type;
   int notes;
+  int nextbar; /* entry in bars[] for the first bar of music from here on */
   struct lyricwords* lyrics;
 };
-struct abctext* head;
-struct abctext* tail;
+/* the output waiting to be re-formatted is abctext[head] to abctext[tail-1] */
+struct abctext* abctext;
+int head, tail;
+static int abctextlimit;
+/* positions in abctext of the bars which contain notes */
+static int* bars;
+static int barslimit, barsused;
+
+/* The text and lyrics held in abctext come from a chain of large blocks */
+/* instead of one malloc() each. The blocks are handed back in one go   */
+/* when all the stored output has been written, and kept for re-use.    */
+#define ARENABLOCK 32768
+
+union arenaalign {
+  double d;
+  long l;
+  void* p;
+};
+
+struct arenablock {
+  struct arenablock* next;
+  int size;
+  int used;
+  union arenaalign start[1];
+};
+
+static struct arenablock* arena = NULL;
+static struct arenablock* spareblocks = NULL;
 
 
 extern char *mode[];
@@ -149,25 +209,116 @@ void transpose_note(char xaccidental,int xmult,char xnote,int xoctave,int transp
     char* accidental, int* mult, char* note, int* octave);
 
 
-static int purgespace(p)
-char* p;
-/* if string p is empty or consists of spaces, set p to the empty string */
-/* and return 1, otherwise return 0. Used to test tmp */
+static void growtmp(n)
+int n;
+/* make room for n more characters in tmp */
+{
+  if (tmplen + n + 1 > tmpsize) {
+    if (tmpsize == 0) {
+      tmpsize = 2000;
+    };
+    while (tmplen + n + 1 > tmpsize) {
+      tmpsize = tmpsize * 2;
+    };
+    tmp = (char*) realloc(tmp, tmpsize);
+    if (tmp == NULL) {
+      printf("Out of memory\n");
+      exit(1);
+    };
+  };
+}
+
+static void cleartmp()
+{
+  tmplen = 0;
+  tmp[0] = '\0';
+}
+
+static int purgespace()
+/* if tmp is empty or consists of spaces, set it to the empty string */
+/* and return 1, otherwise return 0. */
 /* part of new linebreak option (-n) */
 {
-  int blank;
-  char *s;
+  int i;
 
-  blank = 1;
-  s = p;
-  while (*s != '\0') {
-    if (*s != ' ') blank = 0;
-    s = s + 1;
+  for (i=0; i<tmplen; i++) {
+    if (tmp[i] != ' ') {
+      return(0);
+    };
   };
-  if (blank) {
-    *p = '\0';
+  cleartmp();
+  return(1);
+}
+
+static void* textalloc(bytes)
+int bytes;
+/* allocate space for stored output */
+/* part of new linebreak option (-n) */
+{
+  struct arenablock* b;
+  void* p;
+  int size;
+
+  bytes = (bytes + sizeof(union arenaalign) - 1) /
+          sizeof(union arenaalign) * sizeof(union arenaalign);
+  if ((arena == NULL) || (arena->used + bytes > arena->size)) {
+    if ((bytes <= ARENABLOCK) && (spareblocks != NULL)) {
+      b = spareblocks;
+      spareblocks = b->next;
+    } else {
+      size = ARENABLOCK;
+      if (bytes > size) {
+        size = bytes;
+      };
+      b = (struct arenablock*)checkmalloc(sizeof(struct arenablock) + size);
+      b->size = size;
+    };
+    b->used = 0;
+    b->next = arena;
+    arena = b;
+  };
+  p = (char*)arena->start + arena->used;
+  arena->used = arena->used + bytes;
+  return(p);
+}
+
+static char* textstring(s, len)
+char* s;
+int len;
+/* store a copy of a string of known length */
+/* part of new linebreak option (-n) */
+{
+  char* p;
+
+  p = (char*)textalloc(len + 1);
+  memcpy(p, s, len);
+  p[len] = '\0';
+  return(p);
+}
+
+static void clear_abctext()
+/* forget all stored output and release the space it used */
+/* part of new linebreak option (-n) */
+{
+  struct arenablock* b;
+  int i;
+
+  head = 0;
+  tail = 0;
+  barsused = 0;
+  for (i=0; i<voicecount; i++) {
+    voice[i].currentline = -1;
+  };
+  while (arena != NULL) {
+    b = arena;
+    arena = b->next;
+    if (b->size == ARENABLOCK) {
+      b->next = spareblocks;
+      spareblocks = b;
+    } else {
+      free(b);
+    };
   };
-  return(blank);
 }
 
 int zero_barcount(foundbar)
@@ -223,18 +374,19 @@ enum linestattype termination;
 /* returns the number of bars actually output */
 /* part of new linebreak option (-n) */
 {
-  struct abctext *p, *nextp;
-  struct lyricwords *q, *r;
+  struct abctext *p;
   struct lyricwords *barlyrics;
   int count, donewords, wordline;
   int i, foundtext;
   int foundbar;
+  int pos;
 
   /* printf("flush_abctext called\n"); */
   /* print music */
-  p = head;
+  pos = head;
   count = zero_barcount(&foundbar);
-  while ((p != NULL) && (count < bars)) {
+  while ((pos < tail) && (count < bars)) {
+    p = &abctext[pos];
     if (p->type == field) {
       setline(fresh);
     };
@@ -249,7 +401,7 @@ enum linestattype termination;
     if ((count == bars) && (p->type == barline)) {
       setline(endmusicline);
     };
-    p = p->next;
+    pos = pos + 1;
   };
   if (linestat == midmusic) {
     setline(termination);
@@ -259,10 +411,11 @@ enum linestattype termination;
     donewords = 0;
     wordline = 0;
     while (donewords == 0) {
-      p = head;
+      pos = head;
       foundtext = 0;
       count = zero_barcount(&foundbar);
-      while ((p != NULL) && (count < bars)) {
+      while ((pos < tail) && (count < bars)) {
+        p = &abctext[pos];
         barlyrics = p->lyrics;
         for (i=0; i<wordline; i++) {
           if (barlyrics != NULL) {
@@ -278,7 +431,7 @@ enum linestattype termination;
           printf("%s",barlyrics->words);
         };
         count = new_barcount(p->type, &foundbar, count);
-        p = p->next;
+        pos = pos + 1;
       };
       if (foundtext == 0) {
         donewords = 1;
@@ -289,29 +442,14 @@ enum linestattype termination;
       wordline = wordline + 1;
     };
   };
-  /* move head on and free up space used by stuff printed out */
+  /* move head on past stuff printed out */
   count = zero_barcount(&foundbar);
-  p = head;
-  foundbar = 0;
-  while ((p != NULL) && (count < bars)) {
-    if (p != NULL) {
-      free(p->text);
-      q = p->lyrics;
-      while (q != NULL) {
-        free(q->words);
-        r = q->nextverse;
-        free(q);
-        q = r;
-      };
-      count = new_barcount(p->type, &foundbar, count);
-      nextp = p->next;
-      free(p);
-      p = nextp;
-    };
-    head = p;
+  while ((head < tail) && (count < bars)) {
+    count = new_barcount(abctext[head].type, &foundbar, count);
+    head = head + 1;
   };
-  if (head == NULL) {
-    tail = NULL;
+  if (head == tail) {
+    clear_abctext();
   };
   return(count);
 }
@@ -352,22 +490,20 @@ enum linestattype termination;
   if (v->bars_remaining == 0) {
     v->bars_remaining = bars_per_line;
   };
-  head = NULL;
-  tail = NULL;
-  voice[this_voice].currentline = NULL;
+  clear_abctext();
 }
 
-static struct abctext* newabctext(t)
+static int newabctext(t)
 enum abctype t;
 /* called at newlines and barlines */
-/* adds current output text to linked list structure */
+/* adds current output text to abctext array */
 /* part of new linebreak option (-n) */
 {
   struct abctext* p;
+  int pos;
 
   if (output_on == 0) {
-    p = NULL;
-    return(p);
+    return(-1);
   };
   if (newbreaks) {
 /*
@@ -377,10 +513,20 @@ enum abctype t;
       complete_all(&voice[this_voice], midmusic);
       this_voice = next_voice;
     };
-    p = (struct abctext*) checkmalloc(sizeof(struct abctext));
-    p->text = addstring(tmp);
-    tmp[0] = '\0';
-    p->next = NULL;
+    if (tail == abctextlimit) {
+      abctextlimit = (abctextlimit == 0) ? 256 : abctextlimit * 2;
+      abctext = (struct abctext*) realloc(abctext,
+                       abctextlimit * sizeof(struct abctext));
+      if (abctext == NULL) {
+        printf("Out of memory\n");
+        exit(1);
+      };
+    };
+    pos = tail;
+    tail = tail + 1;
+    p = &abctext[pos];
+    p->text = textstring(tmp, tmplen);
+    cleartmp();
     p->type = t;
     p->lyrics = NULL;
     if (t == bar) {
@@ -390,28 +536,38 @@ enum abctype t;
     } else {
       p->notes = 0;
     };
+    p->nextbar = barsused;
+    if ((t == bar) && (p->notes != 0)) {
+      if (barsused == barslimit) {
+        barslimit = (barslimit == 0) ? 256 : barslimit * 2;
+        bars = (int*) realloc(bars, barslimit * sizeof(int));
+        if (bars == NULL) {
+          printf("Out of memory\n");
+          exit(1);
+        };
+      };
+      bars[barsused] = pos;
+      barsused = barsused + 1;
+    };
     if (xinbody) {
       voice[this_voice].barcount = new_barcount(t, 
                        &voice[this_voice].foundbar, 
                         voice[this_voice].barcount);
     };
-    if (head == NULL) {
-      head = p;
-      tail = p;
-    } else {
-      tail->next = p;
-      tail = p;
-    };
-    if ((t != field) && (voice[this_voice].currentline == NULL)) {
-      voice[this_voice].currentline = p;
+    if ((t != field) && (voice[this_voice].currentline == -1)) {
+      voice[this_voice].currentline = pos;
     };
   } else {
-    printf("%s", tmp);  /* output to stdout is here */
-    tmp[0] = '\0';
-    p = NULL;
+    if (copyinput) {
+      addtext(tmp, &lineout);
+    } else {
+      fwrite(tmp, 1, tmplen, stdout);  /* output to stdout is here */
+    };
+    cleartmp();
+    pos = -1;
   };
   inmusic = 1;
-  return(p);
+  return(pos);
 }
 
 static int nextnotes()
@@ -419,17 +575,17 @@ static int nextnotes()
 /* part of new linebreak option (-n) */
 {
   int n, got;
-  struct abctext* p;
+  int pos;
 
-  p = head;
+  pos = head;
   n = 100;
   got = 0;
-  while ((p != NULL) && (!got)) {
-    if (p->type == bar) {
-      n = p->notes;
+  while ((pos < tail) && (!got)) {
+    if (abctext[pos].type == bar) {
+      n = abctext[pos].notes;
       got = 1;
     } else {
-      p = p->next;
+      pos = pos + 1;
     };
   };
   return(n);
@@ -509,6 +665,7 @@ char** filename;
 /* routine called on program start-up */
 {
   int targ, narg;
+  char* s;
 
   if ((getarg("-h", argc, argv) != -1) || (argc < 2)) {
     printf("abc2abc version %s\n",VERSION);
@@ -519,7 +676,7 @@ char** filename;
     printf("  -b to remove bar checking\n");
     printf("  -r to remove repeat checking\n");
     printf("  -e to remove all error reports\n");
-    printf("  -t X to transpose X semitones\n");
+    printf("  -t X[,Y...] to transpose X semitones (then Y ...)\n");
     printf("  -nda No double accidentals in guitar chords\n");
     printf("  -nokeys No key signature. Use sharps\n");
     printf("  -nokeyf No key signature. Use flats\n");
@@ -532,6 +689,8 @@ char** filename;
     printf("  -ver  prints version number and exits\n");
     printf("  -X n renumber the all X: fields as n, n+1, ..\n");
     printf("  -OCC old chord convention (eg. +CE+)\n");
+    printf("  -c copy the parts of the input which are not altered\n");
+    printf("  -j n process n tunes at once in separate processes\n");
     /*printf("  -noplus use !...! instead of +...+ for instructions\n");
      [SS] 2012-06-04
     */
@@ -616,13 +775,21 @@ char** filename;
     if (targ >= argc) {
       event_error("No tranpose value supplied");
     } else {
-      if (*argv[targ] == '-') {
-        transpose = -readnumf(argv[targ]+1);
-      } else if (*argv[targ] == '+') {
-          transpose = readnumf(argv[targ]+1);
-      } else {
-          transpose = readnumf(argv[targ]);
+      /* several values give one copy of the output for each */
+      s = argv[targ];
+      transposecount = 0;
+      do {
+        if (*s == '+') {
+          s = s + 1;
+        };
+        if (transposecount < MAXTRANSPOSE) {
+          transposes[transposecount] = readsnump(&s);
+          transposecount = transposecount + 1;
+        } else {
+          readsnump(&s);
         };
+      } while (*s++ == ',');
+      transpose = transposes[0];
     };
   };
   targ = getarg("-nda",argc,argv);
@@ -655,6 +822,24 @@ char** filename;
      setup_sharps_flats (usekey);
      }
   if (getarg("-OCC",argc,argv) != -1) oldchordconvention=1;
+  /* these rewrite all of the music, so there is nothing to copy */
+  if ((getarg("-c", argc, argv) != -1) && !newbreaks && !newspacing &&
+      !cleanup && !oldchordconvention) {
+    copyinput = 1;
+    copysource = 1;
+    initvstring(&lineout);
+    linecopyable = 1;
+  };
+  narg = getarg("-j", argc, argv);
+  if ((narg != -1) && (narg < argc)) {
+    tunejobs = readnumf(argv[narg]);
+    if (tunejobs < 1) {
+      tunejobs = 1;
+    };
+    if (tunejobs > MAXJOBS) {
+      tunejobs = MAXJOBS;
+    };
+  };
   /*if (getarg("-noplus",argc,argv) != -1) noplus = 1; [SS] 2012-06-04*/
 
 
@@ -665,18 +850,310 @@ char** filename;
   inmusic = 0;
   inchord = 0;
   ingrace = 0;
-  head = NULL;
-  tail = NULL;
-  tmp[0] = '\0';
+  head = 0;
+  tail = 0;
+  for (targ=0; targ<MAX_VOICES; targ++) {
+    voice[targ].currentline = -1;
+  };
+  growtmp(0);
+  cleartmp();
   totalnotes = 0;
 }
 
+static void checkspan()
+/* start a new span if the parser has moved on to a new item */
+/* part of -c option */
+{
+  struct span* p;
+
+  if ((spancount > 0) && (spans[spancount-1].pos == itemposition)) {
+    return;
+  };
+  if (spancount == spanlimit) {
+    spanlimit = (spanlimit == 0) ? 64 : spanlimit * 2;
+    spans = (struct span*) realloc(spans, spanlimit * sizeof(struct span));
+    if (spans == NULL) {
+      printf("Out of memory\n");
+      exit(1);
+    };
+  };
+  p = &spans[spancount];
+  p->pos = itemposition;
+  if (spancount == 0) {
+    p->src = 0;
+  } else {
+    p->src = itemposition;
+    if ((p->src < spans[spancount-1].src) || (p->src > sourceline.len)) {
+      linecopyable = 0;
+    };
+  };
+  p->out = lineout.len + tmplen;
+  p->edited = 0;
+  spancount = spancount + 1;
+}
+
+static void edited()
+/* the output for the current item is not a copy of the input */
+/* part of -c option */
+{
+  if (copyinput && output_on) {
+    checkspan();
+    spans[spancount-1].edited = 1;
+  };
+}
+
+static void writeline()
+/* output the line collected in lineout, copying the spans which */
+/* have not been edited from the input line */
+/* part of -c option */
+{
+  int i, src, srcend, out, outend;
+
+  if (!linecopyable) {
+    fwrite(lineout.st, 1, lineout.len, stdout);
+  } else {
+    for (i=0; i<spancount; i++) {
+      if (spans[i].edited) {
+        out = spans[i].out;
+        if (i+1 < spancount) {
+          outend = spans[i+1].out;
+        } else {
+          outend = lineout.len;
+        };
+        /* purgespace() may have removed some output */
+        if (outend > lineout.len) {
+          outend = lineout.len;
+        };
+        if (out < outend) {
+          fwrite(lineout.st+out, 1, outend-out, stdout);
+        };
+      } else {
+        src = spans[i].src;
+        if (i+1 < spancount) {
+          srcend = spans[i+1].src;
+        } else {
+          srcend = sourceline.len;
+        };
+        fwrite(sourceline.st+src, 1, srcend-src, stdout);
+      };
+    };
+  };
+  clearvstring(&lineout);
+  spancount = 0;
+  linecopyable = output_on;
+}
+
+#ifdef TUNEFORK
+/* With -j the file is parsed by tunejobs processes, each of which   */
+/* writes every tunejobs'th tune to a temporary file and skips the   */
+/* music of the others. The main process copies their output into    */
+/* place in order. Each value given with -t is done by its own set   */
+/* of processes, one after the other.                                */
+#define RECORDMARK '\001'
+
+/* the file one process writes its tunes to */
+struct tunejob {
+  FILE* text;
+  pid_t pid;
+  char buf[8192]; /* for copytext() */
+  int pos, len;
+  int skip;       /* in the middle of a marker line */
+};
+
+static struct tunejob jobs[MAXJOBS];
+static int worker = -1;  /* job done by this process, -1 if none */
+static int partno = 0;   /* number of X: fields seen so far */
+static FILE* discard;
+static char tempname[32]; /* copy of standard input */
+
+static FILE* newtemp()
+/* create a temporary file for the output of a process */
+{
+  FILE* t;
+
+  t = tmpfile();
+  if (t == NULL) {
+    printf("abc2abc: cannot create temporary file\n");
+    exit(1);
+  };
+  return(t);
+}
+
+static void selectpart()
+/* send the output for the current tune to this job's file if it is */
+/* this process that writes the tune and nowhere otherwise          */
+{
+  fflush(stdout);
+  if (partno % tunejobs == worker) {
+    dup2(fileno(jobs[worker].text), 1);
+  } else {
+    dup2(fileno(discard), 1);
+  };
+}
+
+static int nexttune()
+/* called at X: - returns 0 if another process writes this tune */
+{
+  if (worker == -1) {
+    return(1);
+  };
+  if (partno % tunejobs == worker) {
+    printf("%cN\n", RECORDMARK);
+  };
+  partno = partno + 1;
+  selectpart();
+  return(partno % tunejobs == worker);
+}
+
+static int copytext(job)
+struct tunejob* job;
+/* copy the next tune a job wrote to stdout */
+/* returns 0 if this was the last part */
+{
+  char* p;
+
+  while (1) {
+    if (job->pos == job->len) {
+      job->pos = 0;
+      job->len = fread(job->buf, 1, sizeof(job->buf), job->text);
+      if (job->len == 0) {
+        return(0);
+      };
+    };
+    if (job->skip) {
+      /* skip the rest of the marker line */
+      p = memchr(job->buf+job->pos, '\n', job->len-job->pos);
+      if (p == NULL) {
+        job->pos = job->len;
+      } else {
+        job->pos = p+1-job->buf;
+        job->skip = 0;
+        return(1);
+      };
+    } else {
+      p = memchr(job->buf+job->pos, RECORDMARK, job->len-job->pos);
+      if (p == NULL) {
+        p = job->buf+job->len;
+      } else {
+        job->skip = 1;
+      };
+      fwrite(job->buf+job->pos, 1, p-(job->buf+job->pos), stdout);
+      job->pos = p-job->buf;
+    };
+  };
+}
+
+static void copystdin(filename)
+char** filename;
+/* the workers cannot share standard input, so give them a copy */
+{
+  FILE* fp;
+  int fd, n;
+  char buf[8192];
+
+  strcpy(tempname, "/tmp/abc2abcXXXXXX");
+  fd = mkstemp(tempname);
+  if ((fd == -1) || ((fp = fdopen(fd, "w")) == NULL)) {
+    printf("abc2abc: cannot create temporary file\n");
+    exit(1);
+  };
+  while ((n = fread(buf, 1, sizeof(buf), stdin)) > 0) {
+    fwrite(buf, 1, n, fp);
+  };
+  fclose(fp);
+  *filename = tempname;
+}
+
+static void start_jobs(filename)
+char** filename;
+/* Start the processes for -j or several -t values. The main process */
+/* waits for them, writes their output in order and exits.           */
+{
+  int t, k, status, exitcode;
+  pid_t pid;
+
+  if ((tunejobs < 2) && (transposecount < 2)) {
+    return;
+  };
+  if ((strcmp(*filename, "stdin") == 0) || (strcmp(*filename, "-") == 0)) {
+    copystdin(filename);
+  };
+  exitcode = 0;
+  for (t = 0; t < transposecount; t++) {
+    fflush(stdout);
+    for (k = 0; k < tunejobs; k++) {
+      jobs[k].text = newtemp();
+      pid = fork();
+      if (pid < 0) {
+        printf("abc2abc: cannot start process\n");
+        exit(1);
+      };
+      if (pid == 0) {
+        worker = k;
+        transpose = transposes[t];
+        discard = fopen("/dev/null", "w");
+        if (discard == NULL) {
+          exit(1);
+        };
+        selectpart();
+        return;
+      };
+      jobs[k].pid = pid;
+    };
+    for (k = 0; k < tunejobs; k++) {
+      if ((waitpid(jobs[k].pid, &status, 0) != jobs[k].pid) ||
+          !WIFEXITED(status)) {
+        printf("abc2abc: process failed\n");
+        exit(1);
+      };
+      if (WEXITSTATUS(status) != 0) {
+        exitcode = WEXITSTATUS(status);
+      };
+      rewind(jobs[k].text);
+      jobs[k].pos = 0;
+      jobs[k].len = 0;
+      jobs[k].skip = 0;
+    };
+    k = 0;
+    while (copytext(&jobs[k])) {
+      k = (k + 1) % tunejobs;
+    };
+    for (k = 0; k < tunejobs; k++) {
+      fclose(jobs[k].text);
+    };
+  };
+  fflush(stdout);
+  if (*tempname != '\0') {
+    remove(tempname);
+  };
+  exit(exitcode);
+}
+#else
+static int nexttune()
+{
+  return(1);
+}
+
+static void start_jobs(filename)
+char** filename;
+{
+}
+#endif
+
 void emit_string(s)
 char *s;
 /* output string */
 {
+  int len;
+
   if (output_on) {
-    strcpy(tmp+strlen(tmp), s);
+    if (copyinput) {
+      checkspan();
+    };
+    len = strlen(s);
+    growtmp(len);
+    memcpy(tmp+tmplen, s, len+1);
+    tmplen = tmplen + len;
   };
 }
 
@@ -684,12 +1161,14 @@ void emit_char(ch)
 char ch;
 /* output single character */
 {
-  char *place;
-
   if (output_on) {
-    place = tmp+strlen(tmp);
-    *place = ch;
-    *(place+1) = '\0';
+    if (copyinput) {
+      checkspan();
+    };
+    growtmp(1);
+    tmp[tmplen] = ch;
+    tmplen = tmplen + 1;
+    tmp[tmplen] = '\0';
   };
 }
 
@@ -697,8 +1176,58 @@ void emit_int(n)
 int n;
 /* output integer */
 {
+  char digits[12];
+  int i;
+  unsigned int u;
+
   if (output_on) {
-    sprintf(tmp+strlen(tmp), "%d", n);
+    if (copyinput) {
+      checkspan();
+    };
+    growtmp(12);
+    if (n < 0) {
+      tmp[tmplen] = '-';
+      tmplen = tmplen + 1;
+      u = -(unsigned int)n;
+    } else {
+      u = n;
+    };
+    i = 0;
+    do {
+      digits[i] = (char)('0' + u%10);
+      u = u/10;
+      i = i + 1;
+    } while (u > 0);
+    while (i > 0) {
+      i = i - 1;
+      tmp[tmplen] = digits[i];
+      tmplen = tmplen + 1;
+    };
+    tmp[tmplen] = '\0';
+  };
+}
+
+static void emit_format(fmt, s, n)
+char *fmt;
+char *s;
+int n;
+/* output fmt with %s replaced by s and %d by n */
+{
+  char *p;
+
+  for (p = fmt; *p != '\0'; p++) {
+    if ((*p == '%') && (*(p+1) == 's')) {
+      emit_string(s);
+      p = p + 1;
+    } else if ((*p == '%') && (*(p+1) == 'd')) {
+      emit_int(n);
+      p = p + 1;
+    } else {
+      if ((*p == '%') && (*(p+1) == '%')) {
+        p = p + 1;
+      };
+      emit_char(*p);
+    };
   };
 }
 
@@ -708,7 +1237,7 @@ char *s2;
 /* output string containing string expression %s */
 {
   if (output_on) {
-    sprintf(tmp+strlen(tmp), s1, s2);
+    emit_format(s1, s2, 0);
   };
 }
 
@@ -718,7 +1247,7 @@ int n;
 /* output string containing int expression %d */
 {
   if (output_on) {
-    sprintf(tmp+strlen(tmp), s, n);
+    emit_format(s, "", n);
   };
 }
 
@@ -726,11 +1255,9 @@ void unemit_inline()
 /* remove previously output start of inline field */
 /* needed for -V voice selection option           */
 {
-  int len;
-
-  len = strlen(tmp);
-  if ((len > 0) && (tmp[len-1] == '[')) {
-    tmp[len-1] = '\0'; /* delete last character */
+  if ((tmplen > 0) && (tmp[tmplen-1] == '[')) {
+    tmplen = tmplen - 1; /* delete last character */
+    tmp[tmplen] = '\0';
   } else {
     event_error("Internal error - Could not delete [");
   };
@@ -750,6 +1277,9 @@ static void close_newabc()
 void event_eof()
 {
   close_newabc();
+  if (copyinput) {
+    writeline();
+  };
 }
 
 void event_blankline()
@@ -788,9 +1318,14 @@ void print_inputline(); /* from parseabc.c */
 
 void event_linebreak()
 {
-  if (!output_on && passthru) print_inputline(); /* [SS] 2011-06-07*/
+  if (!output_on && passthru) {
+    if (copyinput) {
+      writeline();
+    };
+    print_inputline(); /* [SS] 2011-06-07*/
+  };
   if (newbreaks) {
-    if (!purgespace(tmp)) {
+    if (!purgespace()) {
       if (inmusic) {
         newabctext(bar);
       } else {
@@ -799,6 +1334,9 @@ void event_linebreak()
     };
   } else {
     newabctext(bar);
+    if (copyinput) {
+      writeline();
+    };
     if (output_on) {
       printf("\n"); /* linefeed to stdout is here */
     };
@@ -812,7 +1350,7 @@ void event_linebreak()
 void event_startmusicline()
 /* encountered the start of a line of notes */
 {
-  voice[this_voice].currentline = NULL;
+  voice[this_voice].currentline = -1;
   complete_bars(&voice[this_voice]);
 }
 
@@ -841,7 +1379,7 @@ char *s;
 void event_comment(s)
 char *s;
 {
-  if (newbreaks && (!purgespace(tmp))) {
+  if (newbreaks && (!purgespace())) {
     if (inmusic) {
       newabctext(bar);
     } else {
@@ -896,54 +1434,53 @@ char *f;
   inmusic = 0;
 }
 
-struct abctext* getbar(place)
-struct abctext *place;
-/* find first element in list which is a bar of music */
+int getbar(place)
+int place;
+/* find first element from place on which is a bar of music */
+/* returns -1 if there is none */
 {
-  struct abctext *newplace;
+  int n;
 
-  newplace = place;
-  while ((newplace != NULL) &&
-         ((newplace->type != bar) || 
-          (newplace->notes == 0))) {
-    newplace = newplace->next;
+  if ((place < head) || (place >= tail)) {
+    return(-1);
   };
-  return(newplace);    
+  n = abctext[place].nextbar;
+  if (n >= barsused) {
+    return(-1);
+  };
+  return(bars[n]);
 }
 
-struct abctext* getnextbar(place)
-struct abctext *place;
-/* find next element in list which is a bar of music */
+int getnextbar(place)
+int place;
+/* find next element in array which is a bar of music */
 {
-  struct abctext *newplace;
-
-  newplace = place;
-  if (newplace != NULL) {
-    newplace = getbar(newplace->next);
+  if (place == -1) {
+    return(-1);
   };
-  return(newplace);
+  return(getbar(place + 1));
 };
 
 void append_lyrics(place, newwords)
-struct abctext *place;
+int place;
 char *newwords;
 /* add lyrics to end of lyric list associated with bar */
 {
   struct lyricwords* new_words;
   struct lyricwords *new_place;
 
-  if (place == NULL) {
+  if (place == -1) {
     return;
   };
-  /* printf("append_lyrics has %s at %s\n", newwords, place->text); */
-  new_words = (struct lyricwords*)checkmalloc(sizeof(struct lyricwords));
+  /* printf("append_lyrics has %s at %s\n", newwords, abctext[place].text); */
+  new_words = (struct lyricwords*)textalloc(sizeof(struct lyricwords));
   /* add words to bar */
   new_words->nextverse = NULL;
-  new_words->words = addstring(newwords);
-  if (place->lyrics == NULL) {
-    place->lyrics = new_words;
+  new_words->words = textstring(newwords, strlen(newwords));
+  if (abctext[place].lyrics == NULL) {
+    abctext[place].lyrics = new_words;
   } else {
-    new_place = place->lyrics;
+    new_place = abctext[place].lyrics;
     /* find end of list */
     while (new_place->nextverse != NULL) {
       new_place = new_place->nextverse;
@@ -952,17 +1489,17 @@ char *newwords;
   };
 }
 
-struct abctext* apply_bar(syll, place, notesleft, barwords)
+int apply_bar(syll, place, notesleft, barwords)
 /* advance to next bar (on finding '|' in a w: field) */
 char* syll;
-struct abctext *place;
+int place;
 int *notesleft;
 struct vstring *barwords;
 {
-  struct abctext* new_place;
+  int new_place;
 
-  if (place == NULL) {
-    return(NULL);
+  if (place == -1) {
+    return(-1);
   };
   new_place = place;
   addtext(syll, barwords);
@@ -970,26 +1507,26 @@ struct vstring *barwords;
   /* go on to next bar */
   clearvstring(barwords);
   new_place = getnextbar(place);
-  if (new_place != NULL) {
-    *notesleft = new_place->notes;
+  if (new_place != -1) {
+    *notesleft = abctext[new_place].notes;
   };
   return(new_place); 
 }
 
-struct abctext* apply_syllable(syll, place, notesleft, barwords)
+int apply_syllable(syll, place, notesleft, barwords)
 /* attach syllable to appropriate place in abctext structure */
 char* syll;
-struct abctext *place;
+int place;
 int *notesleft;
 struct vstring *barwords;
 {
-  struct abctext* new_place;
+  int new_place;
   char msg[80];
 
-  if (place == NULL) {
+  if (place == -1) {
     sprintf(msg, "Cannot find note to match \"%s\"", syll);
     event_error(msg);
-    return(NULL);
+    return(-1);
   };
   new_place = place;
   addtext(syll, barwords);
@@ -999,8 +1536,8 @@ struct vstring *barwords;
     /* go on to next bar */
     clearvstring(barwords);
     new_place = getnextbar(place);
-    if (new_place != NULL) {
-      *notesleft = new_place->notes;
+    if (new_place != -1) {
+      *notesleft = abctext[new_place].notes;
     };
   };
   return(new_place); 
@@ -1017,7 +1554,7 @@ char* p;
   int errors;
   int found_hyphen;
 
-  struct abctext *place;
+  int place;
   int notesleft;
 
   if (!xinbody) {
@@ -1025,14 +1562,14 @@ char* p;
     return;
   };
   place = getbar(voice[this_voice].currentline);
-  if (place == NULL) {
+  if (place == -1) {
     event_error("No music to match w: line to");
     return;
   };
-  notesleft = voice[this_voice].currentline->notes;
+  notesleft = abctext[voice[this_voice].currentline].notes;
   initvstring(&barwords);
   errors = 0;
-  if (place == NULL) {
+  if (place == -1) {
     event_error("No notes to match words");
     return;
   };
@@ -1174,7 +1711,7 @@ int num;
     voice[voice_index].bars_remaining = bars_per_line;
     voice[voice_index].drumchan = 0;
   };
-  voice[voice_index].currentline = NULL;
+  voice[voice_index].currentline = -1;
   return(voice_index);
 }
 
@@ -1193,9 +1730,11 @@ struct voice_params *vp;
     }; 
     /*output_on = 0; [SS] 2011-06-10 */
     if (xinbody) output_on = 0; /* [SS] 2011-06-10 */
+    linecopyable = 0;
   } else { 
     if (output_on == 0) { 
       output_on = 1; 
+      linecopyable = 0;
       if (inlinefield) { 
         emit_string("["); /* regenerate missing [ */
       }; 
@@ -1243,6 +1782,9 @@ int n;
 {
   struct fract newunit;
 
+  if (lenfactor.num != lenfactor.denom) {
+    edited();
+  };
   newunit.num = lenfactor.denom;
   newunit.denom = lenfactor.num * n;
   reduce(&newunit.num, &newunit.denom);
@@ -1256,16 +1798,24 @@ int n;
 void event_refno(n)
 int n;
 {
+  int owntune;
+
   if (xinbody) {
     close_newabc();
   };
-  output_on = 1;
+  owntune = nexttune();
+  output_on = owntune;
   if (newrefnos) {
+    edited();
     emit_int_sprintf("X:%d", newref);
     newref = newref + 1;
   } else {
     emit_int_sprintf("X:%d", n);
   };
+  /* tunes another process writes are still parsed, with their output */
+  /* thrown away, as voices, drum channels and keys carry over from one */
+  /* tune to the next                                                   */
+  output_on = 1;
   parseron();
   xinhead = 1;
   notecount = 0;
@@ -1285,6 +1835,9 @@ char *post;
 {
   struct fract newlen;
 
+  if (lenfactor.num != lenfactor.denom) {
+    edited();
+  };
   emit_string("Q:");
   if (pre != NULL) {
     emit_string_sprintf("\"%s\"", pre);
@@ -1492,6 +2045,7 @@ int explict;
 
 
   if (!xinbody && passthru) {print_inputline_nolinefeed(); /* [SS] 2011-06-10 */
+                            linecopyable = 0;
                             if ((xinhead) && (!xinbody)) {
                                 xinbody = 1;
                                 start_tune();
@@ -1499,6 +2053,9 @@ int explict;
                             inmusic = 0;
                             return;
                             }
+  if ((transpose != 0) || nokey || nokeysig) {
+    edited();
+  };
   if (gotkey) {
     setmap(sharps, basemap); /* required by copymap and pitchof */
     setmap(sharps, oldtable);
@@ -1601,7 +2158,8 @@ int a, b;
     emit_int(a);
   };
   if (b != 1) {
-    emit_int_sprintf("/%d", b);
+    emit_char('/');
+    emit_int(b);
   };
 }
 
@@ -1619,6 +2177,9 @@ int decorators[DECSIZE];
 {
   struct fract newlen;
 
+  if (lenfactor.num != lenfactor.denom) {
+    edited();
+  };
   inmusic = 1;
   if( type == 1) emit_string("x");
   else emit_string("z");
@@ -1658,7 +2219,7 @@ char* replist;
 {
   char msg[40];
 
-  if (!purgespace(tmp)) {
+  if (!purgespace()) {
     if (inmusic) {
       newabctext(bar);
     } else {
@@ -1874,22 +2435,21 @@ void event_chordon(int chorddecorators[])
 
 void event_chordoff(int chord_n, int chord_m)
 {
-  char string[16];
   emit_string("]");
   if(chord_n !=1 && chord_m !=1)
      {
-     sprintf(string,"%d/%d",chord_n,chord_m);
-     emit_string(string);
+     emit_int(chord_n);
+     emit_char('/');
+     emit_int(chord_m);
      }
   else if(chord_n !=1)
      {
-     sprintf(string,"%d",chord_n);
-     emit_string(string);
+     emit_int(chord_n);
      }
   else if(chord_m !=1)
      {
-     sprintf(string,"/%d",chord_m);
-     emit_string(string);
+     emit_char('/');
+     emit_int(chord_m);
      }
   inmusic = 1;
   addunits(chord_n, chord_m);
@@ -1953,6 +2513,7 @@ char* s;
     int pitch;
     int j;
 
+    edited();
     if (newkey >= 0) {
       roots = sharproots;
       bases = sharpbases;
@@ -2431,6 +2992,9 @@ int xmult;
 char xaccidental, xnote;
 int xoctave, n, m;
 {
+if ((transpose != 0) || nokey || nokeysig ||
+    (lenfactor.num != lenfactor.denom))
+  edited();
 if (nokey)
   event_note2(decorators, xaccidental, xmult, xnote, xoctave, n, m);
 else
@@ -2575,7 +3139,6 @@ void printpitch(int pitch)
 int p;
 char keylet,symlet;
 int keynum,symcod;
-char string[16];
 p = pitch%12;
 if (useflats)
  {keynum = flatmap[p];
@@ -2605,21 +3168,19 @@ switch (symcod) {
    break;
 }
  
-if (lastaccidental[keynum] == symcod)
-   sprintf(string,"%c",keylet);
-else {
-   sprintf(string,"%c%c", symlet, keylet);
+if (lastaccidental[keynum] != symcod) {
+   emit_char(symlet);
    lastaccidental[keynum] = symcod;
    }
-  emit_string(string);
+  emit_char(keylet);
 
 p = pitch;
 while (p >= MIDDLE + 12) {
-    emit_string("'");
+    emit_char('\'');
     p = p - 12;
     };
 while (p < MIDDLE - 12) {
-    emit_string(",");
+    emit_char(',');
     p = p + 12;
     };
 }
@@ -2640,6 +3201,7 @@ char *argv[];
   if (argc < 2) {
     /* printf("argc = %d\n", argc); */
   } else {
+    start_jobs(&filename);
     init_abbreviations();
     parsefile(filename);
     free_abbreviations();
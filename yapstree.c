@@ -115,12 +115,94 @@ struct fract* f;
   f->denom = f->denom/n;
 }
 
+/* Everything in the tree built for one tune comes from a chain of     */
+/* large blocks instead of one malloc() per note, feature, list element */
+/* and string. freetune() hands the whole tree back in one go and keeps */
+/* the blocks for the next tune. The space is cleared, as reused blocks */
+/* hold whatever the last tune left in them.                           */
+#define ARENABLOCK 32768
+
+union arenaalign {
+  double d;
+  long l;
+  void* p;
+};
+
+struct arenablock {
+  struct arenablock* next;
+  int size;
+  int used;
+  union arenaalign start[1];
+};
+
+static struct arenablock* arena = NULL;
+static struct arenablock* spareblocks = NULL;
+
+void* tunealloc(int bytes)
+/* allocate space for part of the current tune */
+{
+  struct arenablock* b;
+  void* p;
+  int size;
+
+  bytes = (bytes + sizeof(union arenaalign) - 1) /
+          sizeof(union arenaalign) * sizeof(union arenaalign);
+  if ((arena == NULL) || (arena->used + bytes > arena->size)) {
+    if ((bytes <= ARENABLOCK) && (spareblocks != NULL)) {
+      b = spareblocks;
+      spareblocks = b->next;
+    } else {
+      size = ARENABLOCK;
+      if (bytes > size) {
+        size = bytes;
+      };
+      b = (struct arenablock*)checkmalloc(sizeof(struct arenablock) + size);
+      b->size = size;
+    };
+    b->used = 0;
+    b->next = arena;
+    arena = b;
+  };
+  p = (char*)arena->start + arena->used;
+  arena->used = arena->used + bytes;
+  memset(p, 0, bytes);
+  return(p);
+}
+
+char* tunestring(char* s)
+/* store a copy of a string belonging to the current tune */
+{
+  char* p;
+
+  p = (char*)tunealloc(strlen(s) + 1);
+  strcpy(p, s);
+  return(p);
+}
+
+static void freearena()
+/* release everything allocated for the tune */
+/* blocks of the usual size are kept for re-use */
+{
+  struct arenablock* b;
+
+  while (arena != NULL) {
+    b = arena;
+    arena = b->next;
+    if (b->size == ARENABLOCK) {
+      b->next = spareblocks;
+      spareblocks = b;
+    } else {
+      free(b);
+    };
+  };
+}
+
 static struct fract* newfract(int a, int b)
 /* create an initialized fraction */
 {
   struct fract* f;
 
-  f = (struct fract*)checkmalloc(sizeof(struct fract));
+  f = (struct fract*)tunealloc(sizeof(struct fract));
   f->num = a;
   f->denom = b;
   return(f);
@@ -131,7 +213,7 @@ static struct slurtie* newslurtie()
 {
   struct slurtie* f;
 
-  f = (struct slurtie*)checkmalloc(sizeof(struct slurtie));
+  f = (struct slurtie*)tunealloc(sizeof(struct slurtie));
   f->begin = NULL;
   f->end = NULL;
   f->crossline = 0;
@@ -144,7 +226,7 @@ static struct atempo* newtempo(int count, int n, int m, int relative,
 {
   struct atempo* t;
 
-  t = (struct atempo*)checkmalloc(sizeof(struct atempo));
+  t = (struct atempo*)tunealloc(sizeof(struct atempo));
   t->count = count;
   t->basenote.num = n;
   t->basenote.denom = m;
@@ -152,12 +234,12 @@ static struct atempo* newtempo(int count, int n, int m, int relative,
   if (pre == NULL) {
     t->pre = NULL;
   } else {
-    t->pre = addstring(pre);
+    t->pre = tunestring(pre);
   };
   if (post == NULL) {
     t->post = NULL;
   } else {
-    t->post = addstring(post);
+    t->post = tunestring(post);
   };
   return(t);
 }
@@ -167,7 +249,7 @@ static struct vertspacing* newvertspacing()
 {
   struct vertspacing* p;
 
-  p = (struct vertspacing*)checkmalloc(sizeof(struct vertspacing));
+  p = (struct vertspacing*)tunealloc(sizeof(struct vertspacing));
   p->height = 0.0;
   p->descender = 0.0;
   p->yend = 0.0;
@@ -182,7 +264,7 @@ static struct tuple* newtuple(int n, int q, int r, int label)
 {
   struct tuple* f;
 
-  f = (struct tuple*)checkmalloc(sizeof(struct tuple));
+  f = (struct tuple*)tunealloc(sizeof(struct tuple));
   f->n = n;
   f->q = q;
   f->r = r;
@@ -196,7 +278,7 @@ static struct chord* newchord()
 {
   struct chord* f;
 
-  f = (struct chord*)checkmalloc(sizeof(struct chord));
+  f = (struct chord*)tunealloc(sizeof(struct chord));
   f->ytop = 0;
   f->ybot = 0;
   return(f);
@@ -207,7 +289,7 @@ struct aclef* newclef(enum cleftype t, int octave)
 {
   struct aclef* f;
 
-  f = (struct aclef*)checkmalloc(sizeof(struct aclef));
+  f = (struct aclef*)tunealloc(sizeof(struct aclef));
   f->type = t;
   f->octave = octave;
   return(f);
@@ -219,8 +301,8 @@ struct key* newkey(char* name, int sharps, char accidental[], int mult[])
   struct key* k;
   int i;
 
-  k = (struct key*)checkmalloc(sizeof(struct key));
-  k->name = addstring(name);
+  k = (struct key*)tunealloc(sizeof(struct key));
+  k->name = tunestring(name);
   k->sharps = sharps;
   for (i=0; i<7; i++) {
     k->map[i] = accidental[i];
@@ -242,7 +324,7 @@ void addtolist(struct llist* p, void* item)
 {
   struct el* x;
 
-  x = (struct el*)checkmalloc(sizeof(struct el));
+  x = (struct el*)tunealloc(sizeof(struct el));
   x->next = NULL;
   x->datum = item;
   if (p->first == NULL) {
@@ -286,30 +368,6 @@ void* nextitem(struct llist* p)
   };
 }
 
-void freellist(struct llist* l)
-/* frees up all dynamically allocated memory used to build the linked list */
-{
-  void* p;
-  struct el* e;
-  struct el* olde;
-
-  /* printf("freellist\n"); */
-  if (l != NULL) {
-    p = firstitem(l);
-    while (p != NULL) {
-      free(p);
-      p = nextitem(l);
-    };
-    e = l->first;
-    while (e != NULL) {
-      olde = e;
-      e = e->next;
-      free(olde);
-    };
-    init_llist(l);
-  };
-}
-
 static void closebeam(struct voice* v)
 /* called after a run of notes to be beamed together */
 {
@@ -518,7 +576,7 @@ static struct feature* addfeature(featuretype mytype, void* newitem)
     printf("xinhead = %d xinbody = %d\n", xinhead, xinbody);
     exit(0);
   };
-  x = (struct feature*)checkmalloc(sizeof(struct feature));
+  x = (struct feature*)tunealloc(sizeof(struct feature));
   x->next = NULL;
   x->type = mytype;
   x->item = newitem;
@@ -551,7 +609,7 @@ struct llist* newlist()
 {
   struct llist* l;
 
-  l = (struct llist*)checkmalloc(sizeof(struct llist));
+  l = (struct llist*)tunealloc(sizeof(struct llist));
   init_llist(l);
   return(l);
 }
@@ -680,7 +738,7 @@ static char* decstring(int decorators[])
   if (j==0) {
     return(NULL);
   } else {
-    return(addstring(decs));
+    return(tunestring(decs));
   };
 }
 
@@ -695,7 +753,7 @@ int a, b;
 {
   struct note* n;
 
-  n = (struct note*)checkmalloc(sizeof(struct note));
+  n = (struct note*)tunealloc(sizeof(struct note));
   setfract(&n->len, a, b);
   reducef(&n->len);
   n->dots = count_dots(&n->base, &n->base_exp, n->len.num, n->len.denom);
@@ -718,6 +776,7 @@ int a, b;
     n->stemup = 0;
   };
   n->stemlength = 0.0;
+  n->beaming = nostem;
   n->syllables = NULL;
   if (cv->ingrace) {
     n->gchords = NULL;
@@ -736,7 +795,7 @@ static struct rest* newrest(int a, int b, int multi)
 {
   struct rest* n;
 
-  n = (struct rest*)checkmalloc(sizeof(struct rest));
+  n = (struct rest*)tunealloc(sizeof(struct rest));
   setfract(&n->len, a, b);
   n->dots = count_dots(&n->base, &n->base_exp, a, b);
   if (n->dots == -1) {
@@ -781,7 +840,7 @@ static struct voice* newvoice(int n)
 {
   struct voice* v;
 
-  v = (struct voice*)checkmalloc(sizeof(struct voice));
+  v = (struct voice*)tunealloc(sizeof(struct voice));
   v->first = NULL;
   v->last = NULL;
   v->voiceno = n;
@@ -886,152 +945,19 @@ static void init_tune(struct tune* t, int x)
   init_llist(&t->words);
 };
 
-static void freekey(struct key* k)
-/* free up memory allocated for key data structure */
-{
-  if (k != NULL) { 
-    if (k->name != NULL) {
-      free(k->name);
-    };
-    free(k);
-  };
-}
-
-static void freetempo(struct atempo *t)
-/* free up memory allocated for temp data structure */
-{
-  if (t->pre != NULL) {
-    free(t->pre);
-  };
-  if (t->post != NULL) {
-    free(t->post);
-  };
-}
-
-static void freefeature(void* item, featuretype type)
-/* free memory allocated for feature in voice */
-{
-  struct note *n;
-  struct rest *r;
-
-  switch(type) {
-  case NOTE:
-    n = item;
-    if (n->accents != NULL) {
-      free(n->accents);
-    };
-    if (n->syllables != NULL) {
-      freellist(n->syllables);
-      free(n->syllables);
-    };
-    if (n->gchords != NULL) {
-      freellist(n->gchords);
-      free(n->gchords);
-    };
-    if (n->instructions != NULL) {
-      freellist(n->instructions);
-      free(n->instructions);
-    };
-    free(n);
-    break;
-  case REST:
-    r = item;
-    if (r->gchords != NULL) {
-      freellist(r->gchords);
-      free(r->gchords);
-    };
-    if (r->instructions != NULL) {
-      freellist(r->instructions);
-      free(r->instructions);
-    };
-    free(r);
-    break;
-  case KEY:
-    freekey(item);
-    break;
-  case TEMPO:
-    freetempo(item);
-    break;
-  case CLEF:
-  case TIME:
-  case PART:
-  case CHORDON:
-  case TUPLE:
-  case SLUR_ON:
-  case TIE:
-  case PLAY_ON_REP:
-  case LEFT_TEXT:
-  case PRINTLINE:
-    if (item != NULL) {
-      free(item);
-    };
-    break;
-  default:
-    break;
-  };
-}
-
-static void freevoice(struct voice* v)
-/* free up memory allocated for voice data structure and voice data */
-{
-  struct feature* ft;
-  struct feature* oldft;
-
-  ft = v->first;
-  while (ft != NULL) {
-    freefeature(ft->item, ft->type);
-    oldft = ft;
-    ft = ft->next;
-    free(oldft);
-  };
-  if (v->keysig != NULL) {
-    freekey(v->keysig);
-    v->keysig = NULL;
-  };
-  if (v->tempo != NULL) {
-    freetempo(v->tempo);
-    v->tempo = NULL;
-  };
-  if (v->clef != NULL) {
-    free(v->clef);
-  };
-  v->clef = NULL;
-}
-
 static void freetune(struct tune* t)
 /* free up all dynamically allocated memory associated with tune */
 {
-  struct voice* v;
-
-  if (t->composer != NULL) {
-    free(t->composer);
-    t->composer = NULL;
-  };
-  if (t->origin != NULL) {
-    free(t->origin);
-    t->origin = NULL;
-  };
-  if (t->parts != NULL) {
-    free(t->parts);
-    t->parts = NULL;
-  };
-  freellist(&t->title);
-  freellist(&t->notes);
-  if (t->keysig != NULL) {
-    freekey(t->keysig);
-    t->keysig = NULL;
-  };
-  if (t->tempo != NULL) {
-    freetempo(t->tempo);
-    t->tempo = NULL;
-  };
-  v = firstitem(&t->voices);
-  while (v != NULL) {
-    freevoice(v);
-    v = nextitem(&t->voices);
-  };
-  freellist(&t->voices);
-  freellist(&t->words);
+  t->composer = NULL;
+  t->origin = NULL;
+  t->parts = NULL;
+  init_llist(&t->title);
+  init_llist(&t->notes);
+  t->keysig = NULL;
+  t->tempo = NULL;
+  init_llist(&t->voices);
+  init_llist(&t->words);
+  freearena();
 }
 
 static int checkmatch(int refno)
@@ -1077,6 +1003,137 @@ static int checkmatch(int refno)
   return(select);
 }
 
+/* For the -C layout cache each tune is identified by its own text,  */
+/* running from its X: field to the next one, and by everything     */
+/* earlier in the file which can change the way it is set out: the  */
+/* file header and any %% directive or I:, U: or m: field line.     */
+struct tunetext {
+  long start, len;
+  int no;                     /* number in the X: field */
+  unsigned long context[2];   /* hash of what comes before the tune */
+};
+
+static char* abctext = NULL;
+static struct tunetext* tunetexts = NULL;
+static int tunetextcount = 0;
+static int tuneindex = -1; /* X: fields seen so far, less one */
+
+static void addhash(h, s, n)
+unsigned long h[2];
+char* s;
+long n;
+/* add n characters to a pair of 32-bit hash values (FNV-1a and sdbm) */
+{
+  long i;
+  unsigned long c;
+
+  for (i=0; i<n; i++) {
+    c = (unsigned char)s[i];
+    h[0] = ((h[0] ^ c) * 16777619UL) & 0xffffffffUL;
+    h[1] = (c + (h[1] << 6) + (h[1] << 16) - h[1]) & 0xffffffffUL;
+  };
+}
+
+static void scantunes(filename)
+char* filename;
+/* find the text of each tune in the input file for the layout cache */
+{
+  FILE* fp;
+  long size, got, p, eol, space;
+  unsigned long context[2];
+  struct tunetext* tt;
+  char* line;
+
+  fp = fopen(filename, "rb");
+  if (fp == NULL) {
+    return;
+  };
+  size = 0;
+  space = 65536;
+  abctext = (char*)checkmalloc(space);
+  while ((got = fread(abctext+size, 1, space-size, fp)) > 0) {
+    size = size + got;
+    if (size == space) {
+      space = space*2;
+      abctext = (char*)realloc(abctext, space);
+      if (abctext == NULL) {
+        /* the cache is not used */
+        fclose(fp);
+        return;
+      };
+    };
+  };
+  fclose(fp);
+  context[0] = 2166136261UL;
+  context[1] = 0;
+  space = 0;
+  tt = NULL;
+  for (p = 0; p < size; p = eol) {
+    line = abctext + p;
+    eol = p;
+    while ((eol < size) && (abctext[eol] != '\n')) {
+      eol = eol + 1;
+    };
+    if (eol < size) {
+      eol = eol + 1;
+    };
+    if ((eol - p >= 2) && (line[0] == 'X') && (line[1] == ':')) {
+      if (tunetextcount == space) {
+        space = space + 256;
+        tunetexts = (struct tunetext*)realloc(tunetexts, 
+                                       space*sizeof(struct tunetext));
+        if (tunetexts == NULL) {
+          tunetextcount = 0;
+          return;
+        };
+      };
+      tt = &tunetexts[tunetextcount];
+      tunetextcount = tunetextcount + 1;
+      tt->start = p;
+      tt->no = (int)strtol(line+2, NULL, 10);
+      tt->context[0] = context[0];
+      tt->context[1] = context[1];
+    };
+    if (tt != NULL) {
+      tt->len = eol - tt->start;
+    };
+    if ((tt == NULL) || (line[0] == '%') || 
+        ((eol - p >= 2) && (line[1] == ':') && 
+         ((line[0] == 'I') || (line[0] == 'U') || (line[0] == 'm')))) {
+      addhash(context, line, eol - p);
+    };
+  };
+}
+
+int tunekey(t, settings, key)
+struct tune* t;
+char* settings;
+char* key;
+/* work out the name under which the layout of tune t is cached */
+/* from its text and the layout settings. Returns 0 if the tune */
+/* cannot be matched up with the text of the file.              */
+{
+  struct tunetext* tt;
+  unsigned long h[2];
+  char options[80];
+
+  if ((tuneindex < 0) || (tuneindex >= tunetextcount)) {
+    return(0);
+  };
+  tt = &tunetexts[tuneindex];
+  if (tt->no != t->no) {
+    return(0);
+  };
+  h[0] = tt->context[0];
+  h[1] = tt->context[1];
+  sprintf(options, "%s %d\n", VERSION, oldchordconvention);
+  addhash(h, options, (long)strlen(options));
+  addhash(h, settings, (long)strlen(settings));
+  addhash(h, abctext+tt->start, tt->len);
+  sprintf(key, "%08lx%08lx", h[0], h[1]);
+  return(1);
+}
+
 void event_init(argc, argv, filename)
 int argc;
 char* argv[];
@@ -1090,6 +1147,9 @@ char** filename;
   int papsize, margins, newscale;
   int ier;
   int j;
+  int jobs;
+  int pdfarg;
+  int cachedir;
 
   if (getarg("-ver",argc, argv) != -1) {
 	  printf("%s\n",VERSION);
@@ -1105,6 +1165,13 @@ char** filename;
   } else {
     eps_out = 0;
   };
+  pdfarg = getarg("-pdf", argc, argv);
+  if (pdfarg != -1) {
+    pdf_out = 1;
+    if ((argc > pdfarg) && (strcmp(argv[pdfarg], "0") == 0)) {
+      pdf_compress = 0;
+    };
+  };
   if (getarg("-OCC",argc,argv) != -1) oldchordconvention=1;
   if (getarg("-V", argc, argv) != -1) {
     separate_voices = 1;
@@ -1148,6 +1215,20 @@ char** filename;
   ier = 0;
   if ((barnums != -1) && (argc > barnums)) ier = sscanf(argv[barnums],"%d",&nnbars);
   if ((barnums != -1) && (ier <1)) nnbars = 1;
+  jobs = getarg("-j", argc, argv);
+  if ((jobs != -1) && (argc > jobs)) {
+    sscanf(argv[jobs], "%d", &layoutjobs);
+    if (layoutjobs < 1) {
+      layoutjobs = 1;
+    };
+    if (layoutjobs > MAXLAYOUTJOBS) {
+      layoutjobs = MAXLAYOUTJOBS;
+    };
+  };
+  cachedir = getarg("-C", argc, argv);
+  if ((cachedir != -1) && (argc > cachedir)) {
+    layoutcache = addstring(argv[cachedir]);
+  };
 
   refmatch = getarg("-e", argc, argv);
   if (refmatch == -1) {
@@ -1170,11 +1251,16 @@ char** filename;
     printf("     list is comma-separated and may contain ranges\n");
     printf("     but no spaces e.g. 1,3,7-20\n");
     printf("  -E            : generate Encapsulated PostScript\n");
+    printf("  -pdf [0]      : generate PDF instead of PostScript\n");
+    printf("     0 leaves the page contents uncompressed\n");
     printf("  -l            : landscape mode\n");
     printf("  -M XXXxYYY    : set margin sizes in points\n");
     printf("     28.3 points = 1cm, 72 points = 1 inch\n");
     printf("  -N            : add page numbering\n");
     printf("  -k [nn]       : number every nn bars\n");
+    printf("  -j n          : lay out n tunes at once in separate processes\n");
+    printf("  -C <dir>      : keep the layout of each tune in directory dir\n");
+    printf("     and reuse it while the tune and options are unchanged\n");
     printf("  -o <filename> : specify output file\n");
     printf("  -P ss         : paper size; 0 is A4, 1 is US Letter\n");
     printf("     or XXXxYYY to set size in points\n");
@@ -1184,7 +1270,7 @@ char** filename;
     printf("  -OCC          : old chord convention (eg. +CE+)\n");
     printf("Takes an abc music file and converts it to PostScript.\n");
     printf("If no output filename is given, then by default it is\n");
-    printf("the input filename but with extension .ps .\n");
+    printf("the input filename but with extension .ps (.pdf with -pdf).\n");
     exit(0);
   } else {
     *filename = argv[1];
@@ -1199,9 +1285,9 @@ char** filename;
     strncpy(outputname, argv[1],256);
     place = strchr(outputname, '.');
     if (place == NULL) {
-      strcat(outputname, ".ps");
+      strcat(outputname, pdf_out ? ".pdf" : ".ps");
     } else {
-      strcpy(place, ".ps");
+      strcpy(place, pdf_out ? ".pdf" : ".ps");
     };
     if (strcmp(argv[1], outputname)==0) {
       printf("argument must be abc file, not PostScript file\n");
@@ -1243,16 +1329,8 @@ static void check_voice_end(struct voice* v)
     event_error("incomplete ties at end of voice");
     v->tiespending = 0;
   };
-  if (v->gchords_pending != NULL) {
-    freellist(v->gchords_pending);
-    free(v->gchords_pending);
-    v->gchords_pending = NULL;
-  };
-  if (v->instructions_pending != NULL) {
-    freellist(v->instructions_pending);
-    free(v->instructions_pending);
-    v->instructions_pending = NULL;
-  };
+  v->gchords_pending = NULL;
+  v->instructions_pending = NULL;
   if (v->tuplenotes > 0) {
     event_error("incomplete tuple at end of voice");
     v->tuplenotes = 0;
@@ -1486,7 +1564,7 @@ char *str; /* string following first word */
         lefttext(s);
       };
     } else {
-      addfeature(LEFT_TEXT, addstring(s));
+      addfeature(LEFT_TEXT, tunestring(s));
     };
   };
   if ((strcmp(p, "centre") == 0) || (strcmp(p, "center") == 0)) {
@@ -1495,7 +1573,7 @@ char *str; /* string following first word */
         centretext(s);
       };
     } else {
-      addfeature(CENTRE_TEXT, addstring(s));
+      addfeature(CENTRE_TEXT, tunestring(s));
     };
   };
   if (strcmp(p, "vskip") == 0) {
@@ -1536,30 +1614,30 @@ char *f;
     if (debugging) {
       printf("T:%s\n", f);
     };
-    addtolist(&thetune.title, addstring(f));
+    addtolist(&thetune.title, tunestring(f));
     break;
   case 'C':
     if (thetune.composer != NULL) {
       event_error("More than one C: field in tune");
     } else {
-      thetune.composer = addstring(f);
+      thetune.composer = tunestring(f);
     };
     break;
   case 'O':
     if (thetune.origin != NULL) {
       event_error("More than one O: field in tune");
     } else {
-      thetune.origin = addstring(f);
+      thetune.origin = tunestring(f);
     };
     break;
   case 'W':
     if (debugging) {
       printf("W:%s\n", f);
     };
-    addtolist(&thetune.words, addstring(f));
+    addtolist(&thetune.words, tunestring(f));
     break;
   case 'N':
-    addtolist(&thetune.notes, addstring(f));
+    addtolist(&thetune.notes, tunestring(f));
     break;
   default:
     break;
@@ -1623,10 +1701,10 @@ struct feature* apply_syll(char* s, struct feature* wordplace, int* errors)
 /*
     if (strlen(s) < 80) {
       ISOdecode(s, isocode);
-      addtolist(n->syllables, addstring(isocode));
+      addtolist(n->syllables, tunestring(isocode));
     } else {
 */
-      addtolist(n->syllables, addstring(s));
+      addtolist(n->syllables, tunestring(s));
 /*
     };
 */
@@ -1756,7 +1834,7 @@ char* s;
     if (thetune.parts != NULL) {
       event_error("Multiple P: fields in header");
     } else {
-      thetune.parts = addstring(s);
+      thetune.parts = tunestring(s);
     };
   };
   if (xinbody) {
@@ -1766,7 +1844,7 @@ char* s;
       cv->instructions_pending = newlist();
     };
     sprintf(label, ":p%s", s);
-    addtolist(cv->instructions_pending, addstring(label));
+    addtolist(cv->instructions_pending, tunestring(label));
   };
 }
 
@@ -1815,6 +1893,7 @@ int n;
     printtune(&thetune);
   };
   freetune(&thetune);
+  tuneindex = tuneindex + 1;
   xinbody = 0;
   xinhead = 0;
   suppress = 0;
@@ -2278,7 +2357,7 @@ void event_playonrep(s)
 char* s;
 /* play on repeat(s) X - where X can be a list */
 {
-  addfeature(PLAY_ON_REP, addstring(s));
+  addfeature(PLAY_ON_REP, tunestring(s));
 }
 
 void event_broken(type, mult)
@@ -2354,9 +2433,9 @@ char* s;
   if (cv->instructions_pending == NULL) {
     cv->instructions_pending = newlist();
     };
-  addtolist(cv->instructions_pending, addstring(s+1));
+  addtolist(cv->instructions_pending, tunestring(s+1));
   } else {
-    addtolist(cv->gchords_pending, addstring(s));
+    addtolist(cv->gchords_pending, tunestring(s));
   };
 }
 
@@ -2399,18 +2478,18 @@ char* s;
     if (cv->instructions_pending == NULL) {
       cv->instructions_pending = newlist();
      };
-    addtolist(cv->instructions_pending, addstring(inst));
+    addtolist(cv->instructions_pending, tunestring(inst));
     return;
     }
   if (strcmp(s,"red") == 0)
    {     
-   psaction = (struct dynamic*) checkmalloc(sizeof(struct note));
+   psaction = (struct dynamic*) tunealloc(sizeof(struct dynamic));
    psaction->color = 'r';
    addfeature(DYNAMIC,psaction);
    }
   if (strcmp(s,"black") == 0)
    {     
-   psaction = (struct dynamic*) checkmalloc(sizeof(struct note));
+   psaction = (struct dynamic*) tunealloc(sizeof(struct dynamic));
    psaction->color = 'b';
    addfeature(DYNAMIC,psaction);
    }
@@ -2996,6 +3075,10 @@ char *argv[];
   if (argc < 2) {
     /* printf("argc = %d\n", argc); */
   } else {
+    if (layoutcache != NULL) {
+      scantunes(filename);
+    };
+    start_layout_jobs();
     init_abbreviations();
     parsefile(filename);
     free_abbreviations();